@@ -23,7 +23,10 @@
 
 #include "gen/account_ids.hh"
 
+#include "error.hh"
+
 #include <string.h>
+#include <errno.h>
 #define __STDC_FORMAT_MACROS
 #include <inttypes.h>
 #include <stdio.h>
@@ -31,12 +34,53 @@
 
 uint64 _data_account[NUM_ACCOUNT_IDS];
 
+// One extra item, as there may be no select statements.
+uint64 _match_account[NUM_MATCH_ACCOUNT_IDS + 1];
+
 void account_init()
 {
   ssize_t i;
 
   for (i = 0; i < NUM_ACCOUNT_IDS; i++)
     _data_account[i] = 0;
+  for (i = 0; i < NUM_MATCH_ACCOUNT_IDS; i++)
+    _match_account[i] = 0;
+}
+
+// The profile is read by ucesbgen --profile=FILE, to try the most
+// common candidates of select statements first.
+
+void account_write_match_profile(const char *filename)
+{
+  FILE *fid = fopen(filename, "w");
+  ssize_t i;
+
+  if (!fid)
+    {
+      WARNING("Failure opening match profile '%s' for writing: %s",
+	      filename, strerror(errno));
+      return;
+    }
+
+  fprintf (fid, "# structure select candidate ident count\n");
+
+  for (i = 0; i < NUM_MATCH_ACCOUNT_IDS; i++)
+    {
+      match_account_id *acc_id = &_match_account_ids[i];
+
+      fprintf (fid, "%s %d %d %s %" PRIu64 "\n",
+	       acc_id->_name,
+	       acc_id->_select_no,
+	       acc_id->_index,
+	       acc_id->_ident,
+	       (uint64_t) _match_account[i]);
+    }
+
+  if (fclose(fid) != 0)
+    WARNING("Failure writing match profile '%s': %s",
+	    filename, strerror(errno));
+  else
+    INFO(0,"Wrote match profile '%s'.", filename);
 }
 
 void account_show()
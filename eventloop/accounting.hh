@@ -34,8 +34,19 @@ struct account_id
   const char* _ident;
 };
 
+struct match_account_id
+{
+  int         _internal;
+
+  const char* _name;
+  int         _select_no;
+  int         _index;
+  const char* _ident;
+};
+
 void account_init();
 void account_show();
+void account_write_match_profile(const char *filename);
 
 #endif//__ACCOUNTING_HH__
 
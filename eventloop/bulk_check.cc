@@ -0,0 +1,113 @@
+/* This file is part of UCESB - a tool for data unpacking and processing.
+ *
+ * Copyright (C) 2016  Haakan T. Johansson  <f96hajo@chalmers.se>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301  USA
+ */
+
+#include "bulk_check.hh"
+
+#include "optimise.hh"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BULK_CHECK_X86 1
+#include <immintrin.h>
+#endif
+
+static bool bulk_check_32_plain(const uint32 *src,size_t words,
+				uint32 mask,uint32 value)
+{
+  uint32 diff = 0;
+
+  for ( ; words; words--)
+    diff |= (*(src++) & mask) ^ value;
+  return !diff;
+}
+
+#ifdef BULK_CHECK_X86
+
+__attribute__((target("sse2")))
+static bool bulk_check_32_sse2(const uint32 *src,size_t words,
+			       uint32 mask,uint32 value)
+{
+  const __m128i vmask  = _mm_set1_epi32((int) mask);
+  const __m128i vvalue = _mm_set1_epi32((int) value);
+  __m128i diff = _mm_setzero_si128();
+
+  for ( ; words >= 4; words -= 4, src += 4)
+    {
+      __m128i v = _mm_loadu_si128((const __m128i *) src);
+      diff = _mm_or_si128(diff,_mm_xor_si128(_mm_and_si128(v,vmask),vvalue));
+    }
+  if (_mm_movemask_epi8(_mm_cmpeq_epi32(diff,_mm_setzero_si128())) != 0xffff)
+    return false;
+  return bulk_check_32_plain(src,words,mask,value);
+}
+
+__attribute__((target("avx2")))
+static bool bulk_check_32_avx2(const uint32 *src,size_t words,
+			       uint32 mask,uint32 value)
+{
+  const __m256i vmask  = _mm256_set1_epi32((int) mask);
+  const __m256i vvalue = _mm256_set1_epi32((int) value);
+  __m256i diff = _mm256_setzero_si256();
+
+  for ( ; words >= 8; words -= 8, src += 8)
+    {
+      __m256i v = _mm256_loadu_si256((const __m256i *) src);
+      diff = _mm256_or_si256(diff,
+			     _mm256_xor_si256(_mm256_and_si256(v,vmask),
+					      vvalue));
+    }
+  if (!_mm256_testz_si256(diff,diff))
+    return false;
+  return bulk_check_32_plain(src,words,mask,value);
+}
+
+typedef bool (*bulk_check_32_fcn)(const uint32 *,size_t,uint32,uint32);
+
+static bulk_check_32_fcn bulk_check_32_select()
+{
+  __builtin_cpu_init();
+
+  if (__builtin_cpu_supports("avx2"))
+    return bulk_check_32_avx2;
+  if (__builtin_cpu_supports("sse2"))
+    return bulk_check_32_sse2;
+  return bulk_check_32_plain;
+}
+
+// Same answer for all threads, so no harm if several set it.
+static bulk_check_32_fcn _bulk_check_32_fcn = NULL;
+
+bool bulk_check_32(const uint32 *src,size_t words,
+		   uint32 mask,uint32 value)
+{
+  if (UNLIKELY(!_bulk_check_32_fcn))
+    _bulk_check_32_fcn = bulk_check_32_select();
+
+  return _bulk_check_32_fcn(src,words,mask,value);
+}
+
+#else//!BULK_CHECK_X86
+
+bool bulk_check_32(const uint32 *src,size_t words,
+		   uint32 mask,uint32 value)
+{
+  return bulk_check_32_plain(src,words,mask,value);
+}
+
+#endif//BULK_CHECK_X86
@@ -0,0 +1,36 @@
+/* This file is part of UCESB - a tool for data unpacking and processing.
+ *
+ * Copyright (C) 2016  Haakan T. Johansson  <f96hajo@chalmers.se>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301  USA
+ */
+
+#ifndef __BULK_CHECK_HH__
+#define __BULK_CHECK_HH__
+
+#include "typedef.hh"
+
+#include <stddef.h>
+
+// Check that all words have (word & mask) == value.  Used by the
+// generated code for lists of identical data words, to test their
+// fixed bits before the (then check-free) unpack loop.  Uses SSE2 or
+// AVX2 compares when the CPU has them (checked at run-time).
+
+bool bulk_check_32(const uint32 *src,size_t words,
+		   uint32 mask,uint32 value);
+
+#endif//__BULK_CHECK_HH__
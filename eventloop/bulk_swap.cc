@@ -0,0 +1,104 @@
+/* This file is part of UCESB - a tool for data unpacking and processing.
+ *
+ * Copyright (C) 2016  Haakan T. Johansson  <f96hajo@chalmers.se>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301  USA
+ */
+
+#include "bulk_swap.hh"
+
+#include "byteswap_include.h"
+#include "optimise.hh"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BULK_SWAP_X86 1
+#include <immintrin.h>
+#endif
+
+static void bulk_swap_32_plain(uint32 *dest,const uint32 *src,size_t words)
+{
+  for ( ; words; words--)
+    *(dest++) = bswap_32(*(src++));
+}
+
+#ifdef BULK_SWAP_X86
+
+// Shuffle pattern reversing the bytes of each 32-bit word
+#define BULK_SWAP_SHUFFLE_32			\
+  3,  2,  1,  0,  7,  6,  5,  4,		\
+  11, 10,  9,  8, 15, 14, 13, 12
+
+__attribute__((target("ssse3")))
+static void bulk_swap_32_ssse3(uint32 *dest,const uint32 *src,size_t words)
+{
+  const __m128i shuffle = _mm_setr_epi8(BULK_SWAP_SHUFFLE_32);
+
+  for ( ; words >= 4; words -= 4, src += 4, dest += 4)
+    {
+      __m128i v = _mm_loadu_si128((const __m128i *) src);
+      _mm_storeu_si128((__m128i *) dest,_mm_shuffle_epi8(v,shuffle));
+    }
+  bulk_swap_32_plain(dest,src,words);
+}
+
+__attribute__((target("avx2")))
+static void bulk_swap_32_avx2(uint32 *dest,const uint32 *src,size_t words)
+{
+  const __m256i shuffle = _mm256_setr_epi8(BULK_SWAP_SHUFFLE_32,
+					   BULK_SWAP_SHUFFLE_32);
+
+  for ( ; words >= 8; words -= 8, src += 8, dest += 8)
+    {
+      __m256i v = _mm256_loadu_si256((const __m256i *) src);
+      _mm256_storeu_si256((__m256i *) dest,_mm256_shuffle_epi8(v,shuffle));
+    }
+  bulk_swap_32_plain(dest,src,words);
+}
+
+typedef void (*bulk_swap_32_fcn)(uint32 *,const uint32 *,size_t);
+
+// Set by bulk_swap_init(), only read after that.
+static bulk_swap_32_fcn _bulk_swap_32_fcn = bulk_swap_32_plain;
+
+void bulk_swap_init()
+{
+  __builtin_cpu_init();
+
+  if (__builtin_cpu_supports("avx2"))
+    _bulk_swap_32_fcn = bulk_swap_32_avx2;
+  else if (__builtin_cpu_supports("ssse3"))
+    _bulk_swap_32_fcn = bulk_swap_32_ssse3;
+  else
+    _bulk_swap_32_fcn = bulk_swap_32_plain;
+}
+
+void bulk_swap_32(uint32 *dest,const uint32 *src,size_t words)
+{
+  _bulk_swap_32_fcn(dest,src,words);
+}
+
+#else//!BULK_SWAP_X86
+
+void bulk_swap_init()
+{
+}
+
+void bulk_swap_32(uint32 *dest,const uint32 *src,size_t words)
+{
+  bulk_swap_32_plain(dest,src,words);
+}
+
+#endif//BULK_SWAP_X86
@@ -0,0 +1,37 @@
+/* This file is part of UCESB - a tool for data unpacking and processing.
+ *
+ * Copyright (C) 2016  Haakan T. Johansson  <f96hajo@chalmers.se>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301  USA
+ */
+
+#ifndef __BULK_SWAP_HH__
+#define __BULK_SWAP_HH__
+
+#include "typedef.hh"
+
+#include <stddef.h>
+
+// Byte-swap an array of 32-bit words while copying it.  Uses SSSE3
+// or AVX2 shuffles when the CPU has them, and a plain bswap loop
+// otherwise.  The CPU is checked by bulk_swap_init(), which is to be
+// called once (when --bulk-swap is given) before any threads start.
+
+void bulk_swap_init();
+
+void bulk_swap_32(uint32 *dest,const uint32 *src,size_t words);
+
+#endif//__BULK_SWAP_HH__
@@ -77,7 +77,8 @@ struct config_opts
   int _show_members;
   int _event_sizes;
   int _member_dump;
-  int _account;
+  int _account; // 1: data sizes, 2: match profile
+  const char *_match_profile;
   int _show_calib;
 
   char const *_ts_align_hist_command;
@@ -91,6 +92,8 @@ struct config_opts
 
 #ifdef USE_LMD_INPUT
   int _scramble;
+  int _bulk_swap;
+  int _build_index;
 #endif
   uint64_t _input_buffer;
 
@@ -101,6 +104,7 @@ struct config_opts
   int64_t _eventbuilder_window;
   bool _aida_new_stitch;
   bool _aida_skip_decays;
+  int _aida_decoders;
   bool _enable_dtas;
 #endif
 
@@ -133,9 +137,11 @@ struct config_opts
   } _dump;
 
   int _num_threads;
+  const char *_pin; // NULL: none
   int _progress;
 
   int _files_open_ahead;
+  int _split_file;
 
 #ifdef USE_MERGING
   int _merge_concurrent_files;
@@ -143,8 +149,13 @@ struct config_opts
 #endif
 
   int _no_mmap;
+  int _input_io;
+  int _external_decompress;
 };
 
+#define INPUT_IO_DEFAULT  0 // mmap, or read() when not possible
+#define INPUT_IO_URING    1 // io_uring, if supported by the kernel
+
 extern config_opts _conf;
 
 extern config_input_vect _inputs;
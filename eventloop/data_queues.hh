@@ -38,6 +38,7 @@ struct ofq_item
   int                _info;
 
   data_input_source *_source;
+  const char        *_name;    // of the input, for diagnostics
   reclaim_item      *_reclaim;
   reclaim_item     **_last_reclaim;
 };
@@ -50,6 +51,8 @@ struct ofq_item
 #define EQ_INFO_NEXT_PROCESS_MASK 0x000000ff // mask to tell what is next processing stage
 #define EQ_INFO_PROCESS           0x00000100 // event is to continue processing
 #define EQ_INFO_DAMAGED           0x00000200 // event was damaged (no further processing)
+#define EQ_INFO_PRE_UNPACKED      0x00000400 // subevents already located (merging)
+#define EQ_INFO_UNPACKED          0x00000800 // already unpacked (merging, user order)
 
 #define EQ_INFO_PRINT_EVENT       0x00010000 // event header should be printed
 #define EQ_INFO_PRINT_EVENT_DATA  0x00020000 // event data should be printed
@@ -75,7 +78,11 @@ struct eq_item
 
 //////////////////////////////////////////////////////////////////////
 
-#define MAX_THREADS           4
+// The number of worker (unpack) threads is given at run-time
+// (--threads=N, default: the number of available CPUs).  The per-worker
+// queues are allocated by init() of the fan-out/in queues.
+
+#define MAX_THREADS           1024 // sanity limit
 
 //////////////////////////////////////////////////////////////////////
 // Queue for opened data files that should be processed
@@ -25,6 +25,7 @@
 
 #include "endian.hh"
 #include "swapping.hh"
+#include "bulk_check.hh"
 
 #include <stdlib.h>
 
@@ -248,6 +249,18 @@ public:
     return true;
   }
 
+  // Do the next (words) 32-bit words all have (word & mask) == value?
+  // Nothing is consumed.  False also if the words are not available.
+  // Swapping is handled by swapping mask and value instead of the data.
+  bool check_uint32_all(size_t words,uint32 mask,uint32 value)
+  {
+    if (words * sizeof(uint32) > left() || (((size_t) _data) & 3))
+      return false;
+
+    return bulk_check_32((const uint32 *) _data,words,
+			 SWAPPING_BSWAP_32(mask),SWAPPING_BSWAP_32(value));
+  }
+
 public:
   bool empty() { return _data == _end; }
 
@@ -341,6 +354,9 @@ public:
     return true;
   }
 
+  // No batched checks of 32-bit words in 16-bit data.
+  bool check_uint32_all(size_t,uint32,uint32) { return false; }
+
 public:
   bool empty() { return _data == _end; }
 
@@ -427,6 +443,15 @@ public:
     return true;
   }
 
+  bool check_uint32_all(size_t words,uint32 mask,uint32 value)
+  {
+    if (words > (size_t) (_end - _data))
+      return false;
+
+    return bulk_check_32(_data,words,
+			 SWAPPING_BSWAP_32(mask),SWAPPING_BSWAP_32(value));
+  }
+
 public:
   bool empty() { return _data == _end; }
 
@@ -439,6 +464,7 @@ public:
 #endif
 
 extern uint64 _data_account[];
+extern uint64 _match_account[];
 
 inline void do_account_uint64(int account_id)
 {
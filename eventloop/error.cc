@@ -232,6 +232,6 @@ void reclaim_eject_message(tb_reclaim *tbr)
       fprintf (stderr,"%s\n",er->_message);
     }
 
-  tbr->_buffer->reclaim(tbr->_reclaim);
+  tbr->_buffer->reclaim(tbr->_chunk,tbr->_reclaim);
 }
 #endif
@@ -25,12 +25,37 @@
 #include "structures.hh"
 #include "hex_dump_mark.hh"
 
+#ifdef USE_LMD_INPUT
+// Time-stitching information of one event, as extracted (in parallel
+// by the unpack workers) by stitch_prepare(), for the (serial)
+// decision by stitch_decide().
+
+#define STITCH_STAMP_NONE      0 // not extracted (failed)
+#define STITCH_STAMP_GOOD      1
+#define STITCH_STAMP_BAD       2 // error set in time-stamp
+
+struct stitch_stamp
+{
+  uint64_t _timestamp;
+  int      _status;
+#ifdef USE_INPUTFILTER
+  bool     _implant_aida;
+  bool     _implant_frs;
+  bool     _special_trigger; // never stitched
+  int64_t  _aida_length;     // window extension (0 if none)
+#endif
+};
+#endif
+
 class event_base
 {
 public:
 #if USE_THREADING || USE_MERGING
   // FILE_INPUT_EVENT *event;
   void        *_file_event;
+#endif
+#if USE_THREADING && defined(USE_LMD_INPUT)
+  stitch_stamp _stitch; // extracted by the unpack worker
 #endif
   hex_dump_mark_buf _unpack_fail;
   unpack_event _unpack;
@@ -55,8 +55,13 @@
 
 #include "../common/strndup.hh"
 
+#include "bulk_swap.hh"
+#include "worker_thread.hh"
+#include "thread_buffer.hh"
+
 #include <assert.h>
 #include <stdio.h>
+#include <string.h>
 
 #define __STDC_FORMAT_MACROS
 #include <inttypes.h>
@@ -73,6 +78,10 @@ ucesb_event_loop::ucesb_event_loop()
 #ifdef USE_EXT_WRITER
   _ext_source = NULL;
 #endif
+#if defined(USE_LMD_INPUT) && !defined(USE_MERGING) && !defined(USE_THREADING)
+  _index_build = NULL;
+  _index_build_name = NULL;
+#endif
 }
 
 ucesb_event_loop::~ucesb_event_loop()
@@ -93,8 +102,8 @@ tstamp_sync_check *_ts_sync_check = NULL;
 event_base _static_event;
 sticky_event_base _static_sticky_event;
 
-#ifdef USE_MERGING
-// and not USE_THREADING, but does not compile together anyhow
+#if defined(USE_MERGING) && !defined(USE_THREADING)
+// (with threading, CURRENT_EVENT is per thread)
 event_base *_current_event = NULL;
 #endif
 
@@ -259,8 +268,10 @@ void ucesb_event_loop::postprocess()
 
   if (_conf._event_sizes)
     _event_sizes.show();
-  if (_conf._account)
+  if (_conf._account & 1)
     account_show();
+  if (_conf._match_profile)
+    account_write_match_profile(_conf._match_profile);
 
 #ifdef EXIT_USER_FUNCTION
   EXIT_USER_FUNCTION();
@@ -326,6 +337,9 @@ void ucesb_event_loop::close_sources()
 void ucesb_event_loop::close_source()
 {
   bool boom = false;
+#if defined(USE_LMD_INPUT) && !defined(USE_THREADING)
+  close_source_index();
+#endif
   try {
     _source.close();
   } catch (error &e) {
@@ -951,8 +965,101 @@ void ucesb_event_loop::open_source(config_input &input,
 #endif
 	      input,file_input
 	      PTHREAD_ARG(block_reader) );
+#ifdef USE_LMD_INPUT
+  open_source_index(input);
+#endif
 #endif
 }
+
+#if defined(USE_LMD_INPUT) && !defined(USE_MERGING)
+void ucesb_event_loop::open_source_index(config_input &input)
+{
+  if (!_conf._build_index ||
+      input._type != INPUT_TYPE_FILE)
+    return;
+
+  // The offsets are only file offsets if the file is read directly.
+  if (!_source._input._input->seekable())
+    {
+      WARNING("Cannot build index for '%s', "
+	      "not read as plain file with mmap.",input._name);
+      return;
+    }
+
+  _index_build = new lmd_index;
+  _index_build_name = strdup(input._name);
+
+  _source._index_build = _index_build;
+}
+
+void ucesb_event_loop::close_source_index()
+{
+  if (!_index_build)
+    return;
+
+  _index_build->write(_index_build_name);
+
+  _source._index_build = NULL;
+
+  delete _index_build;
+  free(_index_build_name);
+  _index_build = NULL;
+  _index_build_name = NULL;
+}
+
+// Use the index of the file (if any) to go directly to the buffer
+// with the first wanted event.  Returns the number of events that
+// were skipped that way.  The events until the wanted one in that
+// buffer are skipped as usual by the caller.
+
+uint64_t ucesb_event_loop::seek_source_index(config_input &input,
+					     int64_t skip_events,
+					     int64_t first_event)
+{
+  if (input._type != INPUT_TYPE_FILE ||
+      _index_build ||
+      !_source._input._input->seekable())
+    return 0;
+
+  if (skip_events <= 0 &&
+      first_event < 0)
+    return 0;
+
+  lmd_index index;
+
+  if (!index.read(input._name))
+    return 0;
+
+  const lmd_index_entry *entry;
+
+  if (skip_events > 0)
+    entry = index.find_events((uint64_t) skip_events);
+  else
+    {
+      entry = index.find_event_no((uint32_t) first_event);
+
+      // Sticky events before the wanted one must still be seen
+      // (see lmd_index.hh), so do not seek past the first one.
+      if (entry &&
+	  index._first_sticky != LMD_INDEX_NO_STICKY &&
+	  entry->_events > index._first_sticky)
+	entry = index.find_events(index._first_sticky);
+    }
+
+  if (!entry ||
+      !entry->_events)
+    return 0; // No use, it is the start of the file anyhow
+
+  INFO(0,"Index: to event #%u at offset %" PRIu64 " "
+       "(skipping %" PRIu64 " events).",
+       entry->_event_no,entry->_offset,entry->_events);
+
+  _source.seek_buffer((off_t) entry->_offset);
+
+  // Events skipped by event number are not counted
+  return skip_events > 0 ? entry->_events : 0;
+}
+#endif
 #endif//!USE_THREADING
 
 bool ucesb_event_loop::get_ext_source_event(event_base &eb)
@@ -1277,6 +1384,45 @@ void unpack_subevent(event_base_t &eb,
     show_remaining(eb,ev_header,src,start,loc);
 }
 
+#ifdef USE_LMD_INPUT
+static char *bulk_swap_subevent(FILE_INPUT_EVENT *src_event,
+				char *start,char *end)
+{
+  size_t length = (size_t) (end - start);
+
+  // The scratch buffer lives as long as the defragmentation
+  // buffers, i.e. until the event is released.
+#ifdef USE_THREADING
+  char *swapped = (char *)
+    _wt._defrag_buffer->allocate_reclaim(length + 7);
+#else
+  char *swapped = (char *)
+    src_event->_defrag_event_many.allocate(length + 7);
+#endif
+  swapped = (char *) ((((size_t) swapped) + 7) & ~(size_t) 7);
+
+  bulk_swap_32((uint32 *) swapped,(const uint32 *) start,length / 4);
+
+  return swapped;
+}
+
+// Hex dumps of failed events show the original data, so marks into
+// the swapped copy are moved to the same offset in the original.
+static void bulk_swap_unmark(hex_dump_mark_buf &mark,
+			     char *swapped,char *swapped_end,char *start)
+{
+  void **marks[3] = { &mark._prev, &mark._this, &mark._next };
+
+  for (int i = 0; i < 3; i++)
+    {
+      char *p = (char *) *marks[i];
+
+      if (p >= swapped && p <= swapped_end)
+	*marks[i] = start + (p - swapped);
+    }
+}
+#endif
+
 template<typename event_base_t,typename subevent_header_t>
 void revoke_subevent(event_base_t &eb,
 		     subevent_header_t *ev_header)
@@ -1375,15 +1521,31 @@ pre2_unpack_event<sticky_event_base>(sticky_event_base &eb,
 #if defined(USE_LMD_INPUT)
 void ucesb_event_loop::stitch_event(event_base &eb,
 				    stitch_info *stitch)
+{
+  stitch_stamp stamp;
+
+  stamp._status = STITCH_STAMP_NONE;
+
+  try {
+    stitch_prepare(eb,&stamp);
+  } catch (error &e) {
+    // In case any fetch fails, we do not combine
+    stitch_decide(&stamp,stitch);
+    throw;
+  }
+  stitch_decide(&stamp,stitch);
+}
+
+// Get what the stitch decision needs from the event.  Only looks at
+// this event, so may be done by the unpack workers in parallel.
+
+void ucesb_event_loop::stitch_prepare(event_base &eb,
+				      stitch_stamp *stamp)
 {
   assert(_conf._event_stitch_mode == EVENT_STITCH_MODE_TITRIS_TIME ||
 	 _conf._event_stitch_mode == EVENT_STITCH_MODE_WR_TIME);
 
-  bool prev_badstamp = stitch->_badstamp;
-
-  // In case any fetch fails, we do not combine
-  stitch->_badstamp = true;
-  stitch->_combine = false;
+  stamp->_status = STITCH_STAMP_NONE;
 
   // Timestamp is in first subevent
 
@@ -1402,6 +1564,45 @@ void ucesb_event_loop::stitch_event(event_base &eb,
   if (!good_stamp)
     {
       WARNING("Error set in time-stamp.  Dumping event by itself.");
+      stamp->_status = STITCH_STAMP_BAD;
+      return;
+    }
+
+  stamp->_timestamp = ts_sync_info._timestamp;
+
+#ifdef USE_INPUTFILTER
+  stamp->_implant_aida = !!src_event->_aida_implant;
+  // todo: figure out how to spot an FRS event in a non stupid way
+  stamp->_implant_frs = (src_event->_subevents[0]._data[1] == 0x1);
+
+  stamp->_aida_length =
+    (_conf._aida_new_stitch && src_event->_aida_extra) ?
+    src_event->_aida_length : 0;
+
+  stamp->_special_trigger =
+    (src_event->_header._info.i_trigger >= 10 &&
+     src_event->_header._info.i_trigger <= 13);
+#endif
+
+  stamp->_status = STITCH_STAMP_GOOD;
+}
+
+// The serial part of the stitching: compare with the previous stamp.
+
+void ucesb_event_loop::stitch_decide(const stitch_stamp *stamp,
+				     stitch_info *stitch)
+{
+  bool prev_badstamp = stitch->_badstamp;
+
+  // In case any fetch failed, we do not combine
+  stitch->_badstamp = true;
+  stitch->_combine = false;
+
+  if (stamp->_status == STITCH_STAMP_NONE)
+    return;
+
+  if (stamp->_status == STITCH_STAMP_BAD)
+    {
       // printf("!good -> bad !combine\n");
       stitch->_has_stamp = false;
       return;
@@ -1411,20 +1612,16 @@ void ucesb_event_loop::stitch_event(event_base &eb,
   // (unordered may be due to other (previous) stamp being wrong).
   stitch->_badstamp = false;
 
+  uint64_t timestamp = stamp->_timestamp;
+
 #ifdef USE_INPUTFILTER
-  bool is_implant_aida = false;
-  bool is_implant_frs = false;
-  if (src_event->_aida_implant) is_implant_aida = true;
-  // todo: figure out how to spot an FRS event in a non stupid way
-  if(src_event->_subevents[0]._data[1] == 0x1) {
-    is_implant_frs = true;
-  }
+  bool is_implant_aida = stamp->_implant_aida;
+  bool is_implant_frs = stamp->_implant_frs;
 #endif
 
-
   if (stitch->_has_stamp)
     {
-      if (false && ts_sync_info._timestamp < stitch->_last_stamp)
+      if (false && timestamp < stitch->_last_stamp)
 	{
 	  // Unordered, dump!
 	  // printf("unordered -> !bad !combine\n");
@@ -1438,7 +1635,7 @@ void ucesb_event_loop::stitch_event(event_base &eb,
 	}
       else
 	{
-	  if ((int64_t) (ts_sync_info._timestamp - stitch->_last_stamp) <
+	  if ((int64_t) (timestamp - stitch->_last_stamp) <
 	      _conf._event_stitch_value)
 	    {
 #ifdef USE_INPUTFILTER
@@ -1448,7 +1645,7 @@ void ucesb_event_loop::stitch_event(event_base &eb,
 		stitch->_combine = true;
 		stitch->_implant[0] |= is_implant_aida;
 		stitch->_implant[1] |= is_implant_frs;
-		stitch->_last_stamp = ts_sync_info._timestamp + _conf._event_stitch_value;
+		stitch->_last_stamp = timestamp + _conf._event_stitch_value;
 	      }
 	      else if (!is_implant_aida && !is_implant_frs)
 #endif
@@ -1473,13 +1670,13 @@ void ucesb_event_loop::stitch_event(event_base &eb,
 
 #ifdef USE_INPUTFILTER 
   // Only make the window wide at the start of stitching
-  if (_conf._aida_new_stitch && src_event->_aida_extra && !stitch->_combine)
+  if (!stitch->_combine)
   {
-    ts_sync_info._timestamp += src_event->_aida_length;
+    timestamp += stamp->_aida_length;
   }
 
   // Do not stitch special triggers
-  if (src_event->_header._info.i_trigger >= 10 && src_event->_header._info.i_trigger <= 13)
+  if (stamp->_special_trigger)
   {
     stitch->_combine = false;
   }
@@ -1488,7 +1685,7 @@ void ucesb_event_loop::stitch_event(event_base &eb,
   //if (timestamp > stitch->_last_stamp)
 #ifdef USE_INPUTFILTER 
   if (!stitch->_implant[0] && !stitch->_implant[1])
-    stitch->_last_stamp = ts_sync_info._timestamp;
+    stitch->_last_stamp = timestamp;
 #endif
   if (!stitch->_combine)
     {
@@ -1588,7 +1785,36 @@ void ucesb_event_loop::unpack_event(T_event_base &eb)
       scramble ^= src_event->_swapping;
       scramble ^= _conf._scramble;
 
-      if (src_event->_swapping)
+      if (src_event->_swapping &&
+	  _conf._bulk_swap &&
+	  !((end - start) & 3) &&
+	  !(((size_t) start) & 3))
+	{
+	  // Swap the whole payload at once into a scratch buffer, and
+	  // unpack with the native-order reader.  Swapping the 32-bit
+	  // words also exchanges their 16-bit halves, so the scramble
+	  // flag is inverted.
+	  char *swapped = bulk_swap_subevent(src_event,start,end);
+	  char *swapped_end = swapped + (end - start);
+
+	  try {
+	    if (scramble)
+	      {
+		__data_src<0,0,account,memberdump> src(swapped,swapped_end);
+		unpack_subevent(eb,&subevent_info->_header,src,swapped);
+	      }
+	    else
+	      {
+		__data_src<0,1,account,memberdump> src(swapped,swapped_end);
+		unpack_subevent(eb,&subevent_info->_header,src,swapped);
+	      }
+	  } catch (error &e) {
+	    bulk_swap_unmark(eb._unpack_fail,swapped,swapped_end,start);
+	    throw;
+	  }
+	  bulk_swap_unmark(eb._unpack_fail,swapped,swapped_end,start);
+	}
+      else if (src_event->_swapping)
 	{
 	  if (scramble)
 	    {
@@ -123,6 +123,8 @@ int get_time_stamp_mode(const char *);
 
 void init_sticky_idx();
 
+struct stitch_stamp;
+
 struct stitch_info
 {
   uint64_t _last_stamp;
@@ -202,6 +204,21 @@ public:
 #endif
   void close_output();
 
+#if defined(USE_LMD_INPUT) && !defined(USE_MERGING) && !defined(USE_THREADING)
+public:
+  // Sidecar index of the current file (--build-index)
+  lmd_index *_index_build;
+  char      *_index_build_name;
+
+public:
+  uint64_t seek_source_index(config_input &input,
+			     int64_t skip_events,int64_t first_event);
+
+protected:
+  void open_source_index(config_input &input);
+  void close_source_index();
+#endif
+
 protected:
   template<typename source_type>
   void open_source(source_type &source,
@@ -222,6 +239,10 @@ public:
 
   static void stitch_event(event_base &eb,
 			   stitch_info *stitch);
+  static void stitch_prepare(event_base &eb,
+			     stitch_stamp *stamp);
+  static void stitch_decide(const stitch_stamp *stamp,
+			    stitch_info *stitch);
 
   template<typename T_event_base,int account,int memberdump>
   static void unpack_event(T_event_base &eb);
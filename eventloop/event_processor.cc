@@ -28,16 +28,40 @@
 
 #include "config.hh"
 
+#include <string.h>
+
+event_processor::event_processor()
+{
+  _index     = 0;
+  _peers     = NULL;
+  _num_peers = 0;
+
+  for (int i = 0; i < PROCESSOR_WINDOW; i++)
+    _window[i]._state = WINDOW_SLOT_FREE;
+
+  _win_head  = 0;
+  _win_claim = 0;
+  _win_tail  = 0;
+
+  _idle      = false;
+
+  memset(&_counts,0,sizeof(_counts));
+}
+
 event_processor::~event_processor()
 {
 
 }
 
-void event_processor::init(int index)
+void event_processor::init(int index,event_processor *peers,int num_peers)
 {
   worker_thread::init();
 
   _queues.init(index);
+
+  _index     = index;
+  _peers     = peers;
+  _num_peers = num_peers;
 }
 
 void event_processor::wait_for_output_queue_slot()
@@ -60,123 +84,307 @@ void event_processor::wait_for_output_queue_slot()
     }
 }
 
-void event_processor::wait_for_input_queue_item()
+// Do the processing of one event.  May be called by any processor,
+// also for an item in the window of another one.
+
+void event_processor::process_item(eq_item &item)
 {
-  // We must have a slot to insert an event, or we must wait
-  for ( ; ; )
+  // Set up the pointers for where to put any error messages
+  _wt._last_reclaim       = item._last_reclaim;
+
+  try {
+
+    ////////////////////////////////////////////////////
+    // THIS IS TO BE MOVED INTO THE event_loop.cc
+
+    event_base *eb = (event_base *) item._event;
+
+#ifdef USE_LMD_INPUT
+    eb->_stitch._status = STITCH_STAMP_NONE;
+#endif
+
+#if defined(USE_LMD_INPUT) || defined(USE_HLD_INPUT) || defined(USE_RIDF_INPUT)
+    // When merging, the source reader has already done this
+    if (!(item._info & EQ_INFO_PRE_UNPACKED))
+      {
+	ucesb_event_loop::pre1_unpack_event((FILE_INPUT_EVENT *)
+					    eb->_file_event);
+	ucesb_event_loop::pre2_unpack_event(*eb, &_hints);
+      }
+#endif
+
+#ifdef USE_LMD_INPUT
+    // Time stamp for stitching.  Only the comparison with the
+    // previous event is left to the (serial) retire stage.
+    if (_conf._event_stitch_mode)
+      ucesb_event_loop::stitch_prepare(*eb, &eb->_stitch);
+#endif
+
+    if (!(item._info & EQ_INFO_UNPACKED))
+      ucesb_event_loop::unpack_event<event_base,0,0>(*eb);
+    ////////////////////////////////////////////////////
+
+    // process_event();
+    _counts._events++;
+  } catch (error &e) {
+
+    _counts._errors++;
+
+    // If an error occurred during processing, remove the
+    // PROCESS flag
+
+    item._info &= ~EQ_INFO_PROCESS;
+    item._info |=  EQ_INFO_DAMAGED;
+
+    // And possibly mark the event for printing
+
+    if (_conf._debug)
+      item._info |= (EQ_INFO_PRINT_EVENT | EQ_INFO_PRINT_EVENT_DATA);
+  }
+
+  // Quit delivering error messages here
+  item._last_reclaim = _wt._last_reclaim;
+  _wt._last_reclaim = NULL;
+}
+
+void event_processor::sum_counts(status_monitor *sum,
+				 const event_processor *procs,int num)
+{
+  memset(sum,0,sizeof(*sum));
+
+  for (int i = 0; i < num; i++)
     {
-      if (_queues._unpack->can_remove())
-	return;
+      const status_monitor *counts = &procs[i]._counts;
 
-      TDBG("none available");
-      _queues._unpack->request_remove_wakeup(&_block);
-      if (_queues._unpack->can_remove())
-	{
-	  _queues._unpack->cancel_remove_wakeup();
-	  return;
-	}
-      TDBG("waiting");
-      _block.block();
+      sum->_events       += counts->_events;
+      sum->_multi_events += counts->_multi_events;
+      sum->_errors       += counts->_errors;
     }
 }
 
-void *event_processor::worker()
+// Pass the finished items at the head of the window on to the retire
+// queue.  Returns true if anything was retired.
+
+bool event_processor::retire_window()
 {
-  TDBG("");
+  bool retired = false;
 
-  // Take in events from our input queue, find a slot in the output
-  // queue, and process the event
+  while (_win_head != _win_tail)
+    {
+      window_slot &slot = _window[_win_head & (PROCESSOR_WINDOW-1)];
 
+      if (slot._state != WINDOW_SLOT_DONE)
+	break;
 
-  // If there is no free slot in the output queue, it makes no sense
-  // to ask for an event from the input.  Because if the output is
-  // full and the input is empty, to most pressing problem is the lack
-  // of an output slot, since without that we can anyhow not continue
+      LFENCE; // see the item as written by whoever processed it
 
-  for ( ; ; )
-    {
       wait_for_output_queue_slot();
-      wait_for_input_queue_item();
 
-      int next_queue;
+      eq_item &send_item = _queues._retire->next_insert(slot._next_queue);
+
+      send_item = slot._item;
+
+      int info = send_item._info;
+
+      slot._state = WINDOW_SLOT_FREE;
+      _win_head++;
+      if (_win_claim - _win_head < 0)
+	_win_claim = _win_head;
 
-      eq_item &recv_item = _queues._unpack->next_remove(&next_queue);
-      eq_item &send_item = _queues._retire->next_insert(next_queue);
+      // We have produced all information we want.  Let someone
+      // operate on this item.
+      _queues._retire->insert();
+      // You may no longer use send_item!!!
+
+      if (info & EQ_INFO_FLUSH)
+	{
+	  // This must be after the insert(), because the insert may
+	  // not flush if the queue did not get full enough to reach
+	  // wakeup threshold.  But this will flush if there is any
+	  // item left at all (e.g. send_item).
+	  _queues._retire->flush_avail();
+	}
+      retired = true;
+    }
+  return retired;
+}
+
+// Move items from our input queue into the window.
+
+void event_processor::fill_window()
+{
+  int pending = 0;
+
+  while (_win_tail - _win_head < PROCESSOR_WINDOW &&
+	 _queues._unpack->can_remove())
+    {
+      window_slot &slot = _window[_win_tail & (PROCESSOR_WINDOW-1)];
 
-      // First just make a copy of the item to at least send it along.
       // *all* items are sent along, since they may contain reclaim
       // items (among other: messages) that are not to get lost
 
-      send_item = recv_item;
+      slot._item = _queues._unpack->next_remove(&slot._next_queue);
 
       // Now that we have taken over the data from the input slot, we
       // may release it.
       _queues._unpack->remove();
 
-      // Set up the pointers for where to put any error messages
-      _wt._last_reclaim       = send_item._last_reclaim;
+      SFENCE; // item written before it can be claimed
 
       // Is there any processing requested?
-      if (send_item._info & EQ_INFO_PROCESS)
+      if (slot._item._info & EQ_INFO_PROCESS)
 	{
-	  try {
+	  slot._state = WINDOW_SLOT_PENDING;
+	  pending++;
+	}
+      else
+	slot._state = WINDOW_SLOT_DONE;
 
-	    ////////////////////////////////////////////////////
-	    // THIS IS TO BE MOVED INTO THE event_loop.cc
+      _win_tail = _win_tail + 1;
+    }
 
-	    event_base *eb = (event_base *) send_item._event;
+  // More than we will do next, someone idle may help
+  if (pending > 1)
+    {
+      MFENCE; // PENDING written before _idle is read (see worker())
+      wake_idle_peer();
+    }
+}
 
-#if defined(USE_LMD_INPUT) || defined(USE_HLD_INPUT) || defined(USE_RIDF_INPUT)
-	    ucesb_event_loop::pre_unpack_event(*eb, &_hints);
-#endif
+// Process the oldest unclaimed item of our own window.
 
-	    ucesb_event_loop::unpack_event(*eb);
-	    /*
-	    int a, b;
+bool event_processor::process_own()
+{
+  while (_win_claim != _win_tail)
+    {
+      window_slot &slot = _window[_win_claim & (PROCESSOR_WINDOW-1)];
 
-	    for (int i = 0; i < 10000000; i++)
-	      {
-		a = a + b; b ^= i + a;
-		a |= i;
-	      }
-	    */
-	    ////////////////////////////////////////////////////
+      _win_claim++;
 
-	    // process_event();
-	  } catch (error &e) {
+      if (slot._state == WINDOW_SLOT_PENDING &&
+	  __sync_bool_compare_and_swap(&slot._state,
+				       WINDOW_SLOT_PENDING,
+				       WINDOW_SLOT_CLAIMED))
+	{
+	  process_item(slot._item);
+	  SFENCE;
+	  slot._state = WINDOW_SLOT_DONE;
+	  return true;
+	}
+    }
+  return false;
+}
 
-	    // If an error occurred during processing, remove the
-	    // PROCESS flag
+// Process the newest unclaimed item of some other processor.
 
-	    send_item._info &= ~EQ_INFO_PROCESS;
-	    send_item._info |=  EQ_INFO_DAMAGED;
+bool event_processor::steal()
+{
+  for (int j = 1; j < _num_peers; j++)
+    {
+      event_processor *victim = &_peers[(_index + j) % _num_peers];
 
-	    // And possibly mark the event for printing
+      int head = victim->_win_head;
+      int tail = victim->_win_tail;
 
-	    if (_conf._debug)
-	      send_item._info |= (EQ_INFO_PRINT_EVENT | EQ_INFO_PRINT_EVENT_DATA);
-	  }
+      // The indices may move while we look.  It does not matter, a
+      // slot that is PENDING when the claim succeeds is valid work.
+      for (int i = tail - 1; i - head >= 0; i--)
+	{
+	  window_slot &slot = victim->_window[i & (PROCESSOR_WINDOW-1)];
+
+	  if (slot._state == WINDOW_SLOT_PENDING &&
+	      __sync_bool_compare_and_swap(&slot._state,
+					   WINDOW_SLOT_PENDING,
+					   WINDOW_SLOT_CLAIMED))
+	    {
+	      process_item(slot._item);
+	      SFENCE;
+	      slot._state = WINDOW_SLOT_DONE;
+	      // The owner may be waiting to retire it
+	      victim->_block.wakeup();
+	      return true;
+	    }
 	}
+    }
+  return false;
+}
 
-      // Quit delivering error messages here
-      send_item._last_reclaim = _wt._last_reclaim;
-      _wt._last_reclaim = NULL;
+void event_processor::wake_idle_peer()
+{
+  for (int j = 1; j < _num_peers; j++)
+    {
+      event_processor *peer = &_peers[(_index + j) % _num_peers];
 
-      int info = send_item._info;
+      if (peer->_idle)
+	{
+	  peer->_idle = false;
+	  peer->_block.wakeup();
+	  return;
+	}
+    }
+}
 
-      // We have produced all information we want.  Let someone
-      // operate on this item.
-      _queues._retire->insert();
-      // You may no longer use send_item!!!
+void *event_processor::worker()
+{
+  TDBG("");
 
-      if (info & EQ_INFO_FLUSH)
+  // Take in events from our input queue into the window, process
+  // them (or those of others), and retire our own in order.
+
+  for ( ; ; )
+    {
+      retire_window();
+      fill_window();
+
+      if (process_own())
+	continue;
+
+      // Nothing of our own left to work on (the items in the window
+      // are already being processed), help someone else
+
+      if (steal())
+	continue;
+
+      if (retire_window())
+	continue;
+
+      // Go to sleep.  We are woken when our input queue gets items,
+      // when a thief finished an item of ours, or when someone has
+      // items for us to steal.
+
+      _idle = true;
+      MFENCE;
+
+      // Items made PENDING before _idle was set did not wake us
+      if (steal())
 	{
-	  // This must be after the insert(), because the insert may
-	  // not flush if the queue did not get full enough to reach
-	  // wakeup threshold.  But this will flush if there is any
-	  // item left at all (e.g. send_item).
-	  _queues._retire->flush_avail();
+	  _idle = false;
+	  continue;
+	}
+
+      bool window_full = (_win_tail - _win_head >= PROCESSOR_WINDOW);
+
+      if (!window_full)
+	_queues._unpack->request_remove_wakeup(&_block);
+
+      // Try again...
+      if ((!window_full && _queues._unpack->can_remove()) ||
+	  (_win_head != _win_tail &&
+	   _window[_win_head & (PROCESSOR_WINDOW-1)]._state ==
+	   WINDOW_SLOT_DONE))
+	{
+	  if (!window_full)
+	    _queues._unpack->cancel_remove_wakeup();
+	  _idle = false;
+	  continue;
 	}
+
+      TDBG("waiting");
+      _block.block();
+
+      if (!window_full)
+	_queues._unpack->cancel_remove_wakeup();
+      _idle = false;
     }
 
   return NULL;
@@ -24,11 +24,38 @@
 #include "worker_thread.hh"
 #include "data_queues.hh"
 #include "event_loop.hh"
+#include "monitor.hh"
+#include "optimise.hh"
+
+// Events taken from the unpack queue are first put in a window of
+// the processor.  The owner processes them from the oldest end, while
+// idle processors may steal (process) them from the newest end.  Only
+// the owner retires them, in order, so the fan-in order of the retire
+// queue is kept.
+
+#define PROCESSOR_WINDOW          256 // must be power of 2
+
+#define WINDOW_SLOT_FREE          0
+#define WINDOW_SLOT_PENDING       1   // to be processed, by anyone
+#define WINDOW_SLOT_CLAIMED       2   // being processed
+#define WINDOW_SLOT_DONE          3   // to be retired (by owner)
+
+// Slots are claimed by different processors, so keep each on cache
+// lines of its own.
+
+struct window_slot
+{
+  volatile int _state;
+  int          _next_queue;
+  eq_item      _item;
+  CACHE_LINE_PAD(_pad_after);
+};
 
 class event_processor :
   public worker_thread
 {
 public:
+  event_processor();
   virtual ~event_processor();
 
 
@@ -37,6 +64,29 @@ public:
 public:
   processor_thread_data_queues _queues;
 
+public:
+  int              _index;
+  event_processor *_peers;     // all processors (for stealing)
+  int              _num_peers;
+
+  window_slot      _window[PROCESSOR_WINDOW];
+  volatile int     _win_head;  // oldest, not yet retired
+  int              _win_claim; // next one for the owner to try
+  volatile int     _win_tail;  // next free
+
+  volatile bool    _idle;      // sleeping, may be woken to steal
+
+public:
+  // Counters of this thread, on cache lines of their own.  Only
+  // summed (into _status) when the monitor asks for an update.
+  CACHE_LINE_PAD(_pad_counts_before);
+  status_monitor   _counts;
+  CACHE_LINE_PAD(_pad_counts_after);
+
+public:
+  static void sum_counts(status_monitor *sum,
+			 const event_processor *procs,int num);
+
 public:
 #if defined(USE_LMD_INPUT) || defined(USE_HLD_INPUT) || defined(USE_RIDF_INPUT)
   ucesb_event_loop::source_event_hint_t _hints;
@@ -47,10 +97,18 @@ public:
 
 public:
   void wait_for_output_queue_slot();
-  void wait_for_input_queue_item();
+
+protected:
+  void process_item(eq_item &item);
+
+  bool retire_window();
+  void fill_window();
+  bool process_own();
+  bool steal();
+  void wake_idle_peer();
 
 public:
-  void init(int index);
+  void init(int index,event_processor *peers,int num_peers);
 
 };
 
@@ -27,6 +27,17 @@
 
 #include "config.hh"
 
+#include "file_view.hh"
+#include "thread_pin.hh"
+
+#if defined(USE_MERGING) && defined(USE_LMD_INPUT)
+#include "tstamp_alignment.hh"
+
+extern tstamp_alignment *_ts_align_hist;
+#endif
+
+#include <vector>
+
 // When running threaded, the event reader is put in it's own thread.
 
 // The main reason is that file reading (map_range (both of file_mmap
@@ -52,13 +63,22 @@
 // standing around waiting?
 
 
-event_reader::~event_reader()
+event_reader::event_reader()
 {
-
+#ifdef USE_LMD_INPUT
+  _range_readers = NULL;
+  _num_range_readers = 0;
+#endif
+#if defined(USE_MERGING) && defined(USE_LMD_INPUT)
+  _merge_readers = NULL;
+  _num_merge_readers = 0;
+#endif
 }
 
+event_reader::~event_reader()
+{
 
-static int insert_queue = 0;
+}
 
 
 void event_reader::wait_for_unpack_queue_slot()
@@ -88,6 +108,11 @@ void *event_reader::worker()
 {
   TDBG("");
 
+#if defined(USE_MERGING) && defined(USE_LMD_INPUT)
+  if (_num_merge_readers)
+    return merge_worker();
+#endif
+
   // Get the next file from the input queue, and process events
 
   for ( ; ; )
@@ -127,7 +152,7 @@ void *event_reader::worker()
 	  wait_for_unpack_queue_slot();
 
 	  // We may now use the next entry in the queue
-	  eq_item &send_item      = _unpack_event_queue.next_insert(/*0*/(insert_queue++)%MAX_THREADS);
+	  eq_item &send_item      = _unpack_event_queue.next_insert(_queue_select.next_queue());
 
 	  send_item._info         = EQ_INFO_MESSAGE;
 	  send_item._event        = NULL; // there is no event payload
@@ -164,7 +189,7 @@ void *event_reader::worker()
 	  wait_for_unpack_queue_slot();
 
 	  // We may now use the next entry in the queue
-	  eq_item &send_item      = _unpack_event_queue.next_insert(/*0*/(insert_queue++)%MAX_THREADS);
+	  eq_item &send_item      = _unpack_event_queue.next_insert(_queue_select.next_queue());
 
 	  send_item._info         = (info & (OFQ_INFO_FLUSH | OFQ_INFO_DONE));
 	  send_item._event        = NULL; // there is no event payload
@@ -184,6 +209,282 @@ void *event_reader::worker()
 }
 
 
+#if defined(USE_MERGING) && defined(USE_LMD_INPUT)
+void event_reader::spawn_merge_readers(int n)
+{
+  _merge_readers = new merge_reader[n];
+  _num_merge_readers = n;
+
+  for (int i = 0; i < n; i++)
+    {
+      _merge_readers[i]._pin = THREAD_PIN_INPUT;
+      _merge_readers[i].init();
+      _merge_readers[i].spawn();
+    }
+}
+
+void event_reader::forward_merge_item(const eq_item &item,int info)
+{
+  // Make sure the queue has space for an item...
+  wait_for_unpack_queue_slot();
+
+  eq_item &send_item      = _unpack_event_queue.next_insert(_queue_select.next_queue());
+
+  send_item               = item;
+  send_item._info         = info;
+
+  _unpack_event_queue.insert();
+}
+
+// When merging, the sources are read (and pre-unpacked) by the merge
+// readers.  This thread only hands out the sources, and decides which
+// head event is to be next.  Since the unpack workers (through the
+// retire queue) keep the order we produce, that is also the order in
+// which the events are retired.
+
+void *event_reader::merge_worker()
+{
+  merge_event_order *prev_order = NULL;
+
+  int  active = 0;         // readers with a source
+  bool files_done = false; // no more sources will come
+  int  done_info = 0;
+
+  for ( ; ; )
+    {
+      // Give new sources to idle readers.  Like the non-threaded
+      // merge, all concurrent sources are opened before deciding.
+
+      while (active < _num_merge_readers &&
+	     !files_done &&
+	     _open_file_queue.can_remove())
+	{
+	  ofq_item &item = _open_file_queue.next_remove();
+
+	  int info = item._info;
+	  data_input_source *source = item._source;
+	  const char *name = item._name;
+
+	  if (item._reclaim)
+	    {
+	      eq_item msg;
+
+	      msg._event        = NULL; // there is no event payload
+	      msg._reclaim      = item._reclaim;
+	      msg._last_reclaim = item._last_reclaim;
+
+	      forward_merge_item(msg,EQ_INFO_MESSAGE);
+	    }
+
+	  _open_file_queue.remove();
+
+	  if (source)
+	    {
+	      merge_reader *reader = _merge_readers;
+
+	      while (reader->_busy) // there is an idle one, as active < n
+		reader++;
+
+	      reader->start(source,name);
+	      active++;
+	    }
+
+	  if (info & OFQ_INFO_DONE)
+	    {
+	      files_done = true;
+	      done_info = (info & (OFQ_INFO_FLUSH | OFQ_INFO_DONE));
+	    }
+	  else if (info & OFQ_INFO_FLUSH)
+	    {
+	      // Passed on in order with what was forwarded so far, like
+	      // the non-merging reader does.
+	      eq_item flush;
+
+	      flush._event        = NULL; // there is no event payload
+	      flush._reclaim      = NULL;
+	      flush._last_reclaim = NULL;
+
+	      forward_merge_item(flush,EQ_INFO_FLUSH);
+
+	      _unpack_event_queue.flush_avail();
+	    }
+	}
+
+      // Pass on whatever is before the next event of each reader,
+      // and find the reader with the event to be next.
+
+      merge_reader *next = NULL;
+      bool need_wait = (active < _num_merge_readers && !files_done);
+
+      for (int i = 0; i < _num_merge_readers; i++)
+	{
+	  merge_reader *reader = &_merge_readers[i];
+
+	  while (reader->_busy &&
+		 reader->_queue.can_remove())
+	    {
+	      eq_item &item = reader->_queue.next_remove();
+
+	      if (item._info & EQ_INFO_PROCESS)
+		break;
+
+	      forward_merge_item(item,item._info);
+
+	      if (item._info & EQ_INFO_FILE_CLOSE)
+		{
+		  reader->_busy = false;
+		  active--;
+		}
+	      reader->_queue.remove();
+	    }
+
+	  if (!reader->_busy)
+	    continue;
+
+	  if (!reader->_queue.can_remove())
+	    {
+	      // Cannot decide without the next event of this source
+	      need_wait = true;
+	      continue;
+	    }
+
+	  if (!reader->_head_ready)
+	    {
+	      eq_item &item = reader->_queue.next_remove();
+
+	      reader->_seb._event = (event_base *) item._event;
+
+	      // Any messages go with the event
+	      _wt._last_reclaim = item._last_reclaim;
+	      _wt._current_event = reader->_seb._event;
+	      do_merge_prepare_event_info(&reader->_seb);
+	      _wt._current_event = NULL;
+	      item._last_reclaim = _wt._last_reclaim;
+	      _wt._last_reclaim = NULL;
+
+	      reader->_head_ready = true;
+	    }
+
+	  if (!next ||
+	      do_merge_compare_events_after(&next->_seb,&reader->_seb))
+	    next = reader;
+	}
+
+      if (!need_wait && next)
+	{
+	  eq_item &item = next->_queue.next_remove();
+
+	  int info = item._info;
+	  int bad_order;
+
+	  _wt._last_reclaim = item._last_reclaim;
+
+	  if (prev_order &&
+	      (bad_order = do_check_merge_event_after(prev_order,
+						      &next->_seb)) != 0)
+	    {
+	      switch (bad_order)
+		{
+		case MERGE_EVENTS_ERROR_ORDER_SAME:
+		  WARNING("Duplicate events while merging, aborting...");
+		  break;
+		case MERGE_EVENTS_ERROR_ORDER_BEFORE:
+		  WARNING("Events not merged in order (--merge=N, N too small?), aborting...");
+		  break;
+		default: assert (false); break;
+		}
+	      // The event is not processed, only the messages delivered
+	      info = EQ_INFO_MESSAGE | EQ_INFO_FLUSH | EQ_INFO_DONE;
+	    }
+	  else
+	    {
+	      // and record info for this event to check next one
+	      prev_order = do_record_merge_event_info(prev_order,&next->_seb);
+
+	      next->_seb._events++;
+
+	      if (_ts_align_hist)
+		_ts_align_hist->account(next->_seb._tstamp_align_index,
+					next->_seb._timestamp);
+	    }
+
+	  item._last_reclaim = _wt._last_reclaim;
+	  _wt._last_reclaim = NULL;
+
+	  forward_merge_item(item,info);
+
+	  next->_queue.remove();
+	  next->_head_ready = false;
+
+	  if (info & EQ_INFO_DONE)
+	    {
+	      _unpack_event_queue.flush_avail();
+	      return NULL;
+	    }
+	  continue;
+	}
+
+      if (!active && files_done)
+	{
+	  // All sources are exhausted, and no more will come
+
+	  if (done_info)
+	    {
+	      eq_item done;
+
+	      done._event        = NULL; // there is no event payload
+	      done._reclaim      = NULL;
+	      done._last_reclaim = NULL;
+
+	      forward_merge_item(done,done_info);
+	      done_info = 0;
+	    }
+	}
+
+      // Let the unpackers have what we produced before going to
+      // sleep, the fan_out queue would otherwise hold back on the
+      // wakeups.
+
+      _unpack_event_queue.flush_avail();
+
+      // Wait for an event from the sources that have none, or for
+      // a new source.
+
+      bool wait_files = (active < _num_merge_readers && !files_done);
+      bool avail = false;
+
+      for (int i = 0; i < _num_merge_readers; i++)
+	if (_merge_readers[i]._busy &&
+	    !_merge_readers[i]._head_ready)
+	  _merge_readers[i]._queue.request_remove_wakeup(&_block);
+      if (wait_files)
+	_open_file_queue.request_remove_wakeup(&_block);
+
+      // Try again...
+      for (int i = 0; i < _num_merge_readers; i++)
+	if (_merge_readers[i]._busy &&
+	    !_merge_readers[i]._head_ready &&
+	    _merge_readers[i]._queue.can_remove())
+	  avail = true;
+      if (wait_files &&
+	  _open_file_queue.can_remove())
+	avail = true;
+
+      if (!avail)
+	_block.block();
+
+      for (int i = 0; i < _num_merge_readers; i++)
+	if (_merge_readers[i]._busy &&
+	    !_merge_readers[i]._head_ready)
+	  _merge_readers[i]._queue.cancel_remove_wakeup();
+      if (wait_files)
+	_open_file_queue.cancel_remove_wakeup();
+    }
+
+  return NULL;
+}
+#endif//USE_MERGING && USE_LMD_INPUT
+
 
 void event_reader::process_file(data_input_source *source)
 {
@@ -202,7 +503,7 @@ void event_reader::process_file(data_input_source *source)
     wait_for_unpack_queue_slot();
 
     // We may now use the next entry in the queue
-    eq_item &send_item      = _unpack_event_queue.next_insert(/*0*/(insert_queue++)%MAX_THREADS);
+    eq_item &send_item      = _unpack_event_queue.next_insert(_queue_select.next_queue());
 
     send_item._info         = EQ_INFO_MESSAGE;
     send_item._event        = NULL; // there is no event payload
@@ -237,15 +538,41 @@ void event_reader::process_file(data_input_source *source)
     if (failed)
       goto no_more_events;
   }
+  {
+#ifdef USE_LMD_INPUT
+  // Buffer headers are printed as they are read, so that would not
+  // be in order when done by several threads.
+  file_view *split_view = NULL;
+
+  if (_num_range_readers > 1 &&
+#ifdef USE_INPUTFILTER
+      // The event builder must see the entire file, in order
+      !_conf._enable_eventbuilder &&
+#endif
+      !_conf._print_buffer)
+    split_view = dynamic_cast<file_view *>(_reader._input._input);
+#endif
   // Loop over all events
   for ( ; ; )
     {
+#ifdef USE_LMD_INPUT
+      // Once the events of the records read so far are used, the rest
+      // of the file may be handed out in ranges.
+      if (split_view &&
+	  _reader._chunk_cur == _reader._chunk_end)
+	{
+	  if (process_file_split(split_view,_reader._input._cur))
+	    break;
+	  split_view = NULL; // could not split, continue as usual
+	}
+#endif
+
       wait_for_unpack_queue_slot();
 
       TDBG("extract event");
 
       // We may now use the next entry in the queue
-      eq_item &send_item      = _unpack_event_queue.next_insert(/*0*/(insert_queue++)%MAX_THREADS);
+      eq_item &send_item      = _unpack_event_queue.next_insert(_queue_select.next_queue());
 
       send_item._info         = 0;
       send_item._event        = NULL; // there is no event payload
@@ -333,6 +660,7 @@ void event_reader::process_file(data_input_source *source)
       // The event is available for processing, insert it
       _unpack_event_queue.insert();
     }
+  }
 
  no_more_events:
 
@@ -355,7 +683,7 @@ void event_reader::process_file(data_input_source *source)
     wait_for_unpack_queue_slot();
 
     // We may now use the next entry in the queue
-    eq_item &send_item      = _unpack_event_queue.next_insert(/*0*/(insert_queue++)%MAX_THREADS);
+    eq_item &send_item      = _unpack_event_queue.next_insert(_queue_select.next_queue());
 
     send_item._info         = EQ_INFO_FILE_CLOSE;
     send_item._event        = source; // The source item to be removed
@@ -368,3 +696,172 @@ void event_reader::process_file(data_input_source *source)
 }
 
 
+
+
+#ifdef USE_LMD_INPUT
+void event_reader::spawn_range_readers(int n)
+{
+  _range_readers = new range_reader[n];
+  _num_range_readers = n;
+
+  for (int i = 0; i < n; i++)
+    {
+      _range_readers[i]._block_done = &_block;
+      _range_readers[i]._pin = THREAD_PIN_INPUT;
+      _range_readers[i].init();
+      _range_readers[i].spawn();
+    }
+}
+
+
+void event_reader::insert_range_items(range_reader *rr,bool events)
+{
+  for (range_item_vector::iterator iter = rr->_items.begin();
+       iter != rr->_items.end(); ++iter)
+    {
+      range_item &item = *iter;
+
+      wait_for_unpack_queue_slot();
+
+      // We may now use the next entry in the queue
+      eq_item &send_item      = _unpack_event_queue.next_insert(_queue_select.next_queue());
+
+      send_item._info         = EQ_INFO_MESSAGE;
+      send_item._event        = NULL;
+      // The messages, and the memory of the event (also when not used)
+      send_item._reclaim      = item._reclaim;
+      send_item._last_reclaim = item._last_reclaim;
+
+      if (item._event && events)
+	{
+	  send_item._info = EQ_INFO_PROCESS;
+
+	  if (_conf._print)
+	    {
+	      if (_conf._data)
+		send_item._info |= (EQ_INFO_PRINT_EVENT | EQ_INFO_PRINT_EVENT_DATA);
+	      else
+		send_item._info |= EQ_INFO_PRINT_EVENT;
+	    }
+
+	  send_item._event = item._event;
+	}
+
+      _unpack_event_queue.insert();
+    }
+
+  rr->_items.clear();
+}
+
+
+bool event_reader::process_file_split(file_view *view,off_t start)
+{
+  size_t buffer_size;
+  bool   swapping;
+
+  if (start >= view->_size ||
+      !range_split_buffer_size(view,start,&buffer_size,&swapping))
+    return false;
+
+  off_t range_size = (off_t) buffer_size;
+
+  if (buffer_size < RANGE_READER_SPLIT_SIZE)
+    range_size *= (off_t) (RANGE_READER_SPLIT_SIZE / buffer_size);
+
+  // Every range must begin with a similar buffer header, otherwise
+  // we do not dare, and the file is read as usual.
+
+  std::vector<off_t> range_start;
+
+  for (off_t offset = start; offset < view->_size; offset += range_size)
+    {
+      size_t check_size;
+      bool   check_swapping;
+
+      if (!range_split_buffer_size(view,offset,&check_size,&check_swapping) ||
+	  check_size != buffer_size ||
+	  check_swapping != swapping)
+	return false;
+
+      range_start.push_back(offset);
+    }
+
+  size_t num_ranges = range_start.size();
+
+  range_start.push_back(view->_size);
+
+  TDBG("%d ranges",(int) num_ranges);
+
+  // Hand out the ranges to the readers in order, and take the results
+  // back in the same order.  Range k is always handled by reader
+  // k % n, so a reader is free to get a new range when its previous
+  // one has been passed on.
+
+  size_t started = 0;
+  size_t retired = 0;
+  bool failed = false;
+
+  for ( ; ; )
+    {
+      while (!failed &&
+	     started < num_ranges &&
+	     started < retired + (size_t) _num_range_readers)
+	{
+	  range_reader *rr = &_range_readers[started % (size_t) _num_range_readers];
+
+	  assert(rr->_state == RANGE_READER_IDLE);
+
+	  rr->_view  = view;
+	  rr->_start = range_start[started];
+	  rr->_end   = range_start[started+1];
+	  MFENCE;
+	  rr->_state = RANGE_READER_WORK;
+	  rr->_block.wakeup();
+
+	  started++;
+	}
+
+      if (retired == started)
+	break;
+
+      range_reader *rr = &_range_readers[retired % (size_t) _num_range_readers];
+
+      while (rr->_state != RANGE_READER_DONE)
+	_block.block();
+
+      MFENCE; // see the results
+
+      insert_range_items(rr,!failed);
+
+      if (rr->_failed && !failed)
+	{
+	  failed = true;
+
+	  // Tell about it in order, i.e. after the failing item
+
+	  wait_for_unpack_queue_slot();
+
+	  eq_item &send_item      = _unpack_event_queue.next_insert(_queue_select.next_queue());
+
+	  send_item._info         = EQ_INFO_MESSAGE;
+	  send_item._event        = NULL; // there is no event payload
+	  send_item._reclaim      = NULL;
+	  // Any error(info messages goes to this queue item
+	  _wt._last_reclaim       = &send_item._reclaim;
+
+	  WARNING("Skipping rest of this file...");
+
+	  // Stop giving error messages to queue item
+	  send_item._last_reclaim = _wt._last_reclaim;
+	  _wt._last_reclaim = NULL;
+
+	  _unpack_event_queue.insert();
+	}
+
+      rr->_state = RANGE_READER_IDLE;
+      retired++;
+    }
+
+  return true;
+}
+#endif
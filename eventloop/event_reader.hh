@@ -22,6 +22,7 @@
 #define __EVENT_READER_HH__
 
 #include "worker_thread.hh"
+#include "queue_selector.hh"
 
 #include "lmd_input.hh"
 #include "pax_input.hh"
@@ -29,19 +30,33 @@
 #include "ebye_input.hh"
 #include "ridf_input.hh"
 
+#ifdef USE_INPUTFILTER
+#include "lmd_source_multievent.hh"
+#endif
+
+#include "range_reader.hh"
+#include "merge_reader.hh"
+
 class data_input_source;
+class file_view;
 
 class event_reader :
   public worker_thread
 {
 public:
+  event_reader();
   virtual ~event_reader();
 
 public:
   // The record/event reader
 #ifdef USE_LMD_INPUT
+#ifdef USE_INPUTFILTER
+  // Builds AIDA/DTAS events (if enabled), the workers unpack them
+  lmd_source_multievent _reader;
+#else
   lmd_source _reader;
 #endif
+#endif
 #ifdef USE_PAX_INPUT
   pax_source _reader;
 #endif
@@ -55,6 +70,10 @@ public:
   ridf_source _reader;
 #endif
 
+public:
+  // Which unpack queue each event goes to
+  queue_selector _queue_select;
+
 public:
   virtual void *worker();
 
@@ -63,6 +82,33 @@ public:
 
   void wait_for_unpack_queue_slot();
 
+#ifdef USE_LMD_INPUT
+public:
+  // Helpers to parse ranges of the file in parallel (--split-file)
+  range_reader *_range_readers;
+  int           _num_range_readers;
+
+public:
+  void spawn_range_readers(int n);
+
+protected:
+  bool process_file_split(file_view *view,off_t start);
+  void insert_range_items(range_reader *rr,bool events);
+#endif
+
+#if defined(USE_MERGING) && defined(USE_LMD_INPUT)
+public:
+  // One reader per concurrent source when merging (--merge)
+  merge_reader *_merge_readers;
+  int           _num_merge_readers;
+
+public:
+  void spawn_merge_readers(int n);
+
+protected:
+  void *merge_worker();
+  void forward_merge_item(const eq_item &item,int info);
+#endif
 
 };
 
@@ -29,6 +29,7 @@
 
 #include "multi_info.hh"
 #include "pretty_dump.hh"
+#include "subevent_match_cache.hh"
 
 #include <utility>
 #include <vector>
@@ -25,6 +25,7 @@
 #include "colourtext.hh"
 #include "parse_util.hh"
 #include "format_prefix.hh"
+#include "bulk_swap.hh"
 
 #include "mc_def.hh"
 
@@ -44,6 +45,7 @@
 
 
 #include "util.hh"
+#include "arena_chunk.hh"
 #include "worker_thread.hh"
 #include "watcher.hh"
 #include "tstamp_alignment.hh"
@@ -54,6 +56,8 @@
 #include "thread_info_window.hh"
 #include "thread_queue.hh"
 #include "thread_block.hh"
+#include "thread_pin.hh"
+#include "pipe_buffer.hh"
 
 #include "open_retire.hh"
 #include "event_reader.hh"
@@ -89,10 +93,20 @@ void usage()
   printf ("  stream://HOST     Read from stream server HOST.\n");
   printf ("  trans://HOST      Read from transport HOST.\n");
   printf ("  --scramble        Toggle scrambling of data.\n");
+  printf ("  --bulk-swap       Byte-swap foreign-endian subevents in one pass.\n");
+#if !defined(USE_THREADING) && !defined(USE_MERGING)
+  printf ("  --build-index     Write event index (FILE.idx) while reading files.\n");
+#endif
 #else
   printf (" (stream,event,trans://)  No MBS input support compiled in.\n");
 #endif
   printf ("  --input-buffer=N  Input buffer size.\n");
+#ifdef HAVE_IO_URING
+  printf ("  --input-io=MODE   File reading: mmap, read, or uring.\n");
+#else
+  printf ("  --input-io=MODE   File reading: mmap, or read.\n");
+#endif
+  printf ("  --external-decompress  Always fork gunzip/unxz etc for compressed input.\n");
 #if defined(USE_EXT_WRITER) && !defined(USE_MERGING)
   printf ("  --in-tuple=LVL,DET,FILE  Read data from ROOT/STRUCT.\n");
   //printf ("  --reverse         Run mapping in reverse (only with --in-tuple).\n");
@@ -105,6 +119,7 @@ void usage()
   printf ("  --aida-ids=P,W     The ProcID (P) and WR ID (W) for AIDA events. Default: 90, 700\n");
   printf ("  --aida-old-stitch  Use the older method of time-stitching AIDA (ignore length of AIDA event)\n");
   printf ("  --aida-skip-decays Don't output AIDA decay events (for near-line speedup)\n");
+  printf ("  --aida-decoders=N  Threads that decode large AIDA blocks. Default: 0 (input thread)\n");
   printf ("  --dtas             Also split DTAS events\n");
 #else
   printf (" (--aida)           No support for AIDA event building compiled in.\n");
@@ -137,11 +152,12 @@ void usage()
   printf ("  --print-buffer    Print buffer headers.\n");
   printf ("  --print           Print event headers.\n");
   printf ("  --data            Print event data.\n");
-  printf ("  --debug           Print events causing errors.\n");
+  printf ("  --debug           Print events causing errors (and buffer arena usage).\n");
   printf ("  --print-members   Print unpack data members.\n");
   printf ("  --colour=yes|no   Force colour and markup on or off.\n");
   printf ("  --event-sizes     Show average sizes of events and subevents.\n");
   printf ("  --data-sizes      Show data size usage by data members.\n");
+  printf ("  --match-profile=FILE  Write select candidate counts (for ucesbgen --profile).\n");
 
 #if defined(USE_EXT_WRITER)
   printf ("  --monitor[=PORT]  Status information server.\n");
@@ -193,10 +209,15 @@ void usage()
   printf ("  --corr=TRIG,DET,FILE  Create 2D correlation plot.\n");
   printf ("  --dump=LVL        Text dump of data from data structures.\n");
 #ifdef USE_THREADING
-  printf ("  --threads=N       Number of worker threads.\n");
+  printf ("  --threads=N       Number of worker threads (default: available CPUs - 2).\n");
+  printf ("  --pin=CPUS        Pin threads: none (default), auto, or CPU list (Extr,Work..,Final).\n");
   printf ("  --files-ahead=N   Number of files to buffer ahead.\n");
+#ifdef USE_LMD_INPUT
+  printf ("  --split-file=N    Parse N byte ranges of each (plain) file in parallel.\n");
+#endif
 #else
   printf (" (--threads)        No threading support compiled in.\n");
+  printf (" (--pin)            No threading support compiled in.\n");
   printf (" (--files-ahead)    No threading support compiled in.\n");
 #endif
 #ifdef USE_CURSES
@@ -247,7 +268,7 @@ thread_info_window *_ti_info_window = NULL;
 #ifdef USE_THREADING
 open_retire     _open_retire_thread;
 event_reader    _event_reader_thread;
-event_processor _event_processor_threads[MAX_THREADS];
+event_processor *_event_processor_threads = NULL;
 #else
 # ifdef USE_PTHREAD
 thread_block    _block_main;
@@ -623,6 +644,94 @@ void parse_merge_options(const char *command)
 
 /********************************************************************/
 
+#if defined(USE_THREADING) && defined(USE_LMD_INPUT)
+// The output of the threaded retire stage, one event at a time, in
+// order.  Like the non-threaded loop: with time stitching, an output
+// event is held until an event that is not combined with it arrives.
+// The stamps were extracted by the unpack workers, only the
+// comparison with the previous event is done here.
+
+void retire_output_event(ucesb_event_loop &loop,event_base *eb,
+			 bool processed,stitch_info *stitch,
+			 uint32_t *output_eventno)
+{
+  FILE_INPUT_EVENT *file_event = (FILE_INPUT_EVENT *) eb->_file_event;
+
+  if (_conf._event_stitch_mode)
+    ucesb_event_loop::stitch_decide(&eb->_stitch,stitch);
+
+  // Events that failed to unpack are not written
+  if (!processed)
+    return;
+
+  if (_conf._event_stitch_mode &&
+      (!stitch->_combine || stitch->_badstamp))
+    {
+      // Dump previous events!  Already formatted.
+
+      for (unsigned int i = 0; i < loop._output.size(); i++)
+	{
+	  output_info &output = loop._output[i];
+
+	  if (output._dest->_select.accept_final_event(&output._event))
+	    {
+	      output._dest->event_no_seen(output._event._info.l_count);
+	      output._dest->write_event(&output._event);
+	    }
+	}
+    }
+
+  for (unsigned int i = 0; i < loop._output.size(); i++)
+    {
+      output_info &output = loop._output[i];
+
+      if (!stitch->_combine || stitch->_badstamp)
+	output._event.clear();
+
+      if (!output._dest->_select.accept_event(file_event,
+					      &file_event->_header))
+	continue;
+
+#ifdef COPY_OUTPUT_FILE_EVENT
+      if (!COPY_OUTPUT_FILE_EVENT(&output._event,
+				  file_event,
+				  &eb->_unpack,
+				  &output._dest->_select,
+				  stitch->_combine))
+	continue;
+#else
+      // Unless stitching, the event is written below, before it is
+      // reclaimed, so no copy.
+      output._event.copy(file_event,&output._dest->_select,
+			 stitch->_combine,true,
+			 !_conf._event_stitch_mode);
+#endif
+#ifdef USE_MERGING
+      if (!stitch->_combine &&
+	  _conf._merge_event_mode != MERGE_EVENTS_MODE_EVENTNO)
+	output._event._info.l_count = ++(*output_eventno);
+#else
+      UNUSED(output_eventno);
+#endif
+
+      if (!_conf._event_stitch_mode ||
+	  stitch->_badstamp)
+	{
+	  if (output._dest->_select.accept_final_event(&output._event))
+	    {
+	      output._dest->event_no_seen(output._event._info.l_count);
+	      output._dest->write_event(&output._event);
+	    }
+
+	  if (stitch->_badstamp)
+	    output._event.clear();
+	}
+    }
+}
+#endif
+
+/********************************************************************/
+
 int main(int argc, char **argv)
 {
   //INTS4 ll,l_evts=0;
@@ -661,6 +770,7 @@ int main(int argc, char **argv)
   _conf._eventbuilder_window = 2200;
   _conf._aida_new_stitch = true;
   _conf._aida_skip_decays = false;
+  _conf._aida_decoders = 0;
 #endif
   for (int i = 1; i < argc; i++)
     {
@@ -700,6 +810,21 @@ int main(int argc, char **argv)
       else if (MATCH_ARG("--scramble")) {
 	_conf._scramble = 1;
       }
+      else if (MATCH_ARG("--bulk-swap")) {
+#ifdef UNPACKER_HAS_UINT64_ITEMS
+	// The two 32-bit halves would be read in the wrong order
+	ERROR("--bulk-swap not supported, the specification has UINT64 items.");
+#endif
+	_conf._bulk_swap = 1;
+	bulk_swap_init();
+      }
+      else if (MATCH_ARG("--build-index")) {
+#if defined(USE_THREADING) || defined(USE_MERGING)
+	// The index is made by the serial, single source event loop
+	ERROR("--build-index not supported with threading or merging.");
+#endif
+	_conf._build_index = 1;
+      }
       else if (MATCH_PREFIX("--time-stitch=",post)) {
 	parse_time_stitch_options(post);
       }
@@ -733,6 +858,15 @@ int main(int argc, char **argv)
       else if (MATCH_ARG("--aida-skip-decays")) {
          _conf._aida_skip_decays = true;
       }
+      else if (MATCH_PREFIX("--aida-decoders=",post)) {
+#ifdef USE_PTHREAD
+         _conf._aida_decoders = atoi(post);
+         if (_conf._aida_decoders < 0 || _conf._aida_decoders > 64)
+           ERROR("Bad number of AIDA decoders (%s) (0..64).", post);
+#else
+         ERROR("--aida-decoders= needs pthread support.");
+#endif
+      }
       else if (MATCH_ARG("--dtas")) {
 	_conf._enable_dtas = true;
       }
@@ -817,7 +951,11 @@ int main(int argc, char **argv)
 	_conf._event_sizes = 1;
       }
       else if (MATCH_ARG("--data-sizes")) {
-	_conf._account = 1;
+	_conf._account |= 1;
+      }
+      else if (MATCH_PREFIX("--match-profile=",post)) {
+	_conf._match_profile = post;
+	_conf._account |= 2;
       }
       else if (MATCH_ARG("--print")) {
 	_conf._print = 1;
@@ -862,14 +1000,18 @@ int main(int argc, char **argv)
 
       }
       else if (MATCH_ARG("--watcher")) {
-#ifdef USE_CURSES
+#ifdef USE_MERGING
+	ERROR("No watcher when compiled for merging (no raw event level).");
+#elif defined(USE_CURSES)
 	_conf._watcher._command = ""; // non-NULL, i.e. active
 #else
 	ERROR("No watcher - support for ncurses not compiled in.  Compile using 'make USE_CURSES=1'");
 #endif
       }
       else if (MATCH_PREFIX("--watcher=",post)) {
-#ifdef USE_CURSES
+#ifdef USE_MERGING
+	ERROR("No watcher when compiled for merging (no raw event level).");
+#elif defined(USE_CURSES)
 	_conf._watcher._command = post;
 #else
 	ERROR("No watcher - support for ncurses not compiled in.  Compile using 'make USE_CURSES=1'");
@@ -891,15 +1033,52 @@ int main(int argc, char **argv)
 	_conf._broken_files = 1;
       }
       else if (MATCH_ARG("--no-mmap")) {
+	_conf._input_io = INPUT_IO_DEFAULT;
 	_conf._no_mmap = 1;
       }
+      else if (MATCH_ARG("--external-decompress")) {
+	_conf._external_decompress = 1;
+      }
+      else if (MATCH_PREFIX("--input-io=",post)) {
+	// The last mode given wins, so each sets both fields
+	if (strcmp(post,"mmap") == 0) {
+	  _conf._input_io = INPUT_IO_DEFAULT;
+	  _conf._no_mmap = 0;
+	}
+	else if (strcmp(post,"read") == 0) {
+	  _conf._input_io = INPUT_IO_DEFAULT;
+	  _conf._no_mmap = 1;
+	}
+	else if (strcmp(post,"uring") == 0) {
+#ifdef HAVE_IO_URING
+	  _conf._input_io = INPUT_IO_URING;
+	  _conf._no_mmap = 0; // mmap is the fallback without io_uring
+#else
+	  ERROR("No io_uring support compiled in.");
+#endif
+	}
+	else
+	  ERROR("Bad option '%s' for --input-io=",post);
+      }
 #ifdef USE_THREADING
       else if (MATCH_PREFIX("--threads=",post)) {
 	_conf._num_threads = atoi(post);
       }
+      else if (MATCH_PREFIX("--pin=",post)) {
+	_conf._pin = post;
+      }
       else if (MATCH_PREFIX("--files-ahead=",post)) {
         _conf._files_open_ahead = atoi(post);
       }
+#ifdef USE_LMD_INPUT
+      else if (MATCH_PREFIX("--split-file=",post)) {
+	_conf._split_file = atoi(post);
+	if (_conf._split_file < 1 ||
+	    _conf._split_file > MAX_RANGE_READERS)
+	  ERROR("Bad number of ranges (%s) for --split-file= (1..%d).",
+		post,MAX_RANGE_READERS);
+      }
+#endif
 #endif
 #ifdef USE_CURSES
       else if (MATCH_ARG("--progress")) {
@@ -1096,12 +1275,38 @@ int main(int argc, char **argv)
 #endif
 #endif
 
-  int threads = MAX_THREADS; // fix this
+  int threads = 1;
   int tasks   = 3; // extract, unpack, retire
 
 #ifdef USE_THREADING
+  threads = _conf._num_threads;
+
+  if (threads <= 0)
+    {
+      // Default: one worker per CPU we may run on, less the two
+      // for the Extr and Final threads, such that all can be pinned
+      cpu_set_t affinity;
+
+      threads = 1;
+      if (sched_getaffinity(0,sizeof(affinity),&affinity) == 0 &&
+	  CPU_COUNT(&affinity) > 3)
+	threads = CPU_COUNT(&affinity) - 2;
+    }
+  if (threads > MAX_THREADS)
+    {
+      WARNING("Limiting number of worker threads to %d (requested %d).",
+	      MAX_THREADS,threads);
+      threads = MAX_THREADS;
+    }
+
+  thread_pin_setup(_conf._pin,threads);
+
   _unpack_event_queue.init(threads);
+  _event_reader_thread._queue_select.init(&_unpack_event_queue,threads,
+					  UNPACK_QUEUE_LEN);
   _retire_queue.init(threads);
+
+  _event_processor_threads = new event_processor[threads];
 #endif
 
 #if !defined(NDEBUG) && DEBUG_THREADING
@@ -1110,7 +1315,13 @@ int main(int argc, char **argv)
 
 #ifdef USE_THREADING
   for (int i = 0; i < threads; i++)
-    _event_processor_threads[i].init(i);
+    {
+      _event_processor_threads[i]._pin = THREAD_PIN_WORK + i;
+      _event_processor_threads[i].init(i,_event_processor_threads,threads);
+    }
+  _event_reader_thread._pin = THREAD_PIN_EXTR;
+  pipe_buffer_base::_reader_thread_init = thread_pin_input;
+  forked_child::_child_init = thread_pin_release;
 #endif
 
 #if defined(USE_EXT_WRITER)
@@ -1126,6 +1337,36 @@ int main(int argc, char **argv)
 
   if (_conf._files_open_ahead < 1)
     _conf._files_open_ahead = 1;
+#if defined(USE_MERGING) && defined(USE_THREADING)
+  // All the concurrent sources of the merge must be open
+  if (_conf._files_open_ahead < _conf._merge_concurrent_files)
+    _conf._files_open_ahead = _conf._merge_concurrent_files;
+#endif
+
+  // Before the threads are started, as the merge stage uses it
+  if (_conf._ts_align_hist_command
+#ifdef USE_MERGING
+      || _conf._merge_concurrent_files
+#endif
+      )
+    {
+#ifdef USE_LMD_INPUT
+      _ts_align_hist = new tstamp_alignment(_conf._ts_align_hist_command,
+# ifdef USE_MERGING
+          _conf._merge_event_mode
+# else
+          0
+# endif
+          );
+#endif
+    }
+
+  if (_conf._ts_print_command)
+    {
+#ifdef USE_LMD_INPUT
+      _ts_sync_check = new tstamp_sync_check(_conf._ts_print_command);
+#endif
+    }
 
   bool had_broken = false;
 
@@ -1141,6 +1382,14 @@ int main(int argc, char **argv)
 					&_event_reader_thread._block))
 	files_opened++;
     }
+#ifdef USE_LMD_INPUT
+  if (_conf._split_file > 1)
+    _event_reader_thread.spawn_range_readers(_conf._split_file);
+#endif
+#if defined(USE_MERGING) && defined(USE_LMD_INPUT)
+  if (_conf._merge_concurrent_files)
+    _event_reader_thread.spawn_merge_readers(_conf._merge_concurrent_files);
+#endif
   _event_reader_thread.spawn();
 #endif
 
@@ -1181,35 +1430,11 @@ int main(int argc, char **argv)
     }
 #endif
 
-#ifdef USE_MERGING
+#if defined(USE_MERGING) && !defined(USE_THREADING)
   merge_event_order *prev_event_merge_order = NULL;
   uint32_t output_eventno = 0;
 #endif
 
-  if (_conf._ts_align_hist_command
-#ifdef USE_MERGING
-      || _conf._merge_concurrent_files
-#endif
-      )
-    {
-#ifdef USE_LMD_INPUT
-      _ts_align_hist = new tstamp_alignment(_conf._ts_align_hist_command,
-# ifdef USE_MERGING
-          _conf._merge_event_mode
-# else
-          0
-# endif
-          );
-#endif
-    }
-
-  if (_conf._ts_print_command)
-    {
-#ifdef USE_LMD_INPUT
-      _ts_sync_check = new tstamp_sync_check(_conf._ts_print_command);
-#endif
-    }
-
   // Do any global pre-processing, like reading calibration parameters
   // Note, the input stream is already opened and buffering, and we
   // (or better: another processor) is already filling the buffers
@@ -1248,47 +1473,15 @@ int main(int argc, char **argv)
     // Fire up the worker threads
 
 #ifdef USE_THREADING
-    {
-      cpu_set_t orig_affinity;
-      int use_cpu = 0;
-
-      sched_getaffinity(0,sizeof(orig_affinity),&orig_affinity);
-
-      for (int i = 0; i < threads; i++)
-	{
-	  cpu_set_t thread_affinity;
-
-	  CPU_ZERO(&thread_affinity);
-
-	  // Each worker thread executes on a specific CPU
-	  while (!CPU_ISSET(use_cpu,&orig_affinity))
-	    {
-	      if (use_cpu >= CPU_SETSIZE)
-		{
-		  WARNING("Could only find %d CPUs to run worker threads on.",
-			  i);
-		  goto no_more_worker_cpus;
-		}
-	      use_cpu++;
-	    }
-	  CPU_SET(use_cpu,&thread_affinity);
-	  use_cpu++;
-
-	  //sched_setaffinity(0,sizeof(thread_affinity),&thread_affinity);
-	  _event_processor_threads[i].spawn();
-	}
-    no_more_worker_cpus:
-      // Put us back to execute wherever the OS finds nice
-      sched_setaffinity(0,sizeof(orig_affinity),&orig_affinity);
-    }
+    for (int i = 0; i < threads; i++)
+      _event_processor_threads[i].spawn();
 #endif
 
-#ifndef USE_THREADING
-
     /****************************************************************/
     // Open output
 
 #ifdef USE_LMD_INPUT
+#ifndef USE_THREADING
     if (_conf._file_output_bad._name)
       {
 	loop._file_output_bad =
@@ -1300,6 +1493,7 @@ int main(int argc, char **argv)
 
 	loop._file_output_bad->set_file_header(NULL,msg, "", "");
       }
+#endif
     for (config_output_vect::iterator output = _outputs.begin();
 	 output != _outputs.end() ; ++output)
 	{
@@ -1322,6 +1516,8 @@ int main(int argc, char **argv)
 	}
 #endif
 
+#ifndef USE_THREADING
+
 #ifdef USE_LMD_INPUT
     bool check_new_file_header = true;
 
@@ -1334,7 +1530,7 @@ int main(int argc, char **argv)
     stitch._combine = false;
 #endif
 
-    int skip_events_counter = 0;
+    int64_t skip_events_counter = 0;
     bool printed_skipped = false;
     bool printed_skipped_eventno = false;
     int downscale_counter = 0;
@@ -1388,6 +1584,16 @@ int main(int argc, char **argv)
 
 #ifdef USE_MERGING
 	      _ti_info._file_input = NULL; /* got troubles when src object deleted.. */
+#endif
+#if defined(USE_LMD_INPUT) && !defined(USE_MERGING)
+	      // Jump ahead using the index file, if there is one
+	      if (skip_events_counter < _conf._skip_events ||
+		  _conf._first_event >= 0)
+		skip_events_counter += (int64_t)
+		  loop.seek_source_index(this_input,
+					 _conf._skip_events -
+					 skip_events_counter,
+					 _conf._first_event);
 #endif
 	    } catch (error &e) {
 	      had_broken = true;
@@ -1500,7 +1706,7 @@ get_next_event:
 		    (skip_events_counter % 1000) == 0 ||
 		    skip_events_counter == _conf._skip_events)
 		  {
-		    fprintf(stderr, "Skipped events: %s%d%s\r",
+		    fprintf(stderr, "Skipped events: %s%" PRId64 "%s\r",
 			    CT_OUT(BOLD_GREEN),
 			    skip_events_counter,
 			    CT_OUT(NORM_DEF_COL));
@@ -1913,8 +2119,11 @@ get_next_event:
 					      stitch._combine))
 		    continue;
 #else
+		  // Unless stitching, the event is written below, while
+		  // the data of file_event is still around, so no copy.
 		  output._event.copy(file_event,&output._dest->_select,
-				     stitch._combine);
+				     stitch._combine,true,
+				     !_conf._event_stitch_mode);
 		  UNUSED(unpack_event);
 #endif
 #ifdef USE_MERGING
@@ -2281,10 +2490,61 @@ get_next_event:
 
     next_show_time = last_show_time;
 
+#ifdef USE_LMD_INPUT
+    // Output is written here, see retire_output_event().
+    stitch_info retire_stitch;
+    uint32_t output_eventno = 0;
+
+    retire_stitch._last_stamp = 0;
+    retire_stitch._has_stamp = false;
+    retire_stitch._badstamp = false;
+    retire_stitch._combine = false;
+#ifdef USE_INPUTFILTER
+    retire_stitch._implant[0] = false;
+    retire_stitch._implant[1] = false;
+#endif
+
+    if (!loop._output.empty())
+      {
+	// The file headers of the inputs are seen by the reader
+	// thread only, so the output gets a header of its own.
+
+	char msg[81];
+	char msg_ts[81] = "";
+
+	snprintf (msg,sizeof(msg),
+		  "Processed by UCESB/unpacker: %s",argv[0]);
+
+	if (_conf._event_stitch_mode == TIMESTAMP_TYPE_WR)
+	  snprintf (msg_ts,sizeof(msg_ts),
+		    "Time-stitched with WR, window = %d ns",
+		    _conf._event_stitch_value);
+
+	for (unsigned int i = 0; i < loop._output.size(); i++)
+	  loop._output[i]._dest->set_file_header(NULL,msg,"",msg_ts);
+      }
+#endif
+
+    // Pinned (with --pin) only now that all other threads have been
+    // started, as they would otherwise inherit our mask.  Later file
+    // readers pin themselves, and forked children are released.
+    thread_pin_self(THREAD_PIN_FINAL);
+
     for ( ; ; )
       {
 	_ti_info.update();
 
+#if defined(USE_EXT_WRITER)
+	// The per-thread counters are only summed when the monitor
+	// wants an update.
+	if (_status_block._mon_update_seq != _status_block._update_seq)
+	  {
+	    event_processor::sum_counts(&_status,
+					_event_processor_threads,threads);
+	    MON_CHECK_COPY_BLOCK(&_status_block, &_status);
+	  }
+#endif
+
 	////////////////////////////////////////////////////////////
 	// Retire events
 
@@ -2305,6 +2565,20 @@ get_next_event:
 
 	    int info = item._info;
 
+#ifdef USE_LMD_INPUT
+	    if (info & (EQ_INFO_PROCESS | EQ_INFO_DAMAGED))
+	      {
+		try {
+		  retire_output_event(loop,(event_base *) item._event,
+				      !!(info & EQ_INFO_PROCESS),
+				      &retire_stitch,&output_eventno);
+		} catch (error &e) {
+		  WARNING("Error while writing output, aborting...");
+		  goto no_more_files;
+		}
+	      }
+#endif
+
 	    if (UNLIKELY(info & (EQ_INFO_FILE_CLOSE |
 				 EQ_INFO_FLUSH |
 				 EQ_INFO_PRINT_EVENT)))
@@ -2360,7 +2634,11 @@ get_next_event:
 			  // src_event->get_10_1_info();    // this may throw up (also)...
 			  // src_event->locate_subevents(); // this may throw up...
 
-			  ucesb_event_loop::force_event_data(*eb);
+			  ucesb_event_loop::force_event_data(*eb
+#if defined(USE_LMD_INPUT) || defined(USE_HLD_INPUT) || defined(USE_RIDF_INPUT)
+							     , &loop._source_event_hint
+#endif
+							     );
 
 			} catch (error &e) {
 
@@ -2372,7 +2650,9 @@ get_next_event:
 			// Now, we are set to print the event!
 			// And it will be printed directly
 
-			((FILE_INPUT_EVENT *) eb->_file_event)->print_event(!!(info & EQ_INFO_PRINT_EVENT_DATA));
+			((FILE_INPUT_EVENT *) eb->_file_event)->
+			  print_event(!!(info & EQ_INFO_PRINT_EVENT_DATA),
+				      &eb->_unpack_fail);
 		      }
 		  }
 	      }
@@ -2512,9 +2792,35 @@ get_next_event:
  no_more_files:
     ;
 
+#ifdef USE_LMD_INPUT
+    try {
+      if (_conf._event_stitch_mode)
+	{
+	  // Dump last event!  Already formatted.
+
+	  for (unsigned int i = 0; i < loop._output.size(); i++)
+	    {
+	      output_info &output = loop._output[i];
+
+	      if (output._dest->_select.accept_final_event(&output._event))
+		{
+		  output._dest->event_no_seen(output._event._info.l_count);
+		  output._dest->write_event(&output._event);
+		}
+	    }
+	}
+      loop.close_output();
+    } catch (error &e) {
+      WARNING("Error while closing output...");
+      return 1;
+    }
+#endif
 #endif
   }
 
+  if (_conf._debug)
+    arena_chunk_stats();
+
   return 0;
 }
 
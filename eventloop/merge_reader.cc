@@ -0,0 +1,262 @@
+/* This file is part of UCESB - a tool for data unpacking and processing.
+ *
+ * Copyright (C) 2016  Haakan T. Johansson  <f96hajo@chalmers.se>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301  USA
+ */
+
+#include "merge_reader.hh"
+
+#include "thread_buffer.hh"
+#include "event_base.hh"
+#include "pipe_buffer.hh"
+
+#include "config.hh"
+
+#if defined(USE_MERGING) && defined(USE_LMD_INPUT)
+
+merge_reader::merge_reader()
+{
+  _source = NULL;
+  _state  = MERGE_READER_IDLE;
+
+  _busy       = false;
+  _head_ready = false;
+}
+
+merge_reader::~merge_reader()
+{
+
+}
+
+
+void merge_reader::start(data_input_source *source,const char *filename)
+{
+  _source = source;
+
+  _busy       = true;
+  _head_ready = false;
+
+  _seb._src    = &_reader;
+  _seb._event  = NULL;
+  _seb._sticky_event = NULL;
+  _seb._name   = filename ? filename : "-";
+  _seb._events = 0;
+  _seb._events_last_show = 0;
+
+  MFENCE; // job must be set up before the state change
+
+  _state = MERGE_READER_WORK;
+  _block.wakeup();
+}
+
+
+void *merge_reader::worker()
+{
+  TDBG("");
+
+  for ( ; ; )
+    {
+      while (_state != MERGE_READER_WORK)
+	_block.block();
+
+      MFENCE; // see the job before working on it
+
+      process_source();
+    }
+
+  return NULL;
+}
+
+
+eq_item &merge_reader::wait_for_queue_slot()
+{
+  // We must have a slot to insert an item, or we must wait
+  for ( ; ; )
+    {
+      if (_queue.can_insert())
+	break;
+
+      TDBG("none available");
+
+      _queue.request_insert_wakeup(&_block);
+      if (_queue.can_insert())
+	{
+	  _queue.cancel_insert_wakeup();
+	  break;
+	}
+      TDBG("waiting");
+      _block.block();
+    }
+
+  return _queue.next_insert();
+}
+
+
+void merge_reader::process_source()
+{
+  data_input_source *source = _source;
+
+  _reader.take_over(*source);
+
+  // Any thread reading the input shall wake us when waiting for data
+  pipe_buffer_base *pbuf =
+    dynamic_cast<pipe_buffer_base *>(_reader._input._input);
+
+  if (pbuf)
+    pbuf->_block_reader = &_block;
+
+  _reader.new_file();
+
+  {
+    eq_item &send_item      = wait_for_queue_slot();
+
+    send_item._info         = EQ_INFO_MESSAGE;
+    send_item._event        = NULL; // there is no event payload
+    send_item._reclaim      = NULL;
+    // Any error(info messages goes to this queue item
+    _wt._last_reclaim       = &send_item._reclaim;
+
+    bool failed = false;
+
+    try {
+      if (!_reader.read_record())
+	ERROR("No record in file.");
+    } catch (error &e) {
+      WARNING("Skipping this file...");
+      failed = true;
+    }
+
+    // Stop giving error messages to queue item
+    send_item._last_reclaim = _wt._last_reclaim;
+    _wt._last_reclaim = NULL;
+
+    _queue.insert();
+    _queue.flush_avail();
+
+    if (failed)
+      goto no_more_events;
+  }
+
+  // Loop over all events
+  for ( ; ; )
+    {
+      eq_item &send_item      = wait_for_queue_slot();
+
+      send_item._info         = EQ_INFO_MESSAGE;
+      send_item._event        = NULL;
+      send_item._reclaim      = NULL;
+      // Any error(info messages goes to this queue item
+      _wt._last_reclaim       = &send_item._reclaim;
+
+      event_base *eb = NULL;
+      bool done = false;
+
+      try {
+	eb = (event_base *)
+	  _wt._defrag_buffer->allocate_reclaim(sizeof (event_base));
+
+	memset(eb,0,sizeof(event_base));
+
+	eb->_file_event = _reader.get_event();
+      } catch (error &e) {
+	WARNING("Skipping this file...");
+	eb = NULL;
+      }
+
+      if (!eb || !eb->_file_event)
+	done = true; // (the item only carries messages and memory)
+      else
+	{
+	  send_item._event = eb;
+
+	  // The merge decision needs the event number or time stamp,
+	  // i.e. at least the subevents located.
+
+	  try {
+	    ucesb_event_loop::pre1_unpack_event((FILE_INPUT_EVENT *)
+						eb->_file_event);
+	    ucesb_event_loop::pre2_unpack_event(*eb,&_hints);
+	    send_item._info = EQ_INFO_PROCESS | EQ_INFO_PRE_UNPACKED;
+#ifdef MERGE_COMPARE_EVENTS_AFTER
+	    // The user comparison looks at the unpacked event
+	    if (_conf._merge_event_mode == MERGE_EVENTS_MODE_USER)
+	      {
+		ucesb_event_loop::unpack_event<event_base,0,0>(*eb);
+		send_item._info |= EQ_INFO_UNPACKED;
+	      }
+#endif
+	  } catch (error &e) {
+	    // Cannot take part in the merge, is passed on directly
+	    send_item._info = EQ_INFO_DAMAGED;
+
+	    if (_conf._debug)
+	      send_item._info |= (EQ_INFO_PRINT_EVENT |
+				  EQ_INFO_PRINT_EVENT_DATA);
+	  }
+
+	  if (_conf._print)
+	    {
+	      if (_conf._data)
+		send_item._info |= (EQ_INFO_PRINT_EVENT |
+				    EQ_INFO_PRINT_EVENT_DATA);
+	      else
+		send_item._info |= EQ_INFO_PRINT_EVENT;
+	    }
+	}
+
+      // Stop giving error messages to queue item
+      send_item._last_reclaim = _wt._last_reclaim;
+      _wt._last_reclaim = NULL;
+
+      _queue.insert();
+      // The event reader cannot decide without our next event, so
+      // wake it up even if it only has this one.
+      _queue.flush_avail();
+
+      if (done)
+	break;
+    }
+
+ no_more_events:
+
+  // If we have stopped reading the file prematurely, then we must
+  // make sure that another file gets opened ASAP!
+  _reader._input._input->request_next_file();
+
+  TDBG("source processed");
+
+  // Take back the source
+  source->take_over(_reader);
+
+  // Before the close item is seen, since the event reader may then
+  // give us the next source right away
+  _state = MERGE_READER_IDLE;
+
+  {
+    eq_item &send_item      = wait_for_queue_slot();
+
+    send_item._info         = EQ_INFO_FILE_CLOSE;
+    send_item._event        = source; // The source item to be removed
+    send_item._reclaim      = NULL;
+    send_item._last_reclaim = NULL; // there will be no error messages
+
+    _queue.insert();
+    _queue.flush_avail();
+  }
+}
+
+#endif//USE_MERGING && USE_LMD_INPUT
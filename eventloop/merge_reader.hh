@@ -0,0 +1,90 @@
+/* This file is part of UCESB - a tool for data unpacking and processing.
+ *
+ * Copyright (C) 2016  Haakan T. Johansson  <f96hajo@chalmers.se>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301  USA
+ */
+
+#ifndef __MERGE_READER_HH__
+#define __MERGE_READER_HH__
+
+#include "worker_thread.hh"
+#include "thread_queue.hh"
+#include "data_queues.hh"
+
+#include "lmd_input.hh"
+#include "event_loop.hh"
+
+#if defined(USE_MERGING) && defined(USE_LMD_INPUT)
+
+// When merging (--merge=style,N), each of the N concurrent sources is
+// read by its own thread.  It extracts and pre-unpacks (locates the
+// subevents of) the events, and hands them in file order to the
+// event reader, which does the merge decision and passes the events
+// on to the unpack workers.
+
+#define MERGE_QUEUE_LEN          256 // must be power of 2
+
+#define MERGE_READER_IDLE        0
+#define MERGE_READER_WORK        1
+
+class data_input_source;
+
+class merge_reader :
+  public worker_thread
+{
+public:
+  merge_reader();
+  virtual ~merge_reader();
+
+public:
+  lmd_source _reader;
+
+  ucesb_event_loop::source_event_hint_t _hints;
+
+public:
+  // Set up by the event reader before _state is set to WORK
+  data_input_source *_source;
+
+  volatile int  _state;
+
+public:
+  // Events (with EQ_INFO_PROCESS), messages, and finally the
+  // EQ_INFO_FILE_CLOSE item of the source.  Only the event reader
+  // removes items.
+  single_thread_queue<eq_item,MERGE_QUEUE_LEN> _queue;
+
+public:
+  // Used by the event reader only
+  bool              _busy;       // has source (close item not yet seen)
+  bool              _head_ready; // merge info of head event prepared
+  source_event_base _seb;        // merge info of head event
+
+public:
+  virtual void *worker();
+
+public:
+  void start(data_input_source *source,const char *filename);
+
+protected:
+  void process_source();
+  eq_item &wait_for_queue_slot();
+
+};
+
+#endif//USE_MERGING && USE_LMD_INPUT
+
+#endif//__MERGE_READER_HH__
@@ -63,6 +63,7 @@ bool open_retire::open_file(int wakeup_this_file,
 
   send_item._info    = OFQ_INFO_FILE;
   send_item._source  = new data_input_source;
+  send_item._name    = _input_iter->_name;
   send_item._reclaim = NULL;
   // Any error(info messages goes to this queue item
   _wt._last_reclaim = &send_item._reclaim;
@@ -147,6 +148,7 @@ void open_retire::send_flush(int info)
 
   send_item._info    = OFQ_INFO_FLUSH | info;
   send_item._source  = NULL;
+  send_item._name    = NULL;
   send_item._reclaim = NULL;
   send_item._last_reclaim = NULL;
 
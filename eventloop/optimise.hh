@@ -82,5 +82,21 @@
 # define LFENCE MFENCE
 #endif
 
+// Data written by different threads should not share a cache line,
+// or the line bounces between the CPUs on every update (false
+// sharing).  Padding members to be placed between such data.
+
+#define CACHE_LINE_SIZE  64
+
+#define CACHE_LINE_PAD(name)  char name[CACHE_LINE_SIZE]
+
+// Hint to the CPU that we are in a busy-wait loop.
+
+#if defined (__i386__) || defined (__x86_64__)
+# define CPU_RELAX asm __volatile__ ("    pause  \n\t" : : : "memory")
+#else
+# define CPU_RELAX asm __volatile__ ("" : : : "memory")
+#endif
+
 #endif//__OPTIMISE_HH__
 
@@ -0,0 +1,170 @@
+/* This file is part of UCESB - a tool for data unpacking and processing.
+ *
+ * Copyright (C) 2016  Haakan T. Johansson  <f96hajo@chalmers.se>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301  USA
+ */
+
+#include "range_reader.hh"
+
+#include "file_view.hh"
+#include "thread_buffer.hh"
+#include "event_base.hh"
+
+#ifdef USE_LMD_INPUT
+
+range_reader::range_reader()
+{
+  _view  = NULL;
+  _start = 0;
+  _end   = 0;
+  _block_done = NULL;
+
+  _state  = RANGE_READER_IDLE;
+  _failed = false;
+}
+
+range_reader::~range_reader()
+{
+
+}
+
+
+void *range_reader::worker()
+{
+  TDBG("");
+
+  for ( ; ; )
+    {
+      while (_state != RANGE_READER_WORK)
+	_block.block();
+
+      MFENCE; // see the job before working on it
+
+      process_range();
+
+      MFENCE; // results must be visible before the state change
+
+      _state = RANGE_READER_DONE;
+      _block_done->wakeup();
+    }
+
+  return NULL;
+}
+
+
+void range_reader::process_range()
+{
+  TDBG("");
+
+  _items.clear();
+  _failed = false;
+
+  _reader._input._input = _view;
+  _reader._input._cur   = _start;
+
+  _reader.new_file();
+  _reader._expect_file_header  = false;
+  _reader._range_end           = _end;
+  _reader._range_skip_fragment = true;
+
+  for (bool done = false; !done; )
+    {
+      range_item item;
+
+      item._event   = NULL;
+      item._reclaim = NULL;
+      // Any error/info messages goes to this item
+      _wt._last_reclaim = &item._reclaim;
+
+      try {
+	event_base *eb = (event_base *)
+	  _wt._defrag_buffer->allocate_reclaim(sizeof (event_base));
+
+	memset(eb,0,sizeof(event_base));
+
+	eb->_file_event = _reader.get_event();
+
+	if (eb->_file_event)
+	  item._event = eb;
+	else
+	  done = true; // end of range
+      } catch (error &e) {
+	// The message is with the item.  The event reader will skip
+	// the rest of the file after this item.
+	_failed = true;
+	done = true;
+      }
+
+      item._last_reclaim = _wt._last_reclaim;
+      _wt._last_reclaim = NULL;
+
+      // There is always something to reclaim (the event_base
+      // allocation above), so _last_reclaim does not point into item.
+      assert(item._reclaim);
+
+      _items.push_back(item);
+    }
+
+  // The view is owned by the data_input_source
+  _reader._input._input = NULL;
+}
+
+
+// Look at the buffer header at start, to see if the rest of the file
+// can be split at fixed buffer boundaries.
+
+bool range_split_buffer_size(file_view *view,off_t start,
+			     size_t *buffer_size,bool *swapping)
+{
+  s_bufhe_host header;
+
+  if (!view->read_range(&header,start,sizeof(header)))
+    return false;
+
+  uint32 endian_free0 = (uint32) header.l_free[0];
+
+  if (endian_free0 == 0x00000001)
+    *swapping = false;
+  else if (endian_free0 == bswap_32(0x00000001))
+    *swapping = true;
+  else
+    return false;
+
+  if (*swapping)
+    byteswap_32(header);
+
+  // Only fixed size buffers can be found without walking the file
+
+  if (!((header.i_type    == LMD_BUF_HEADER_10_1_TYPE &&
+	 header.i_subtype == LMD_BUF_HEADER_10_1_SUBTYPE) ||
+	(header.i_type    == LMD_BUF_HEADER_HAS_STICKY_TYPE &&
+	 header.i_subtype == LMD_BUF_HEADER_HAS_STICKY_SUBTYPE)))
+    return false;
+
+  if (!header.l_dlen ||
+      header.l_dlen > 0x20000000)
+    return false;
+
+  *buffer_size = BUFFER_SIZE_FROM_DLEN((size_t) header.l_dlen);
+
+  if (*buffer_size % 1024)
+    return false;
+
+  return true;
+}
+
+#endif//USE_LMD_INPUT
@@ -0,0 +1,97 @@
+/* This file is part of UCESB - a tool for data unpacking and processing.
+ *
+ * Copyright (C) 2016  Haakan T. Johansson  <f96hajo@chalmers.se>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301  USA
+ */
+
+#ifndef __RANGE_READER_HH__
+#define __RANGE_READER_HH__
+
+#include "worker_thread.hh"
+
+#include "lmd_input.hh"
+
+#include <vector>
+
+#ifdef USE_LMD_INPUT
+
+// A large (plain) file can be split into byte ranges at buffer
+// boundaries, and the records and events of each range be extracted
+// by a separate thread.  A range owns the events that start in its
+// buffers.  An event fragmented across the range end is completed by
+// reading on into the next range, and that range skips the leading
+// fragment.  The event reader hands the ranges out, and then passes
+// the events on in range order, so global event order is kept.
+
+#define MAX_RANGE_READERS        16
+
+#define RANGE_READER_SPLIT_SIZE  0x01000000 // 16 MB (full buffers)
+
+#define RANGE_READER_IDLE        0
+#define RANGE_READER_WORK        1
+#define RANGE_READER_DONE        2
+
+class file_view;
+class event_base;
+
+struct range_item
+{
+  event_base    *_event; // NULL if only messages (or memory to reclaim)
+  reclaim_item  *_reclaim;
+  reclaim_item **_last_reclaim;
+};
+
+typedef std::vector<range_item> range_item_vector;
+
+class range_reader :
+  public worker_thread
+{
+public:
+  range_reader();
+  virtual ~range_reader();
+
+public:
+  lmd_source _reader;
+
+public:
+  // Set up by the event reader before _state is set to WORK
+  file_view    *_view;
+  off_t         _start;
+  off_t         _end;
+  thread_block *_block_done;
+
+  volatile int  _state;
+
+public:
+  // Valid when _state is DONE
+  range_item_vector _items;
+  bool              _failed;
+
+public:
+  virtual void *worker();
+
+public:
+  void process_range();
+
+};
+
+bool range_split_buffer_size(file_view *view,off_t start,
+			     size_t *buffer_size,bool *swapping);
+
+#endif//USE_LMD_INPUT
+
+#endif//__RANGE_READER_HH__
@@ -0,0 +1,121 @@
+/* This file is part of UCESB - a tool for data unpacking and processing.
+ *
+ * Copyright (C) 2016  Haakan T. Johansson  <f96hajo@chalmers.se>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301  USA
+ */
+
+#ifndef __SUBEVENT_MATCH_CACHE_HH__
+#define __SUBEVENT_MATCH_CACHE_HH__
+
+#include "typedef.hh"
+
+#include <string.h>
+
+/* Remember which subevent declaration of the EVENT block a subevent
+ * header (type, subtype, control, subcrate, procid) matched.  The
+ * conditions only depend on the header fields, so the linear search
+ * through all declarations (with its check for multiple matches) only
+ * has to be done the first time a certain kind of subevent is seen.
+ *
+ * Open addressing, the entries are never removed.  If the table gets
+ * full, lookups of new kinds just fail, and the full search is done.
+ *
+ * The tables are not part of the event (which in threaded mode is
+ * allocated anew for each event), but kept per thread (in _wt), or
+ * statically when not threading.  One table each for unpack_event and
+ * unpack_sticky_event.
+ */
+
+#define SUBEVENT_MATCH_CACHE_BITS    6
+#define SUBEVENT_MATCH_CACHE_SIZE    (1 << SUBEVENT_MATCH_CACHE_BITS)
+#define SUBEVENT_MATCH_CACHE_PROBE   8
+
+#define SUBEVENT_MATCH_CACHE_EVENT   0
+#define SUBEVENT_MATCH_CACHE_STICKY  1
+#define SUBEVENT_MATCH_CACHE_KINDS   2
+
+struct subevent_match_cache_item
+{
+  uint64 _key;
+  int    _match_no_1; // match_no + 1, 0 is unused
+};
+
+class subevent_match_cache
+{
+public:
+  subevent_match_cache() { clear(); }
+
+public:
+  subevent_match_cache_item _items[SUBEVENT_MATCH_CACHE_SIZE];
+
+public:
+  void clear()
+  {
+    memset(_items,0,sizeof(_items));
+  }
+
+  static uint32 hash(uint64 key)
+  {
+    return (uint32) ((key * 0x9e3779b97f4a7c15ULL) >>
+		     (64 - SUBEVENT_MATCH_CACHE_BITS));
+  }
+
+  bool find(uint64 key,int &match_no) const
+  {
+    uint32 h = hash(key);
+
+    for (int i = 0; i < SUBEVENT_MATCH_CACHE_PROBE; i++)
+      {
+	const subevent_match_cache_item &item =
+	  _items[(h + i) & (SUBEVENT_MATCH_CACHE_SIZE - 1)];
+
+	if (!item._match_no_1)
+	  return false;
+	if (item._key == key)
+	  {
+	    match_no = item._match_no_1 - 1;
+	    return true;
+	  }
+      }
+    return false;
+  }
+
+  void insert(uint64 key,int match_no)
+  {
+    uint32 h = hash(key);
+
+    for (int i = 0; i < SUBEVENT_MATCH_CACHE_PROBE; i++)
+      {
+	subevent_match_cache_item &item =
+	  _items[(h + i) & (SUBEVENT_MATCH_CACHE_SIZE - 1)];
+
+	if (!item._match_no_1)
+	  {
+	    item._key        = key;
+	    item._match_no_1 = match_no + 1;
+	    return;
+	  }
+      }
+    // Full, just do not remember this one
+  }
+};
+
+#ifndef USE_THREADING
+extern subevent_match_cache _subevent_match_caches[SUBEVENT_MATCH_CACHE_KINDS];
+#endif
+
+#endif//__SUBEVENT_MATCH_CACHE_HH__
@@ -26,6 +26,10 @@
 
 #include "colourtext.hh"
 
+#ifdef USE_THREADING
+#include "worker_thread.hh"
+#endif
+
 /*
  *
  */
@@ -42,6 +46,87 @@
 #include "ridf_event.hh"
 #endif
 
+/* Checks of fixed bits, ranges and word counts in __unpack_checks.
+ *
+ * With __check_deferred, a mismatch is only or:ed into __check_fail,
+ * which is tested once when the structure is done.  A failure then
+ * re-runs the unpacking with immediate checks (from the saved buffer
+ * position, after cleaning the structure), which reports the first
+ * bad item exactly as before.  Before anything else that could
+ * report an error caused by bad data (reading beyond the end,
+ * array indices, substructures), pending failures are flushed.
+ *
+ * Enable with -DUNPACK_DEFERRED_CHECKS=1.  Member dumps and
+ * accounting always check immediately.
+ */
+
+struct unpack_check_deferred_fail { };
+
+#define UNPACK_CHECK_FLUSH {                             \
+  if (__check_deferred && UNLIKELY(__check_fail))        \
+    throw unpack_check_deferred_fail();                  \
+}
+
+#define UNPACK_CHECK_MISMATCH(mismatch) \
+  (__check_deferred ? (__check_fail |= (uint32) (mismatch), false) : \
+   UNLIKELY(mismatch))
+
+#if defined __GNUC__ && __GNUC__ < 3 // 2.95 do not do iso99 variadic macros
+#define UNPACK_CHECK_IMMEDIATE(name,__VA_ARGS__...) {    \
+  uint32 __check_fail = 0;                               \
+  name<__data_src_t,0>(__check_fail,__buffer, ## __VA_ARGS__); \
+}
+#else
+#define UNPACK_CHECK_IMMEDIATE(name,...) {               \
+  uint32 __check_fail = 0;                               \
+  name<__data_src_t,0>(__check_fail,__buffer, ## __VA_ARGS__); \
+}
+#endif
+
+#if UNPACK_DEFERRED_CHECKS
+#if defined __GNUC__ && __GNUC__ < 3 // 2.95 do not do iso99 variadic macros
+#define UNPACK_CHECK_DEFERRED(name,__VA_ARGS__...) {     \
+  uint32 __check_fail = 0;                               \
+  if (__buffer.is_memberdump() || __buffer.is_account()) \
+    name<__data_src_t,0>(__check_fail,__buffer, ## __VA_ARGS__); \
+  else {                                                 \
+    __data_src_t __check_buffer(__buffer);               \
+    try {                                                \
+      name<__data_src_t,1>(__check_fail,__buffer, ## __VA_ARGS__); \
+    } catch (unpack_check_deferred_fail &) {             \
+    }                                                    \
+    if (UNLIKELY(__check_fail)) {                        \
+      __buffer = __check_buffer;                         \
+      __clean();                                         \
+      __check_fail = 0;                                  \
+      name<__data_src_t,0>(__check_fail,__buffer, ## __VA_ARGS__); \
+    }                                                    \
+  }                                                      \
+}
+#else
+#define UNPACK_CHECK_DEFERRED(name,...) {                \
+  uint32 __check_fail = 0;                               \
+  if (__buffer.is_memberdump() || __buffer.is_account()) \
+    name<__data_src_t,0>(__check_fail,__buffer, ## __VA_ARGS__); \
+  else {                                                 \
+    __data_src_t __check_buffer(__buffer);               \
+    try {                                                \
+      name<__data_src_t,1>(__check_fail,__buffer, ## __VA_ARGS__); \
+    } catch (unpack_check_deferred_fail &) {             \
+    }                                                    \
+    if (UNLIKELY(__check_fail)) {                        \
+      __buffer = __check_buffer;                         \
+      __clean();                                         \
+      __check_fail = 0;                                  \
+      name<__data_src_t,0>(__check_fail,__buffer, ## __VA_ARGS__); \
+    }                                                    \
+  }                                                      \
+}
+#endif
+#else
+#define UNPACK_CHECK_DEFERRED UNPACK_CHECK_IMMEDIATE
+#endif
+
 // The UNLIKELY(...) should also be in the PEEK_FROM_BUFFER, but it
 // seems many versions (random) of gcc then comes with spurious warnings
 // about __match_peek possibly being used uninitialized...
@@ -54,6 +139,7 @@
 
 #define READ_FROM_BUFFER(loc,data_type,dest,account_id) {	   \
   if (UNLIKELY(!__buffer.get_##data_type(&dest))) {                \
+    UNPACK_CHECK_FLUSH;                                            \
     ERROR_U_LOC(loc,"Error while reading %s from buffer.",#dest);  \
   }                                                                \
   if (__buffer.is_account()) do_account_##data_type(account_id);   \
@@ -73,6 +159,7 @@
 
 #define READ_FROM_BUFFER_FULL(loc,data_type,dest,dest_full,account_id) { \
   if (UNLIKELY(!__buffer.get_##data_type(&dest_full))) {           \
+    UNPACK_CHECK_FLUSH;                                            \
     ERROR_U_LOC(loc,"Error while reading %s from buffer.",#dest);  \
   }                                                                \
   if (__buffer.is_account()) do_account_##data_type(account_id);   \
@@ -85,14 +172,14 @@
 }
 
 #define CHECK_BITS_EQUAL(loc,value,constraint) {	      \
-  if (UNLIKELY((value) != (constraint))) {		      \
+  if (UNPACK_CHECK_MISMATCH((value) != (constraint))) {       \
     ERROR_U_LOC(loc,"%s should be 0x%" PRIx64 ", is 0x%" PRIx64 ".",#value, \
 		(uint64) (constraint),(uint64) (value));      \
   }							      \
 }
 
 #define CHECK_UNNAMED_BITS_ZERO(loc,value,mask) {                            \
-  if (UNLIKELY(((value) & (mask)) != 0)) {                                   \
+  if (UNPACK_CHECK_MISMATCH(((value) & (mask)) != 0)) {                      \
     ERROR_U_LOC(loc,"Undefined parts of %s (mask 0x%" PRIx64 ") "	     \
 		    "expected to be 0, "				     \
 		    "are 0x%" PRIx64 " (masked 0x%" PRIx64 ").",#value,	     \
@@ -101,7 +188,7 @@
 }
 
 #define CHECK_BITS_RANGE(loc,value,min,max) {                               \
-  if (UNLIKELY((value) < (min) || (value) > (max))) {                       \
+  if (UNPACK_CHECK_MISMATCH((value) < (min) || (value) > (max))) {          \
     ERROR_U_LOC(loc,"%s should be within 0x%" PRIx64 "..0x%" PRIx64 ", "    \
 		    "is 0x%" PRIx64 ".",				    \
 		    #value,(uint64) (min),(uint64) (max),(uint64) (value)); \
@@ -109,7 +196,7 @@
 }
 
 #define CHECK_BITS_RANGE_MAX(loc,value,max) {                             \
-  if (UNLIKELY((value) > (max))) {                                        \
+  if (UNPACK_CHECK_MISMATCH((value) > (max))) {                           \
     ERROR_U_LOC(loc,"%s should be within 0x%" PRIx64 "..0x%" PRIx64 ", "  \
 		    "is 0x%" PRIx64 ".",				  \
 		    #value,(uint64) (0),(uint64) (max),(uint64) (value)); \
@@ -119,7 +206,8 @@
 #define CHECK_WORD_COUNT(loc,value,start,stop,offset,multiplier) { \
   size_t __check_distance =                                        \
     (size_t) (((char*) __mark_##stop) - ((char*) __mark_##start)) + (offset); \
-  if (UNLIKELY(((size_t) (value)) * (multiplier) != __check_distance)) { \
+  if (UNPACK_CHECK_MISMATCH(((size_t) (value)) * (multiplier) !=   \
+			    __check_distance)) {                   \
     ERROR_U_LOC(loc,"%s (= %d) times multiplier %d, is %d, "       \
                     "should be byte count from %s"                 \
                     " to %s + offset %d = %d.",                    \
@@ -130,6 +218,22 @@
   }                                                                \
 }
 
+/* Lists of identical data words: all fixed bits are checked before
+ * the loop, see bulk_check_32().  A parameter that does not fit its
+ * field can never match, then the normal loop reports the error.
+ */
+
+#define UNPACK_LIST_FIXED_PARAM(value,ok,shift,field_mask,param) { \
+  uint64 __list_param = (uint64) (param);                 \
+  if (__list_param & ~(uint64) (field_mask))              \
+    ok = false;                                           \
+  value |= ((uint32) __list_param & (field_mask)) << (shift); \
+}
+
+#define UNPACK_LIST_CHECK_FIXED_32(min,max,mask,value)   \
+  ((uint32) (max) <= (uint32) (min) ||                   \
+   __buffer.check_uint32_all((uint32) (max) - (uint32) (min),(mask),(value)))
+
 #define MATCH_BITS_EQUAL(loc,value,constraint) {      \
   if ((value) != (constraint)) {                      \
     return false;                                     \
@@ -255,6 +359,32 @@
 }
 #endif
 
+/* Count which candidate of a select statement matched, when
+ * accounting (--match-profile), see account_write_match_profile().
+ */
+
+#define MATCH_ACCOUNT(base,match) {                       \
+  if (__buffer.is_account() && (match) > 0)               \
+    _match_account[(base) + (match) - 1]++;               \
+}
+
+/* Gather the (discriminating) bits in mask of the peeked word into a
+ * compact table index.  Fallback is the equivalent shift and mask
+ * expression generated by ucesbgen.  PEXT is slow (microcoded) on
+ * some older AMD CPUs, so only used when BMI2 is enabled by the
+ * compiler flags (-mbmi2 or -march=..., e.g. make UCESB_MARCH=native).
+ * There is no run-time dispatch: it would cost a call per select,
+ * more than the few instructions of the fallback.
+ */
+
+#if defined(__BMI2__) && !defined(UCESB_NO_PEXT)
+#include <immintrin.h>
+#define MATCH_INDEX_GATHER(peek,mask,fallback) \
+  ((uint32) _pext_u32((uint32) (peek),(mask)))
+#else
+#define MATCH_INDEX_GATHER(peek,mask,fallback) (fallback)
+#endif
+
 /*
 #define MATCH_DECL_ARRAY(loc,match,matchindex,matcharray) { \
   match = matcharray[matchindex];                           \
@@ -266,6 +396,7 @@
 
 #if defined __GNUC__ && __GNUC__ < 3 // 2.95 do not do iso99 variadic macros
 #define UNPACK_DECL(loc,decltype,declname,__VA_ARGS__...) { \
+  UNPACK_CHECK_FLUSH;           \
   try {                         \
     (declname).__unpack(__buffer, ## __VA_ARGS__);  \
   } catch (error &e) {          \
@@ -275,6 +406,7 @@
 }
 #else
 #define UNPACK_DECL(loc,decltype,declname,...) { \
+  UNPACK_CHECK_FLUSH;           \
   try {                         \
     (declname).__unpack(__buffer, ## __VA_ARGS__);  \
   } catch (error &e) {          \
@@ -300,6 +432,7 @@
 
 #define UNPACK_CHECK_NO_REVISIT(loc,decltype,declname,visit_array,visit_index) { \
   if (UNLIKELY(visit_array.get_set(visit_index))) {                              \
+    UNPACK_CHECK_FLUSH;                                                          \
     ERROR_U_LOC(loc,"Duplicate, substructure %s %s"                              \
                     " has already been visited.",#decltype,#declname);           \
   }                                                                              \
@@ -313,6 +446,13 @@
 #define VES10_1_control  VES10_1_ITEM(h_control)
 #define VES10_1_subcrate VES10_1_ITEM(h_subcrate)
 #define VES10_1_procid   VES10_1_ITEM(i_procid)
+
+#define SUBEVENT_MATCH_KEY					\
+  (((uint64) VES10_1_type)            |				\
+   ((uint64) VES10_1_subtype  << 16)  |				\
+   ((uint64) VES10_1_control  << 32)  |				\
+   ((uint64) VES10_1_subcrate << 40)  |				\
+   ((uint64) VES10_1_procid   << 48))
 #endif//USE_LMD_INPUT
 
 #ifdef USE_HLD_INPUT
@@ -320,6 +460,8 @@
 
 #define VES10_1_decode_type  VES10_1_ITEM(_deconde._type)
 #define VES10_1_id           VES10_1_ITEM(_id)
+
+#define SUBEVENT_MATCH_KEY   ((uint64) VES10_1_id)
 #endif//USE_HLD_INPUT
 
 #ifdef USE_PAX_INPUT
@@ -337,8 +479,29 @@
 #define VES10_1_fp   VES10_1_ITEM(0x000fc000, 14)
 #define VES10_1_det  VES10_1_ITEM(0x00003f00,  8)
 #define VES10_1_mod  VES10_1_ITEM(0x000000ff,  0)
+
+#define SUBEVENT_MATCH_KEY \
+    ((uint64) ((ridf_subevent_header *) __header)->_id)
 #endif//USE_RIDF_INPUT
 
+// Only the formats with a known subevent header get the lookup cache
+#ifdef SUBEVENT_MATCH_KEY
+#ifdef USE_THREADING
+#define SUBEVENT_MATCH_CACHES \
+  (LIKELY(_wt._subevent_match != NULL) ? \
+   _wt._subevent_match : _wt.alloc_subevent_match())
+#else
+#define SUBEVENT_MATCH_CACHES _subevent_match_caches
+#endif
+#define SUBEVENT_MATCH_CACHE_FIND(match) \
+  SUBEVENT_MATCH_CACHES[__subevent_match_kind].find(SUBEVENT_MATCH_KEY,match)
+#define SUBEVENT_MATCH_CACHE_INSERT(match) \
+  SUBEVENT_MATCH_CACHES[__subevent_match_kind].insert(SUBEVENT_MATCH_KEY,match)
+#else
+#define SUBEVENT_MATCH_CACHE_FIND(match)   false
+#define SUBEVENT_MATCH_CACHE_INSERT(match) do { } while (0)
+#endif
+
 #define UNPACK_SUBEVENT_CHECK_NO_REVISIT(loc,decltype,declname,visit_index) { \
   if (UNLIKELY(__visited.get_set(visit_index))) {                             \
     ERROR_U_LOC(loc,"Duplicate, subevent %s %s "                              \
@@ -29,4 +29,8 @@
 #include "gen/revoke.hh"
 //#include "gen/cleaner.hh"
 
+#ifndef USE_THREADING
+subevent_match_cache _subevent_match_caches[SUBEVENT_MATCH_CACHE_KINDS];
+#endif
+
 
@@ -23,8 +23,11 @@
 #include "config.hh"
 
 #include "file_mmap.hh"
+#include "file_view.hh"
 #include "pipe_buffer.hh"
 #include "tcp_pipe_buffer.hh"
+#include "uring_buffer.hh"
+#include "decompress_buffer.hh"
 
 #include "thread_debug.hh"
 #include "set_thread_name.hh"
@@ -164,6 +167,12 @@ void *decompress_relay_thread(void *info)
 
   drt_info *drt = (drt_info *) info;
 
+#ifdef USE_PTHREAD
+  // Reads the input, so placed like the other reader threads.
+  if (pipe_buffer_base::_reader_thread_init)
+    pipe_buffer_base::_reader_thread_init();
+#endif
+
 #define DRT_BUF_SIZE (64 * 1024) // must be power of 2
 
   size_t page_size = (size_t) sysconf(_SC_PAGESIZE);
@@ -285,18 +294,45 @@ struct decompress_magic_cmd_args_t
   } _magic;
   const char *_cmd;
   const char *_args[3];
+  int         _inproc; // method when decompressing within our process
 } decompress_magic_cmd_args[] = {
-  { { 3, { 'B',  'Z',  'h',  0    } } , "bunzip2", { "-c",NULL } },
-  { { 2, { 0x1f, 0x8b, 0,    0    } } , "gunzip",  { "-c",NULL } },
-  { { 4, { '7',  'z',  0xbc, 0xaf } } , "7za",     { "e","-so",NULL } },
+  { { 3, { 'B',  'Z',  'h',  0    } } , "bunzip2", { "-c",NULL },
+    DECOMPRESS_INPROC_NONE },
+  { { 2, { 0x1f, 0x8b, 0,    0    } } , "gunzip",  { "-c",NULL },
+#ifdef HAVE_ZLIB
+    DECOMPRESS_INPROC_GZIP
+#else
+    DECOMPRESS_INPROC_NONE
+#endif
+  },
+  { { 4, { '7',  'z',  0xbc, 0xaf } } , "7za",     { "e","-so",NULL },
+    DECOMPRESS_INPROC_NONE },
   // FF 4C 5A 4D 41 00 = 0xff"LZMA"0x00
-  { { 4, { 0xff, 'L',  'Z',  'M'  } } , "lzma",    { "-d","-c",NULL } },
-  { { 4, { 0x89, 'L',  'Z',  'O'  } } , "lzop",    { "-d","-c",NULL } },
+  { { 4, { 0xff, 'L',  'Z',  'M'  } } , "lzma",    { "-d","-c",NULL },
+    DECOMPRESS_INPROC_NONE },
+  { { 4, { 0x89, 'L',  'Z',  'O'  } } , "lzop",    { "-d","-c",NULL },
+    DECOMPRESS_INPROC_NONE },
   // FD 37 7a 58 5a 00 = 0xff"7zXZ"0x00
-  { { 4, { 0xfd, '7',  'z',  'X'  } } , "unxz",    { "-d","-c",NULL } },
+  { { 4, { 0xfd, '7',  'z',  'X'  } } , "unxz",    { "-d","-c",NULL },
+#ifdef HAVE_LZMA
+    DECOMPRESS_INPROC_XZ
+#else
+    DECOMPRESS_INPROC_NONE
+#endif
+  },
+  // 28 B5 2F FD = zstd frame
+  { { 4, { 0x28, 0xb5, 0x2f, 0xfd } } , "zstd",    { "-d","-c",NULL },
+    DECOMPRESS_INPROC_NONE },
+  // 04 22 4D 18 = lz4 frame
+  { { 4, { 0x04, 0x22, 0x4d, 0x18 } } , "lz4",     { "-d","-c",NULL },
+    DECOMPRESS_INPROC_NONE },
 };
 
 /* Plan for finding out decompressing engine (if any).  Goal:
+ *
+ * (If the format can be decompressed in-process, none of the below
+ * forking business is done.  We just report the method and return
+ * the stolen magic, which then is fed first to the library.)
  *
  * - If no decrompressor needed - do not destroy the input.
  * - If decompressing from file, let decompressor do the file reading.
@@ -330,6 +366,7 @@ struct decompress_magic_cmd_args_t
 
 void decompress(decompressor **handler,
 		drt_info     **relay_info,
+		int *inproc,
 		int *fd,
 		const char *filename,
 		unsigned char *push_magic,size_t *push_magic_len)
@@ -419,6 +456,15 @@ void decompress(decompressor **handler,
 
       if (memcmp(push_magic,dmca._magic._b,(size_t) dmca._magic._len) == 0)
 	{
+	  if (dmca._inproc != DECOMPRESS_INPROC_NONE &&
+	      !_conf._external_decompress)
+	    {
+	      *inproc = dmca._inproc;
+	      if (!untouched)
+		*push_magic_len = PEEK_MAGIC_BYTES;
+	      return;
+	    }
+
 	  // It seems to be a compressed file,
 
 	  *handler = new decompressor();
@@ -800,22 +846,118 @@ void data_input_source::open(const char *filename
 
   unsigned char push_magic[PEEK_MAGIC_BYTES];
   size_t push_magic_len = 0;
+  int inproc = DECOMPRESS_INPROC_NONE;
 
   // See it it was an compressed file, if so, run the
-  // decompressor as a separate process
+  // decompressor as a separate process (or within our process)
 
-  decompress(&_decompressor,&_relay_info,&fd,decompress_filename,
+  decompress(&_decompressor,&_relay_info,&inproc,&fd,decompress_filename,
 	     push_magic,&push_magic_len);
 
+  if (inproc != DECOMPRESS_INPROC_NONE)
+    {
+      decompress_buffer *db = new decompress_buffer();
+
+      TDBG("attempting in-process decompression %p",db);
+
+#if USE_THREADING
+      db->set_next_file(blocked_next_file,wakeup_next_file);
+#endif
+
+      db->init(fd,inproc,push_magic,push_magic_len,
+	       get_prefetch_size()
+#ifdef USE_PTHREAD
+	       ,block_reader
+#endif
+	       );
+
+      db->set_filename(filename);
+
+      _input._input = db;
+      _input._cur   = 0;
+
+      return;
+    }
+
   // Ok, whatever happened, _fd is still a file-handle to a file that
   // we want to read.  Either it is now pointing to a pipe from a
   // child, or it already from the beginning pointed to a pipe
   // (e.g. mkfifo) or it points to a file.  We'd prefer to read the
   // file using mmap if possible
 
+#if defined(USE_THREADING) && defined(USE_LMD_INPUT)
+  // When the file is to be parsed in ranges by several threads, it
+  // is mapped completely
+
+  if (!_decompressor &&
+      _conf._split_file > 1)
+    {
+      file_view *fv = new file_view();
+
+      TDBG("attempting full mmap %p",fv);
+
+      if (fv->init(fd))
+	{
+	  fv->set_next_file(blocked_next_file,wakeup_next_file);
+	  fv->set_filename(filename);
+
+	  _input._input = fv;
+	  _input._cur   = 0;
+
+	  return;
+	}
+
+      delete fv; // init failure leaves the file descriptor alone
+    }
+#endif
+
+#ifdef HAVE_IO_URING
+  // io_uring reads need file offsets, so only for plain files
+
+  struct stat st;
+
+  if (!_decompressor &&
+      _conf._input_io == INPUT_IO_URING &&
+      fstat(fd,&st) == 0 && S_ISREG(st.st_mode))
+    {
+      uring_buffer *ub = new uring_buffer();
+
+#if USE_THREADING
+      ub->set_next_file(blocked_next_file,wakeup_next_file);
+#endif
+
+      TDBG("attempting io_uring %p",ub);
+
+      if (ub->init(fd,push_magic,push_magic_len,
+		   get_prefetch_size()
+#ifdef USE_PTHREAD
+		   ,block_reader
+#endif
+		   ))
+	{
+	  ub->set_filename(filename);
+
+	  _input._input = ub;
+	  _input._cur   = 0;
+	}
+      else
+	{
+	  static bool warned_no_uring = false;
+
+	  if (!warned_no_uring)
+	    WARNING("io_uring not supported by kernel, "
+		    "using normal file reading.");
+	  warned_no_uring = true;
+
+	  ub->_fd = -1; // do not let it destroy our input file descriptor
+	  delete ub;
+	}
+    }
+#endif
+
   // mmap is not exactly working for pipes, so do not even try that
 
-  if (!_decompressor && !no_mmap)
+  if (!_decompressor && !no_mmap && !_input._input)
     {
       file_mmap *mm = new file_mmap();
 
@@ -135,6 +135,7 @@ public:
 
 void decompress(decompressor **handler,
 		drt_info     **relay_info,
+		int *inproc,
 		int *fd,
 		const char *filename,
 		unsigned char *push_magic,size_t *push_magic_len);
@@ -0,0 +1,524 @@
+/* This file is part of UCESB - a tool for data unpacking and processing.
+ *
+ * Copyright (C) 2016  GSI Helmholtzzentrum fuer Schwerionenforschung GmbH
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301  USA
+ */
+
+#include "decompress_buffer.hh"
+#include "error.hh"
+
+#include <unistd.h>
+#include <stdio.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <limits.h>
+
+// Principle of operation:
+//
+// The reader thread (or read_now() without threads) reads compressed
+// data from the file descriptor into a small staging buffer, and
+// lets the decompression library write its output directly into the
+// free space of the pipe_buffer_base ring.  Towards the consumer,
+// this is just another pipe_buffer.
+//
+// gzip: handled by zlib, including multi-member files (as written by
+// e.g. pigz --independent, or simply concatenated files).  Trailing
+// garbage after a member is ignored with a warning, like gunzip does.
+//
+// xz: handled by liblzma, using its multi-threaded decoder when
+// available (liblzma >= 5.4).  Files with several blocks (xz -T) are
+// then decoded in parallel.  Concatenated streams are also handled.
+//
+// Bad compressed data is reported and treated as end of file.  The
+// error is then repeated at close(), like the exit status of an
+// external decompressor would be.  (But not from the destructor.)
+//
+// zlib counts with uInt, so at most UINT_MAX bytes are given to it
+// at a time.
+
+decompress_buffer::decompress_buffer()
+{
+  _fd = -1;
+  _method = DECOMPRESS_INPROC_NONE;
+
+  _in = NULL;
+  _in_fill = 0;
+  _in_eof = false;
+
+  _decode_done = false;
+  _decode_error = false;
+
+#ifdef USE_PTHREAD
+  _stop = false;
+#endif
+
+#ifdef HAVE_ZLIB
+  _zs_init = false;
+#endif
+#ifdef HAVE_LZMA
+  _ls_init = false;
+  _lzma_threads = 1;
+#endif
+}
+
+decompress_buffer::~decompress_buffer()
+{
+  shutdown();
+
+  if (_decode_error)
+    WARNING("In-process decompression failed (not reported at close).");
+
+  free(_in);
+  _in = NULL;
+}
+
+void decompress_buffer::fill_input(const unsigned char **next_in,
+				   size_t *avail_in)
+{
+  // Only called when the library has consumed all input.
+
+  size_t have = _in_fill;
+
+  _in_fill = 0; // pushed magic only used once
+
+  while (!have && !_in_eof)
+    {
+      ssize_t n = read(_fd,_in,DECOMPRESS_INPUT_SIZE);
+
+      if (n == 0)
+	{
+	  _in_eof = true;
+	  break;
+	}
+
+      if (n == -1)
+	{
+	  if (errno == EINTR)
+	    continue;
+	  perror("read()");
+	  exit(1);
+	}
+
+      have = (size_t) n;
+    }
+
+  *next_in  = _in;
+  *avail_in = have;
+}
+
+#ifdef HAVE_ZLIB
+static uInt clamp_uInt(size_t n)
+{
+  return n > UINT_MAX ? UINT_MAX : (uInt) n;
+}
+#endif
+
+size_t decompress_buffer::decode_gzip(char *dest,size_t space)
+{
+#ifdef HAVE_ZLIB
+  // fill_input() gives at most DECOMPRESS_INPUT_SIZE, so the input
+  // is never clamped.
+  if (space > UINT_MAX)
+    space = UINT_MAX;
+
+  for ( ; ; )
+    {
+      if (!_zs.avail_in && !_in_eof)
+	{
+	  const unsigned char *next_in;
+	  size_t avail_in;
+
+	  fill_input(&next_in,&avail_in);
+
+	  _zs.next_in  = (Bytef *) next_in;
+	  _zs.avail_in = clamp_uInt(avail_in);
+	}
+
+      _zs.next_out  = (Bytef *) dest;
+      _zs.avail_out = clamp_uInt(space);
+
+      int ret = inflate(&_zs,Z_NO_FLUSH);
+
+      size_t produced = space - _zs.avail_out;
+
+      if (ret == Z_STREAM_END)
+	{
+	  // End of one member.  There may be another one.
+
+	  if (!_zs.avail_in && !_in_eof)
+	    {
+	      const unsigned char *next_in;
+	      size_t avail_in;
+
+	      fill_input(&next_in,&avail_in);
+
+	      _zs.next_in  = (Bytef *) next_in;
+	      _zs.avail_in = clamp_uInt(avail_in);
+	    }
+
+	  if (!_zs.avail_in)
+	    _decode_done = true;
+	  else if (_zs.next_in[0] != 0x1f)
+	    {
+	      WARNING("Decompress (gzip): trailing garbage ignored.");
+	      _decode_done = true;
+	    }
+	  else
+	    inflateReset(&_zs);
+	}
+      else if (ret == Z_BUF_ERROR)
+	{
+	  // No progress possible.  Fine if we got more input.
+	  if (_in_eof && !_zs.avail_in)
+	    {
+	      WARNING("Decompress (gzip): unexpected end of file.");
+	      _decode_error = true;
+	      _decode_done = true;
+	    }
+	}
+      else if (ret != Z_OK)
+	{
+	  WARNING("Decompress (gzip): %s.",
+		  _zs.msg ? _zs.msg : "corrupt data");
+	  _decode_error = true;
+	  _decode_done = true;
+	}
+
+      if (produced || _decode_done)
+	return produced;
+    }
+#else
+  UNUSED(dest);
+  UNUSED(space);
+  assert(false);
+  return 0;
+#endif
+}
+
+size_t decompress_buffer::decode_xz(char *dest,size_t space)
+{
+#ifdef HAVE_LZMA
+  for ( ; ; )
+    {
+      if (!_ls.avail_in && !_in_eof)
+	fill_input(&_ls.next_in,&_ls.avail_in);
+
+      _ls.next_out  = (uint8_t *) dest;
+      _ls.avail_out = space;
+
+      lzma_ret ret = lzma_code(&_ls,_in_eof ? LZMA_FINISH : LZMA_RUN);
+
+      size_t produced = space - _ls.avail_out;
+
+      if (ret == LZMA_STREAM_END)
+	_decode_done = true;
+      else if (ret == LZMA_BUF_ERROR)
+	{
+	  WARNING("Decompress (xz): unexpected end of file.");
+	  _decode_error = true;
+	  _decode_done = true;
+	}
+      else if (ret != LZMA_OK)
+	{
+	  WARNING("Decompress (xz): error %d.",(int) ret);
+	  _decode_error = true;
+	  _decode_done = true;
+	}
+
+      if (produced || _decode_done)
+	return produced;
+    }
+#else
+  UNUSED(dest);
+  UNUSED(space);
+  assert(false);
+  return 0;
+#endif
+}
+
+size_t decompress_buffer::decode(char *dest,size_t space)
+{
+  if (_method == DECOMPRESS_INPROC_GZIP)
+    return decode_gzip(dest,space);
+  return decode_xz(dest,space);
+}
+
+#ifdef USE_PTHREAD
+void *decompress_buffer::reader()
+{
+  sigset_t sigmask;
+
+  sigemptyset(&sigmask);
+  sigaddset(&sigmask,SIGINT);
+
+  pthread_sigmask(SIG_BLOCK,&sigmask,NULL);
+
+  while (!_decode_done && !_stop)
+    {
+      assert((ssize_t) (_avail - _done) >= 0);
+
+      if (_avail - _done >= _size)
+	{
+	  // Buffer is FULL.  Same procedure (and race avoidance) as
+	  // in pipe_buffer::reader().
+
+	  MFENCE;
+
+	  _wakeup_done = _avail - _size + (_size >> 4);
+	  MFENCE;
+	  _need_reader_wakeup = &_block;
+
+	  MFENCE;
+
+	  if (_avail - _done >= _size && !_stop)
+	    _block.block();
+	  continue;
+	}
+
+      size_t space   = _size - (_avail - _done);
+      size_t offset  = _avail & (_size - 1);
+      size_t segment = _size - offset;
+
+      if (segment > space)
+	segment = space;
+
+      size_t n = decode(_buffer + offset,segment);
+
+      _avail += n;
+
+      if (_need_consumer_wakeup &&
+	  ((ssize_t) (_avail - _wakeup_avail)) >= 0)
+	{
+	  // The consumer was waiting for us.
+
+	  const thread_block *blocked =
+	    (const thread_block *) _need_consumer_wakeup;
+	  _need_consumer_wakeup = NULL;
+	  SFENCE;
+	  blocked->wakeup();
+	}
+    }
+
+  if (_stop)
+    return NULL; // closed before the end
+
+#ifdef USE_THREADING
+  request_next_file();
+#endif
+
+  _reached_eof = true;
+
+  MFENCE;
+
+  if (_need_consumer_wakeup)
+    {
+      // The consumer was waiting for us.  Wake him up to tell him
+      // that data will never be available.
+
+      const thread_block *blocked =
+	(const thread_block *) _need_consumer_wakeup;
+      _need_consumer_wakeup = NULL;
+      SFENCE;
+      blocked->wakeup();
+    }
+
+  return NULL;
+}
+#else//!USE_PTHREAD
+int decompress_buffer::read_now(off_t end)
+{
+  // We have no reader thread.  Decompress until the requested range
+  // is available.
+
+  while (((ssize_t) _avail - (ssize_t) end) < 0)
+    {
+      if (_reached_eof)
+	return 0; // data requested is NOT available
+
+      if (_decode_done)
+	{
+	  _reached_eof = true;
+	  continue;
+	}
+
+      size_t space   = _size - (_avail - _done);
+      size_t offset  = _avail & (_size - 1);
+      size_t segment = _size - offset;
+
+      if (UNLIKELY(space <= 0))
+	ERROR("pipe_buffer too small");
+
+      if (segment > space)
+	segment = space;
+
+      _avail += decode(_buffer + offset,segment);
+    }
+  return 1;
+}
+#endif//!USE_PTHREAD
+
+void decompress_buffer::init(int fd,int method,
+			     unsigned char *push_magic,size_t push_magic_len,
+			     size_t bufsize
+#ifdef USE_PTHREAD
+			     ,thread_block *block_reader
+#endif
+			     )
+{
+  _fd = fd;
+  _method = method;
+
+  _in = (unsigned char *) malloc(DECOMPRESS_INPUT_SIZE);
+
+  if (!_in)
+    ERROR("Memory allocation failure.");
+
+  // Magic bytes that were stolen from the input are compressed
+  // data, so they go in front of the library input, not into the
+  // output buffer.
+
+  assert(push_magic_len <= DECOMPRESS_INPUT_SIZE);
+  memcpy(_in,push_magic,push_magic_len);
+  _in_fill = push_magic_len;
+
+  const char *what = "";
+
+  switch (method)
+    {
+#ifdef HAVE_ZLIB
+    case DECOMPRESS_INPROC_GZIP:
+      memset(&_zs,0,sizeof(_zs));
+      // 15 + 32: maximum window, detect gzip or zlib header
+      if (inflateInit2(&_zs,15 + 32) != Z_OK)
+	ERROR("Failed to initialise zlib.");
+      _zs_init = true;
+      what = "gzip";
+      break;
+#endif
+#ifdef HAVE_LZMA
+    case DECOMPRESS_INPROC_XZ:
+      {
+	lzma_stream ls_init = LZMA_STREAM_INIT;
+	lzma_ret ret;
+
+	_ls = ls_init;
+
+#if LZMA_VERSION >= UINT32_C(50040002) // 5.4.0 stable
+	lzma_mt mt;
+
+	memset(&mt,0,sizeof(mt));
+
+	_lzma_threads = lzma_cputhreads();
+	if (!_lzma_threads)
+	  _lzma_threads = 1;
+
+	mt.flags   = LZMA_CONCATENATED;
+	mt.threads = _lzma_threads;
+	mt.timeout = 0;
+	// Do not let huge blocks eat the machine, decode
+	// single-threaded instead.
+	mt.memlimit_threading = lzma_physmem() / 4;
+	mt.memlimit_stop      = UINT64_MAX;
+
+	ret = lzma_stream_decoder_mt(&_ls,&mt);
+#else
+	ret = lzma_stream_decoder(&_ls,UINT64_MAX,LZMA_CONCATENATED);
+#endif
+	if (ret != LZMA_OK)
+	  ERROR("Failed to initialise liblzma (%d).",(int) ret);
+	_ls_init = true;
+	what = "xz";
+      }
+      break;
+#endif
+    default:
+      assert(false);
+    }
+
+#ifdef HAVE_LZMA
+  if (method == DECOMPRESS_INPROC_XZ && _lzma_threads > 1)
+    INFO(0,"Decompressing input in-process (%s, %d threads)...",
+	 what,(int) _lzma_threads);
+  else
+#endif
+    INFO(0,"Decompressing input in-process (%s)...",what);
+
+  pipe_buffer_base::init(NULL,0,bufsize
+#ifdef USE_PTHREAD
+			 ,block_reader,false
+#endif
+			 );
+
+#ifdef USE_PTHREAD
+  spawn_reader("INFLT");
+#endif
+}
+
+// Stop the reader and release the libraries and file.  Does not
+// throw, since also used by the destructor.
+
+void decompress_buffer::shutdown()
+{
+#ifdef USE_PTHREAD
+  if (_active)
+    {
+      _stop = true;
+      MFENCE;
+      _block.wakeup();
+
+      if (pthread_join(_thread,NULL) != 0)
+	{
+	  perror("pthread_join()");
+	  exit(1);
+	}
+      _active = false;
+    }
+#endif
+
+#ifdef HAVE_ZLIB
+  if (_zs_init)
+    inflateEnd(&_zs);
+  _zs_init = false;
+#endif
+#ifdef HAVE_LZMA
+  if (_ls_init)
+    lzma_end(&_ls);
+  _ls_init = false;
+#endif
+
+  if (_fd != -1 &&
+      ::close(_fd) == -1)
+    {
+      perror("close()");
+      exit(1);
+    }
+  _fd = -1;
+}
+
+void decompress_buffer::close()
+{
+  shutdown();
+
+  if (_decode_error)
+    {
+      _decode_error = false;
+      ERROR("In-process decompression failed.  "
+	    "(See error messages on lines above.)");
+    }
+}
@@ -0,0 +1,106 @@
+/* This file is part of UCESB - a tool for data unpacking and processing.
+ *
+ * Copyright (C) 2016  GSI Helmholtzzentrum fuer Schwerionenforschung GmbH
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301  USA
+ */
+
+#ifndef __DECOMPRESS_BUFFER_HH__
+#define __DECOMPRESS_BUFFER_HH__
+
+#include "pipe_buffer.hh"
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_LZMA
+#include <lzma.h>
+#endif
+
+#define DECOMPRESS_INPROC_NONE  0
+#define DECOMPRESS_INPROC_GZIP  1
+#define DECOMPRESS_INPROC_XZ    2
+
+#define DECOMPRESS_INPUT_SIZE   0x40000 // 256 kB of compressed data
+
+// Decompress the input file within our own process, writing directly
+// into the pipe_buffer_base ring.  Saves the extra process and the
+// pipe copy of the external decompressors.
+
+class decompress_buffer
+  : public pipe_buffer_base
+{
+public:
+  decompress_buffer();
+  virtual ~decompress_buffer();
+
+public:
+  int _fd;
+  int _method;
+
+protected:
+  unsigned char *_in;
+  size_t         _in_fill; // (pushed magic) bytes already in _in
+  bool           _in_eof;
+
+  bool           _decode_done;
+  bool           _decode_error;
+
+#ifdef USE_PTHREAD
+  // Set by close() to make the reader thread return.  It is not
+  // cancelled, since it may be inside the (threaded) decoder library.
+  volatile bool  _stop;
+#endif
+
+#ifdef HAVE_ZLIB
+  z_stream       _zs;
+  bool           _zs_init;
+#endif
+#ifdef HAVE_LZMA
+  lzma_stream    _ls;
+  bool           _ls_init;
+  uint32_t       _lzma_threads;
+#endif
+
+protected:
+  void fill_input(const unsigned char **next_in,size_t *avail_in);
+  size_t decode(char *dest,size_t space);
+  size_t decode_gzip(char *dest,size_t space);
+  size_t decode_xz(char *dest,size_t space);
+
+  void shutdown();
+
+#ifdef USE_PTHREAD
+public:
+  virtual void *reader();
+#else
+public:
+  virtual int read_now(off_t end);
+#endif
+
+public:
+  void init(int fd,int method,
+	    unsigned char *push_magic,size_t push_magic_len,
+	    size_t bufsize
+#ifdef USE_PTHREAD
+	    ,thread_block *block_reader
+#endif
+	    );
+  virtual void close();
+
+};
+
+#endif//__DECOMPRESS_BUFFER_HH__
@@ -226,7 +226,12 @@ int file_mmap::map_range(off_t start,off_t end,buf_chunk chunks[2])
       size_t length;
       off_t offset;
 
-      offset = LAST != &_ends ? LAST->_end : (start & (off_t) _page_mask);
+      // Continue after the last mapping, unless data beyond that
+      // is wanted (seek, see lmd_source::seek_buffer)
+
+      offset = start & (off_t) _page_mask;
+      if (LAST != &_ends && LAST->_end >= offset)
+	offset = LAST->_end;
       length = MMAP_SIZE;
 
       // Figure out how long the file is.
@@ -241,7 +246,7 @@ int file_mmap::map_range(off_t start,off_t end,buf_chunk chunks[2])
       /*
       printf ("stat_buf.st_size: %d\n",(int) stat_buf.st_size);
       */
-      if (!S_ISREG(stat_buf.st_mode) ||
+      if (!S_ISREG(stat_buf.st_mode) &&
 	  !S_ISCHR(stat_buf.st_mode))
 	return 0; // Do not attempt mmap'ing
 
@@ -96,6 +96,8 @@ public:
   virtual size_t buffer_size();
   virtual size_t max_item_length();
 
+  virtual bool seekable() { return true; }
+
   void consistency_check();
 };
 
@@ -0,0 +1,135 @@
+/* This file is part of UCESB - a tool for data unpacking and processing.
+ *
+ * Copyright (C) 2016  Haakan T. Johansson  <f96hajo@chalmers.se>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301  USA
+ */
+
+#include "file_view.hh"
+#include "error.hh"
+
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+file_view::file_view()
+{
+  _fd   = -1;
+  _base = NULL;
+  _size = 0;
+}
+
+file_view::~file_view()
+{
+  close();
+}
+
+bool file_view::init(int fd)
+{
+  struct stat stat_buf;
+
+  if (fstat(fd,&stat_buf))
+    {
+      perror("stat");
+      ERROR("Error stat()ing file.");
+    }
+
+  if (!S_ISREG(stat_buf.st_mode) ||
+      stat_buf.st_size == 0)
+    return false;
+
+  char *base = (char *) mmap(0,(size_t) stat_buf.st_size,
+			     PROT_READ,MAP_PRIVATE,
+			     fd,0);
+
+  if (base == MAP_FAILED)
+    {
+      perror("mmap");
+      return false;
+    }
+
+  // The ranges are each read sequentially, but there are several of
+  // them at once, so do not ask for MADV_SEQUENTIAL.
+
+  madvise(base,(size_t) stat_buf.st_size,MADV_WILLNEED);
+
+  _fd   = fd;
+  _base = base;
+  _size = stat_buf.st_size;
+
+  sig_register_mmap(&_mmap_info, _base, (size_t) _size, _fd, 0);
+
+  return true;
+}
+
+void file_view::close()
+{
+  if (_base)
+    {
+      sig_unregister_mmap(&_mmap_info, _base, (size_t) _size);
+
+      if (munmap(_base,(size_t) _size))
+	{
+	  ERROR("munmap() failure");
+	}
+      _base = NULL;
+    }
+
+  if (_fd != -1)
+    {
+      if (::close(_fd) == -1)
+	perror("close");
+    }
+  _fd = -1;
+}
+
+int file_view::map_range(off_t start,off_t end,buf_chunk chunks[2])
+{
+  assert(end >= start);
+
+  // Several readers may hit the end, so requesting the next file is
+  // left to the event reader, when it is done with this one.
+
+  if (end > _size)
+    return 0;
+
+  chunks[0]._ptr    = _base + start;
+  chunks[0]._length = (size_t) (end - start);
+
+  return 1;
+}
+
+void file_view::release_to(off_t end)
+{
+  // Everything stays mapped until close.
+  UNUSED(end);
+}
+
+#ifdef USE_THREADING
+void file_view::arrange_release_to(off_t end)
+{
+  UNUSED(end);
+}
+#endif
+
+size_t file_view::buffer_size()
+{
+  return (size_t) _size;
+}
+
+size_t file_view::max_item_length()
+{
+  return (size_t) _size;
+}
@@ -0,0 +1,70 @@
+/* This file is part of UCESB - a tool for data unpacking and processing.
+ *
+ * Copyright (C) 2016  Haakan T. Johansson  <f96hajo@chalmers.se>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301  USA
+ */
+
+#ifndef __FILE_VIEW_HH__
+#define __FILE_VIEW_HH__
+
+#include "sig_mmap.hh"
+
+#include "input_buffer.hh"
+
+// The entire file mapped at once (read-only).  Used when several
+// threads parse different byte ranges of the same file (see
+// range_reader), so any part is available to anyone at any time.
+// Nothing is released before the file is closed, the pages are clean
+// and belong to the page cache, so the kernel may drop them anyhow.
+
+class file_view
+  : public input_buffer
+{
+public:
+  file_view();
+  virtual ~file_view();
+
+public:
+  int _fd;
+
+public:
+  char  *_base;
+  off_t  _size;
+
+  sig_mmap_info _mmap_info;
+
+public:
+  bool init(int fd);
+  virtual void close();
+
+public:
+  virtual int map_range(off_t start,off_t end,buf_chunk chunks[2]);
+  virtual void release_to(off_t end);
+
+#ifdef USE_THREADING
+  virtual void arrange_release_to(off_t end);
+#endif
+
+public:
+  virtual size_t buffer_size();
+  virtual size_t max_item_length();
+
+  virtual bool seekable() { return true; }
+
+};
+
+#endif//__FILE_VIEW_HH__
@@ -0,0 +1,9 @@
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+int main()
+{
+  int a = 0;
+  return (int) syscall(SYS_futex,&a,FUTEX_WAKE_PRIVATE,1,NULL,NULL,0);
+}
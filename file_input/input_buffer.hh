@@ -363,6 +363,11 @@ public:
   virtual size_t buffer_size() = 0;
   virtual size_t max_item_length() = 0;
 
+public:
+  // Can the first range after opening be anywhere in the file (and
+  // not only just after the previous one)?
+  virtual bool seekable() { return false; }
+
 public:
   bool read_range(void *dest,off_t start,size_t length);
 
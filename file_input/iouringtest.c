@@ -0,0 +1,10 @@
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+int main()
+{
+  struct io_uring_params p;
+  syscall(__NR_io_uring_setup,1,&p);
+  return IORING_OP_READ_FIXED + IORING_REGISTER_EVENTFD;
+}
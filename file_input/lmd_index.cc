@@ -0,0 +1,247 @@
+/* This file is part of UCESB - a tool for data unpacking and processing.
+ *
+ * Copyright (C) 2016  Haakan T. Johansson  <f96hajo@chalmers.se>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301  USA
+ */
+
+#include "lmd_index.hh"
+
+#include "error.hh"
+
+#include <sys/stat.h>
+#include <unistd.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+lmd_index::lmd_index()
+{
+  _flags = LMD_INDEX_EVENTNO_SORTED;
+  _first_sticky = LMD_INDEX_NO_STICKY;
+
+  _last_buffer = -1;
+  _events = 0;
+}
+
+// Called for each event (in order) from lmd_source::get_event.
+
+void lmd_index::add_event(off_t buffer_offset,
+			  bool is_10_1,bool is_sticky,uint32_t event_no)
+{
+  if (is_sticky &&
+      _first_sticky == LMD_INDEX_NO_STICKY)
+    _first_sticky = _events;
+
+  if (buffer_offset != _last_buffer)
+    {
+      _last_buffer = buffer_offset;
+
+      // Sticky events carry no event number, such buffers are not
+      // used as seek points.
+      if (is_10_1)
+	{
+	  lmd_index_entry entry;
+
+	  entry._offset   = (uint64_t) buffer_offset;
+	  entry._events   = _events;
+	  entry._event_no = event_no;
+	  entry._pad      = 0;
+
+	  if (!_entries.empty() &&
+	      event_no <= _entries.back()._event_no)
+	    _flags &= ~LMD_INDEX_EVENTNO_SORTED;
+
+	  _entries.push_back(entry);
+	}
+    }
+
+  _events++;
+}
+
+char *lmd_index_filename(const char *filename)
+{
+  size_t len = strlen(filename);
+
+  char *idx_name = (char *) malloc(len + strlen(LMD_INDEX_SUFFIX) + 1);
+
+  if (!idx_name)
+    ERROR("Memory allocation failure!");
+
+  strcpy(idx_name,filename);
+  strcpy(idx_name + len,LMD_INDEX_SUFFIX);
+
+  return idx_name;
+}
+
+// The index is only trusted if the data file still has the size and
+// modification time noted when it was made.
+
+bool lmd_index::read(const char *filename)
+{
+  struct stat st;
+
+  if (stat(filename,&st) != 0 ||
+      !S_ISREG(st.st_mode))
+    return false;
+
+  char *idx_name = lmd_index_filename(filename);
+
+  FILE *fid = fopen(idx_name,"rb");
+
+  if (!fid)
+    {
+      free(idx_name);
+      return false;
+    }
+
+  lmd_index_header header;
+  bool ok = false;
+
+  if (fread(&header,sizeof(header),1,fid) != 1)
+    WARNING("Index file '%s' too short.",idx_name);
+  else if (header._magic != LMD_INDEX_MAGIC ||
+	   header._version != LMD_INDEX_VERSION)
+    WARNING("Index file '%s' has bad magic or version.",idx_name);
+  else if (header._file_size != (uint64_t) st.st_size ||
+	   header._file_mtime != (uint64_t) st.st_mtime)
+    WARNING("Index file '%s' is stale (file size or time changed), "
+	    "not used.",idx_name);
+  else
+    {
+      _entries.resize(header._entries);
+      _flags = header._flags;
+      _first_sticky = header._first_sticky;
+
+      if (header._entries &&
+	  fread(&_entries[0],sizeof(lmd_index_entry),header._entries,fid) !=
+	  header._entries)
+	{
+	  WARNING("Index file '%s' truncated.",idx_name);
+	  _entries.clear();
+	}
+      else
+	ok = true;
+    }
+
+  fclose(fid);
+  free(idx_name);
+
+  return ok;
+}
+
+bool lmd_index::write(const char *filename)
+{
+  struct stat st;
+
+  if (stat(filename,&st) != 0)
+    {
+      perror("stat");
+      return false;
+    }
+
+  char *idx_name = lmd_index_filename(filename);
+
+  FILE *fid = fopen(idx_name,"wb");
+
+  if (!fid)
+    {
+      perror("fopen");
+      WARNING("Failed to open index file '%s' for writing.",idx_name);
+      free(idx_name);
+      return false;
+    }
+
+  lmd_index_header header;
+
+  memset(&header,0,sizeof(header));
+
+  header._magic      = LMD_INDEX_MAGIC;
+  header._version    = LMD_INDEX_VERSION;
+  header._file_size  = (uint64_t) st.st_size;
+  header._file_mtime = (uint64_t) st.st_mtime;
+  header._entries    = (uint32_t) _entries.size();
+  header._flags      = _flags;
+  header._first_sticky = _first_sticky;
+
+  bool ok =
+    fwrite(&header,sizeof(header),1,fid) == 1 &&
+    (_entries.empty() ||
+     fwrite(&_entries[0],sizeof(lmd_index_entry),_entries.size(),fid) ==
+     _entries.size());
+
+  if (fclose(fid) != 0)
+    ok = false;
+
+  if (!ok)
+    {
+      perror("fwrite");
+      WARNING("Failed to write index file '%s'.",idx_name);
+      unlink(idx_name);
+    }
+  else
+    INFO(0,"Wrote index '%s' (%zd entries, %" PRIu64 " events).",
+	 idx_name,_entries.size(),_events);
+
+  free(idx_name);
+
+  return ok;
+}
+
+// Find the last entry with at most the given number of events
+// before it.  NULL if none.
+
+const lmd_index_entry *lmd_index::find_events(uint64_t events) const
+{
+  size_t lo = 0, hi = _entries.size();
+
+  while (lo < hi)
+    {
+      size_t mid = lo + (hi - lo) / 2;
+
+      if (_entries[mid]._events <= events)
+	lo = mid + 1;
+      else
+	hi = mid;
+    }
+
+  return lo ? &_entries[lo - 1] : NULL;
+}
+
+// Find the last entry whose first event number is not after the
+// wanted one.  Only possible when the numbers are sorted.
+
+const lmd_index_entry *lmd_index::find_event_no(uint32_t event_no) const
+{
+  if (!(_flags & LMD_INDEX_EVENTNO_SORTED))
+    return NULL;
+
+  size_t lo = 0, hi = _entries.size();
+
+  while (lo < hi)
+    {
+      size_t mid = lo + (hi - lo) / 2;
+
+      if (_entries[mid]._event_no <= event_no)
+	lo = mid + 1;
+      else
+	hi = mid;
+    }
+
+  return lo ? &_entries[lo - 1] : NULL;
+}
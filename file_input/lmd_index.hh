@@ -0,0 +1,101 @@
+/* This file is part of UCESB - a tool for data unpacking and processing.
+ *
+ * Copyright (C) 2016  Haakan T. Johansson  <f96hajo@chalmers.se>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301  USA
+ */
+
+#ifndef __LMD_INDEX_HH__
+#define __LMD_INDEX_HH__
+
+#include "typedef.hh"
+
+#include <sys/types.h>
+#include <stdint.h>
+
+#include <vector>
+
+// Sidecar index of an LMD file, stored as FILE.idx next to it.  There
+// is one entry per buffer in which a (10/1) event starts, telling
+// where the buffer is, and which event is the first to start in it.
+// With this, --skip-events and --first-event can go straight to (the
+// buffer of) the wanted event instead of reading all the ones before.
+//
+// Sticky events are not replayed when seeking.  --first-event thus
+// only seeks up to the first sticky event of the file, after which
+// the events are read as without index (and the sticky events are
+// handled).  --skip-events drops skipped sticky events also without
+// index, so it seeks all the way.
+
+#define LMD_INDEX_MAGIC          0x58444955 // 'UIDX' (little endian)
+#define LMD_INDEX_VERSION        2
+#define LMD_INDEX_SUFFIX         ".idx"
+
+#define LMD_INDEX_EVENTNO_SORTED 0x0001 // event numbers are increasing
+
+#define LMD_INDEX_NO_STICKY      ((uint64_t) -1)
+
+struct lmd_index_header
+{
+  uint32_t _magic;
+  uint32_t _version;
+  uint64_t _file_size;  // of the LMD file, to detect a stale index
+  uint64_t _file_mtime;
+  uint32_t _entries;
+  uint32_t _flags;
+  uint64_t _first_sticky; // events before the first sticky event
+};
+
+struct lmd_index_entry
+{
+  uint64_t _offset;     // of the buffer (header) in the file
+  uint64_t _events;     // number of events in the file before
+  uint32_t _event_no;   // l_count of the first event starting in buffer
+  uint32_t _pad;        // written as 0
+};
+
+class lmd_index
+{
+public:
+  lmd_index();
+
+public:
+  std::vector<lmd_index_entry> _entries;
+  uint32_t _flags;
+  uint64_t _first_sticky; // LMD_INDEX_NO_STICKY if none
+
+public:
+  // While building
+  off_t    _last_buffer;
+  uint64_t _events;
+
+public:
+  void add_event(off_t buffer_offset,
+		 bool is_10_1,bool is_sticky,uint32_t event_no);
+
+public:
+  bool read(const char *filename);
+  bool write(const char *filename);
+
+public:
+  const lmd_index_entry *find_events(uint64_t events) const;
+  const lmd_index_entry *find_event_no(uint32_t event_no) const;
+
+};
+
+char *lmd_index_filename(const char *filename);
+
+#endif//__LMD_INDEX_HH__
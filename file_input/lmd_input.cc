@@ -115,6 +115,61 @@ void lmd_source::new_file()
   _close_is_error = false;
 
   _file_header_seen = false;
+
+  _range_end = 0;
+  _range_skip_fragment = false;
+
+  _index_build = NULL;
+}
+
+// Continue reading from the buffer at offset (from an index).  Only
+// possible before anything has been read from the input (see
+// input_buffer::seekable()).  Any fragment at the start of the buffer
+// belongs to an event we are not interested in.
+
+void lmd_source::seek_buffer(off_t offset)
+{
+  assert(_input._input->seekable());
+
+  _input._cur = offset;
+
+  _expect_file_header = false;
+  _range_skip_fragment = true;
+  _last_buffer_no = 0;
+
+  _chunk_cur = _chunk_end = NULL;
+  _events_left = 0;
+}
+
+void lmd_source::index_event(lmd_event *event,
+			     off_t buffer_start)
+{
+  bool is_10_1 = false;
+  bool is_sticky =
+    event->_header._header.i_type    == LMD_EVENT_STICKY_TYPE &&
+    event->_header._header.i_subtype == LMD_EVENT_STICKY_SUBTYPE;
+  lmd_event_info_host info;
+
+  info.l_count = 0;
+
+  if (event->_header._header.i_type    == LMD_EVENT_10_1_TYPE &&
+      event->_header._header.i_subtype == LMD_EVENT_10_1_SUBTYPE)
+    {
+      buf_chunk *chunk_cur = event->_chunks_ptr;
+      size_t offset_cur = 0;
+
+      if (get_range_many((char *) &info,
+			 chunk_cur,offset_cur,event->_chunk_end,
+			 sizeof(info)))
+	{
+	  if (event->_swapping)
+	    byteswap ((uint32*) &info,sizeof(info));
+	  is_10_1 = true;
+	}
+    }
+
+  _index_build->add_event(buffer_start,
+			  is_10_1,is_sticky,info.l_count);
 }
 
 #define min(a,b) ((a)<(b)?(a):(b))
@@ -647,7 +702,8 @@ bool lmd_source::read_record(bool expect_fragment)
 	}
       else
 	{
-	  WARNING("Buffer header had unexpected fragment at start.");
+	  if (!_range_skip_fragment)
+	    WARNING("Buffer header had unexpected fragment at start.");
 
 	  // TODO:
 
@@ -685,6 +741,8 @@ bool lmd_source::read_record(bool expect_fragment)
 	  _events_left--; // we've just eaten a fragment (yummy!)
 	}
     }
+
+  _range_skip_fragment = false;
   /*
   printf("buf_header.l_dlen      = %08x\n",_buffer_header.l_dlen         );
   printf("buf_header.i_subtype   =     %04x\n",(ushort) _buffer_header.i_subtype );
@@ -789,6 +847,14 @@ lmd_event *lmd_source::get_event()
 
   for ( ; ; )
     {
+      // Events in buffers that start beyond the range belong to the
+      // following range.  (_prev_record_release_to is where the
+      // current buffer started, _input._cur where the next one does.)
+      if (UNLIKELY(_range_end) &&
+	  (_chunk_cur == _chunk_end ?
+	   _input._cur : _prev_record_release_to) >= _range_end)
+	return NULL;
+
       //printf ("get record?...\n");
       if (_chunk_cur == _chunk_end)
 	{
@@ -862,6 +928,9 @@ lmd_event *lmd_source::get_event()
       size_t event_size =
 	(size_t) EVENT_DATA_LENGTH_FROM_DLEN(event_header->_header.l_dlen);
       dest->_swapping = _swapping;
+
+      // Where the event starts, for the index
+      off_t  event_buffer_start = _prev_record_release_to;
       dest->_status |= _first_buf_status;
 
       // Now, we'd like to get the data, but it may be larger than the
@@ -899,6 +968,9 @@ lmd_event *lmd_source::get_event()
 	  //for (buf_chunk *p = dest->_chunks; p < dest->_chunk_end; p++)
 	  //  INFO(0,"got(1): chunk(%8p) (%8p,%d)",p,p->_ptr,p->_length);
 
+	  if (UNLIKELY(_index_build != NULL))
+	    index_event(dest,event_buffer_start);
+
 	  return dest;
 	}
 
@@ -1044,6 +1116,9 @@ lmd_event *lmd_source::get_event()
       //for (buf_chunk *p = dest->_chunks; p < dest->_chunk_end; p++)
       //	INFO(0,"got(m): chunk(%8p) (%8p,%d)",p,p->_ptr,p->_length);
 
+      if (UNLIKELY(_index_build != NULL))
+	index_event(dest,event_buffer_start);
+
       return dest;
     }
 
@@ -32,6 +32,7 @@
 #ifdef USE_LMD_INPUT
 
 #include "lmd_event.hh"
+#include "lmd_index.hh"
 
 #define LMD_INPUT_TYPE_STREAM  (INPUT_TYPE_LAST+1)
 #define LMD_INPUT_TYPE_TRANS   (INPUT_TYPE_LAST+2)
@@ -191,6 +192,16 @@ public:
 
   int                _first_buf_status;
 
+  // When only a byte range of the file is handled (see range_reader),
+  // no new events are started from buffers at or beyond _range_end
+  // (0 = no limit), and a fragment at the start of the first buffer
+  // belongs to the previous range.
+  off_t              _range_end;
+  bool               _range_skip_fragment;
+
+  // When building an index of the file (--build-index)
+  lmd_index         *_index_build;
+
 public:
   buf_chunk  _chunks[2];
   buf_chunk *_chunk_cur;
@@ -213,6 +224,12 @@ public:
   bool read_record(bool expect_fragment = false);
   bool skip_record();
 
+public:
+  void seek_buffer(off_t offset);
+
+protected:
+  void index_event(lmd_event *event,off_t buffer_start);
+
 };
 
 #endif//USE_LMD_INPUT
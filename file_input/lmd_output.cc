@@ -1340,7 +1340,8 @@ void lmd_event_out::copy_all(const lmd_event *event,
 void lmd_event_out::copy(const lmd_event *event,
 			 const select_event *select,
 			 bool combine_event,
-			 bool emit_header)
+			 bool emit_header,
+			 bool refer_data)
 {
   // Copy only subevents requested, so we first make sure they have
   // been located
@@ -1395,9 +1396,11 @@ void lmd_event_out::copy(const lmd_event *event,
 	    length =
 	      SUBEVENT_DATA_LENGTH_FROM_DLEN((size_t) subevent_info->_header._header.l_dlen);
 
-	  // ANOTHER_CHUNK(subevent_info->_data,length,event->_swapping);
-
-	  if (length)
+	  if (length && refer_data)
+	    {
+	      ANOTHER_CHUNK(subevent_info->_data,length,event->_swapping);
+	    }
+	  else if (length)
 	    {
 	      char *buf;
 
@@ -1414,12 +1417,18 @@ void lmd_event_out::copy(const lmd_event *event,
 
 	  // we already checked for space for first chunk
 
-	  // ANOTHER_CHUNK(frag->_ptr,size0,event->_swapping);
-
-	  char *buf;
+	  if (refer_data)
+	    {
+	      ANOTHER_CHUNK(frag->_ptr + subevent_info->_offset,size0,
+			    event->_swapping);
+	    }
+	  else
+	    {
+	      char *buf;
 
-	  ADD_TO_BUF(buf,frag->_ptr,size0);
-	  ANOTHER_CHUNK(buf,size0,event->_swapping);
+	      ADD_TO_BUF(buf,frag->_ptr + subevent_info->_offset,size0);
+	      ANOTHER_CHUNK(buf,size0,event->_swapping);
+	    }
 
 	  // No guard against stciky revoke (size -1), as we had large size
 	  size_t length =
@@ -1430,10 +1439,17 @@ void lmd_event_out::copy(const lmd_event *event,
 
 	  while (UNLIKELY(size < length))
 	    {
-	      // ANOTHER_CHUNK(frag->_ptr,size,event->_swapping);
-
-	      ADD_TO_BUF(buf,frag->_ptr,size);
-	      ANOTHER_CHUNK(buf,size,event->_swapping);
+	      if (refer_data)
+		{
+		  ANOTHER_CHUNK(frag->_ptr,size,event->_swapping);
+		}
+	      else
+		{
+		  char *buf;
+
+		  ADD_TO_BUF(buf,frag->_ptr,size);
+		  ANOTHER_CHUNK(buf,size,event->_swapping);
+		}
 
 	      length -= size;
 
@@ -1441,10 +1457,17 @@ void lmd_event_out::copy(const lmd_event *event,
 	      size = frag->_length;
 	    }
 
-	  // ANOTHER_CHUNK(frag->_ptr,length,event->_swapping);
+	  if (refer_data)
+	    {
+	      ANOTHER_CHUNK(frag->_ptr,length,event->_swapping);
+	    }
+	  else
+	    {
+	      char *buf;
 
-	  ADD_TO_BUF(buf,frag->_ptr,length);
-	  ANOTHER_CHUNK(buf,length,event->_swapping);
+	      ADD_TO_BUF(buf,frag->_ptr,length);
+	      ANOTHER_CHUNK(buf,length,event->_swapping);
+	    }
 	}
     }
 }
@@ -93,10 +93,13 @@ public:
 		   bool combine_event);
   void copy_all(const lmd_event *event,
 		bool combine_event);
+  // With refer_data, the chunks point to the subevent data of event,
+  // which then must stay valid until the event has been written.
   void copy(const lmd_event *event,
 	    const select_event *select,
 	    bool combine_event,
-	    bool emit_header = true);
+	    bool emit_header = true,
+	    bool refer_data = false);
 };
 
 void copy_to_buffer(void *dest, const void *src,
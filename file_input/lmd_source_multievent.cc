@@ -8,6 +8,10 @@
 #include <sstream>
 #include <iomanip>
 
+#ifdef USE_PTHREAD
+#include "set_thread_name.hh"
+#endif
+
 #define AIDA_PROCID 1
 #define AIDA_TIME_SHIFT 14000
 #define AIDA_CORRELATION_PULSER 1
@@ -26,6 +30,11 @@ aidaeb_watcher_stats* _AIDA_WATCHER_STATS = nullptr;
 
 // someone thought it a good idea to use uint32 where xe ought to have used size_t.
 #define WRTS_SIZE (uint32_t)sizeof(wrts_header)
+
+static_assert(AIDA_PAYLOAD_HEAD * sizeof(uint32_t) == sizeof(wrts_header),
+              "AIDA payload head must hold the WR header");
+static_assert(DTAS_PAYLOAD_HEAD * sizeof(uint32_t) == sizeof(wrts_header) + sizeof(uint32_t),
+              "DTAS payload head must hold the WR header and sausage");
 //
 // Debugging
 #define MEMORY_REPORT 0
@@ -46,9 +55,53 @@ std::string print_aida(uint32_t word1, uint32_t word2);
 // These suck but it is what it is
 sint32 l_count = 0;
 lmd_event_10_1_host input_event_header;
+bool input_event_swapping = false;
+
+// The event handed out.  Without threading it is the global
+// _file_event, and the subevent data is that of the entry, used in
+// place until the next event is requested.  With threading, it is
+// passed on through the queues, and thus allocated (with a copy of
+// the data) in reclaimable memory, like those of lmd_source.
+
+static lmd_event *emit_event_begin()
+{
+#if USE_THREADING
+  lmd_event *ev = (lmd_event *) _wt._defrag_buffer->allocate_reclaim(sizeof (lmd_event));
+  memset(ev, 0, sizeof (lmd_event));
+  ev->_swapping = input_event_swapping;
+  return ev;
+#else
+  _file_event.release();
+  return &_file_event;
+#endif
+}
+
+static lmd_subevent *emit_event_subevents(lmd_event *ev, int n)
+{
+#if USE_THREADING
+  (void) ev;
+  return (lmd_subevent *) _wt._defrag_buffer->allocate_reclaim((size_t) n * sizeof (lmd_subevent));
+#else
+  return (lmd_subevent *) ev->_defrag_event.allocate((size_t) n * sizeof (lmd_subevent));
+#endif
+}
+
+#if USE_THREADING
+static char *emit_event_data(size_t size)
+{
+  return (char *) _wt._defrag_buffer->allocate_reclaim(size);
+}
+#endif
 
 lmd_event *lmd_source_multievent::get_event()
 {
+  // The previous event is done with, so its entry can go
+  if (emitted)
+  {
+    emitted->return_to_pool();
+    emitted = nullptr;
+  }
+
 get_event_retry:
   _TRACE("lmd_source_multievent::get_event()\n");
 
@@ -77,7 +130,7 @@ get_event_retry:
         _TRACE(" Marking AIDA event as unfragmented due to WR\n");
         // Unfragment the event, store it and continue
         cur_aida->fragment = false;
-        events.push(cur_aida);
+        events.push(aida_source, cur_aida);
         cur_aida = nullptr;
       }
       // Always retry after loading events?
@@ -91,7 +144,7 @@ get_event_retry:
       if (cur_dtas && cur_dtas->fragment) {
         // Unfragment the event, store it and continue
         cur_dtas->fragment = false;
-        events.push(cur_dtas);
+        events.push(dtas_source, cur_dtas);
         cur_dtas = nullptr;
         goto get_event_retry;
       }
@@ -109,6 +162,7 @@ get_event_retry:
           TIMEWARP("Recovered from timewarp but skipped %d event(s)", emit_skip);
         emit_skip = 0;
         emit_wr = first->timestamp;
+        emitted = first;
         return first->emit();
       }
       else
@@ -153,7 +207,7 @@ get_event_retry:
     {
       _TRACE("Unfragmented final AIDA event");
       cur_aida->fragment = false;
-      events.push(cur_aida);
+      events.push(aida_source, cur_aida);
       cur_aida = nullptr;
     }
     // First unfragment the current built DTAS
@@ -161,7 +215,7 @@ get_event_retry:
     {
       _TRACE("Unfragmented final DTAS event");
       cur_dtas->fragment = false;
-      events.push(cur_dtas);
+      events.push(dtas_source, cur_dtas);
       cur_dtas = nullptr;
     }
     // Now empty the events quque
@@ -187,18 +241,19 @@ lmd_source_multievent::file_status_t lmd_source_multievent::load_events()  /////
 
   lmd_subevent *se;
 
-  _file_event.release();
-
   _TRACE("lmd_source::get_event()\n");
 
   // Read the next event from the input
-  if (!lmd_source::get_event())
+  loaded = lmd_source::get_event();
+  if (!loaded)
   return eof;
 
+  input_event_swapping = loaded->_swapping;
+
   _TRACE("Get 10:1 info\n");
 
-  _file_event.get_10_1_info();
-  if(_file_event._header._header.i_type != 10 || _file_event._header._header.i_subtype != 1)
+  loaded->get_10_1_info();
+  if(loaded->_header._header.i_type != 10 || loaded->_header._header.i_subtype != 1)
   {
     _TRACE("=> return unknown_event\n");
     return unknown_event;
@@ -206,28 +261,28 @@ lmd_source_multievent::file_status_t lmd_source_multievent::load_events()  /////
 
   _TRACE("Locating subevents\n");
 
-  _file_event.locate_subevents(&event_hint);
+  loaded->locate_subevents(&event_hint);
 
   #if _ENABLE_TRACE
-  //_file_event.print_event(0, NULL);
-  _TRACE(" Event: Number: %d, Trigger :%d\n", _file_event._header._info.l_count, _file_event._header._info.i_trigger);
+  //loaded->print_event(0, NULL);
+  _TRACE(" Event: Number: %d, Trigger :%d\n", loaded->_header._info.l_count, loaded->_header._info.i_trigger);
   #endif
 
-  if(_file_event._nsubevents == 0)
+  if(loaded->_nsubevents == 0)
   {
     _TRACE("-> return unknown_events (_nsubevents = 0)\n");
     return unknown_event;
   }
 
-  for(int i = 0; i < _file_event._nsubevents; i++)
+  for(int i = 0; i < loaded->_nsubevents; i++)
   {
-    se = &(_file_event._subevents[i]);
+    se = &(loaded->_subevents[i]);
     _TRACE("  Subevent: Type: %d, Subtype: %d, ProcID: %d\n", se->_header._header.i_type,
     se->_header._header.i_subtype, se->_header.i_procid);
 
     // Try to find a WR Timestamp
     char *pb_start, *pb_end;
-    _file_event.get_subevent_data_src(se, pb_start, pb_end);
+    loaded->get_subevent_data_src(se, pb_start, pb_end);
     uint32_t *pl_start = reinterpret_cast<uint32_t*>(pb_start);
     int64_t mbs_wr = 0;
 
@@ -269,7 +324,7 @@ lmd_source_multievent::file_status_t lmd_source_multievent::load_events()  /////
 
   triggerevent_entry* entry = pool_new(trigger_events_pool);
   entry->timestamp = load_event_wr;
-  entry->event_no =  _file_event._header._info.l_count;
+  entry->event_no =  loaded->_header._info.l_count;
 
 #if BPLAST_DELAY_FIX
   if (se->_header.i_procid == 80)
@@ -392,33 +447,381 @@ lmd_source_multievent::file_status_t lmd_source_multievent::load_events()  /////
 #endif
 
   // Copy the data over to ensure ownership of pointerss
-  entry->event._header = _file_event._header;
+  entry->event._header = loaded->_header;
   entry->event._status = LMD_EVENT_GET_10_1_INFO_ATTEMPT | LMD_EVENT_HAS_10_1_INFO | LMD_EVENT_LOCATE_SUBEVENTS_ATTEMPT;
-  entry->event._swapping = _file_event._swapping;
-  entry->event._nsubevents = _file_event._nsubevents;
+  entry->event._swapping = loaded->_swapping;
+  entry->event._nsubevents = loaded->_nsubevents;
   // allocate subevent array
-  entry->event._subevents = (lmd_subevent*)entry->event._defrag_event.allocate((size_t)entry->event._nsubevents * sizeof(lmd_subevent));
+  entry->event._subevents = (lmd_subevent*)entry->subevents_alloc.allocate((size_t)entry->event._nsubevents * sizeof(lmd_subevent));
   // copy subevents over
   for (int i = 0; i < entry->event._nsubevents; i++)
   {
-    size_t nsubev = SUBEVENT_DATA_LENGTH_FROM_DLEN(_file_event._subevents[i]._header._header.l_dlen);
-    entry->event._subevents[i]._header = _file_event._subevents[i]._header;
-    entry->event._subevents[i]._data = (char*)entry->event._defrag_event_many.allocate(nsubev);
-    memcpy(entry->event._subevents[i]._data, _file_event._subevents[i]._data, nsubev);
+    size_t nsubev = SUBEVENT_DATA_LENGTH_FROM_DLEN(loaded->_subevents[i]._header._header.l_dlen);
+    entry->event._subevents[i]._header = loaded->_subevents[i]._header;
+    entry->event._subevents[i]._data = (char*)entry->data_alloc.allocate(nsubev);
+    memcpy(entry->event._subevents[i]._data, loaded->_subevents[i]._data, nsubev);
   }
 
-  events.push(entry);
+  events.push(trigger_source, entry);
 
   //_TRACE("Other Buffer now contains: %lu events\n", trigger_event.size());
 
   return other_event;
 }
 
+// Runs of plain ADC (decay) items, in time order and without gaps
+// larger than the event builder window, are the bulk of the AIDA data.
+// They need no per-item work, so are located with a vector scan and
+// then copied as a whole.  Returns the number of leading word pairs
+// of such a run.  prev is the (low 28 bits of the) previous ADC time.
+
+static size_t aida_adc_run_plain(const uint32_t *p, size_t pairs,
+                                 uint32_t prev, int32_t window)
+{
+  size_t n;
+
+  for (n = 0; n < pairs; n++, p += 2)
+  {
+    int32_t ts = (int32_t) (p[1] & 0x0fffffff);
+    int32_t diff = ts - (int32_t) prev;
+
+    if ((p[0] & 0xF0000000) != 0xC0000000 || diff < 0 || diff > window)
+      break;
+    prev = (uint32_t) ts;
+  }
+  return n;
+}
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define AIDA_SCAN_X86 1
+#include <immintrin.h>
+
+__attribute__((target("avx2")))
+static size_t aida_adc_run_avx2(const uint32_t *p, size_t pairs,
+                                uint32_t prev, int32_t window)
+{
+  // 4 pairs per vector: word1 in the even, word2 in the odd lanes
+  const __m256i kind_mask = _mm256_set1_epi32((int) 0xF0000000);
+  const __m256i kind_adc  = _mm256_set1_epi32((int) 0xC0000000);
+  const __m256i ts_mask   = _mm256_set1_epi32(0x0fffffff);
+  const __m256i vwindow   = _mm256_set1_epi32(window);
+  const __m256i zero      = _mm256_setzero_si256();
+  // Time of the previous pair (lane 1 gets the carry)
+  const __m256i prev_idx  = _mm256_setr_epi32(0, 0, 0, 1, 0, 3, 0, 5);
+
+  size_t n = 0;
+
+  for ( ; pairs - n >= 4; n += 4, p += 8)
+  {
+    __m256i v = _mm256_loadu_si256((const __m256i *) p);
+
+    __m256i kind = _mm256_cmpeq_epi32(_mm256_and_si256(v, kind_mask),
+                                      kind_adc);
+    __m256i ts = _mm256_and_si256(v, ts_mask);
+    __m256i tsp = _mm256_blend_epi32(_mm256_permutevar8x32_epi32(ts, prev_idx),
+                                     _mm256_set1_epi32((int) prev), 0x02);
+    __m256i diff = _mm256_sub_epi32(ts, tsp);
+    __m256i bad_ts = _mm256_or_si256(_mm256_cmpgt_epi32(zero, diff),
+                                     _mm256_cmpgt_epi32(diff, vwindow));
+
+    // Even lanes: bad if not ADC; odd lanes: bad if out of order/window
+    __m256i bad = _mm256_blend_epi32(_mm256_xor_si256(kind,
+                                                      _mm256_cmpeq_epi32(zero, zero)),
+                                     bad_ts, 0xaa);
+    unsigned m = (unsigned) _mm256_movemask_ps(_mm256_castsi256_ps(bad));
+
+    if (m)
+    {
+      m = (m | (m >> 1)) & 0x55;
+      return n + (size_t) (__builtin_ctz(m) >> 1);
+    }
+    prev = (uint32_t) _mm256_extract_epi32(ts, 7);
+  }
+  return n + aida_adc_run_plain(p, pairs - n, prev, window);
+}
+
+typedef size_t (*aida_adc_run_fcn)(const uint32_t *, size_t, uint32_t, int32_t);
+
+static aida_adc_run_fcn aida_adc_run_select()
+{
+  __builtin_cpu_init();
+
+  if (__builtin_cpu_supports("avx2"))
+    return aida_adc_run_avx2;
+  return aida_adc_run_plain;
+}
+
+static aida_adc_run_fcn _aida_adc_run_fcn = NULL;
+#endif//AIDA_SCAN_X86
+
+static size_t aida_adc_run(const uint32_t *p, size_t pairs,
+                           uint32_t prev, int32_t window)
+{
+#ifdef AIDA_SCAN_X86
+  if (UNLIKELY(!_aida_adc_run_fcn))
+    _aida_adc_run_fcn = aida_adc_run_select();
+
+  return _aida_adc_run_fcn(p, pairs, prev, window);
+#else
+  return aida_adc_run_plain(p, pairs, prev, window);
+#endif
+}
+
+// Break map word for the n (<= 64) pairs from i0 of a block.  A pair
+// is a break unless it is a plain ADC item whose time follows that of
+// the pair before within the window, i.e. unless it continues a run as
+// aida_adc_run() would take it.  The first pair of a block is always a
+// break, it is checked against the carried time.
+
+static uint64_t aida_breaks_word_plain(const uint32_t *p, size_t i0, size_t n,
+                                       int32_t window)
+{
+  uint64_t bits = 0;
+
+  for (size_t j = 0; j < n; j++)
+  {
+    size_t i = i0 + j;
+
+    if (i == 0)
+    {
+      bits |= 1;
+      continue;
+    }
+
+    const uint32_t *q = p + 2 * i;
+    int32_t diff = (int32_t) (q[1] & 0x0fffffff) - (int32_t) (q[-1] & 0x0fffffff);
+
+    if ((q[0] & 0xF0000000) != 0xC0000000 || diff < 0 || diff > window)
+      bits |= (uint64_t) 1 << j;
+  }
+  return bits;
+}
+
+#ifdef AIDA_SCAN_X86
+// Same checks as aida_adc_run_avx2(), but all 64 pairs are classified.
+__attribute__((target("avx2")))
+static uint64_t aida_breaks_word_avx2(const uint32_t *p, size_t i0, size_t n,
+                                      int32_t window)
+{
+  if (n != 64 || i0 == 0)
+    return aida_breaks_word_plain(p, i0, n, window);
+
+  const __m256i kind_mask = _mm256_set1_epi32((int) 0xF0000000);
+  const __m256i kind_adc  = _mm256_set1_epi32((int) 0xC0000000);
+  const __m256i ts_mask   = _mm256_set1_epi32(0x0fffffff);
+  const __m256i vwindow   = _mm256_set1_epi32(window);
+  const __m256i zero      = _mm256_setzero_si256();
+  const __m256i prev_idx  = _mm256_setr_epi32(0, 0, 0, 1, 0, 3, 0, 5);
+
+  const uint32_t *q = p + 2 * i0;
+  uint32_t prev = q[-1] & 0x0fffffff;
+  uint64_t bits = 0;
+
+  for (size_t j = 0; j < 64; j += 4, q += 8)
+  {
+    __m256i v = _mm256_loadu_si256((const __m256i *) q);
+
+    __m256i kind = _mm256_cmpeq_epi32(_mm256_and_si256(v, kind_mask),
+                                      kind_adc);
+    __m256i ts = _mm256_and_si256(v, ts_mask);
+    __m256i tsp = _mm256_blend_epi32(_mm256_permutevar8x32_epi32(ts, prev_idx),
+                                     _mm256_set1_epi32((int) prev), 0x02);
+    __m256i diff = _mm256_sub_epi32(ts, tsp);
+    __m256i bad_ts = _mm256_or_si256(_mm256_cmpgt_epi32(zero, diff),
+                                     _mm256_cmpgt_epi32(diff, vwindow));
+    __m256i bad = _mm256_blend_epi32(_mm256_xor_si256(kind,
+                                                      _mm256_cmpeq_epi32(zero, zero)),
+                                     bad_ts, 0xaa);
+    unsigned m = (unsigned) _mm256_movemask_ps(_mm256_castsi256_ps(bad));
+
+    // One bit per pair
+    m = (m | (m >> 1)) & 0x55;
+    m = (m | (m >> 1)) & 0x33;
+    m = (m | (m >> 2)) & 0x0f;
+    bits |= (uint64_t) m << j;
+
+    prev = (uint32_t) _mm256_extract_epi32(ts, 7);
+  }
+  return bits;
+}
+#endif//AIDA_SCAN_X86
+
+typedef uint64_t (*aida_breaks_word_fcn)(const uint32_t *, size_t, size_t, int32_t);
+
+// Selected before the decoder threads start
+static aida_breaks_word_fcn _aida_breaks_word_fcn = aida_breaks_word_plain;
+
+// Break map for pairs [begin, end) of a block, begin a multiple of 64.
+static void aida_decode_breaks(const uint32_t *p, size_t begin, size_t end,
+                               int32_t window, uint64_t *breaks)
+{
+  for (size_t i0 = begin; i0 < end; i0 += 64)
+    breaks[i0 / 64] = _aida_breaks_word_fcn(p, i0, std::min((size_t) 64, end - i0),
+                                            window);
+}
+
+// Like aida_adc_run(), for pair k of a block with a break map.
+static size_t aida_adc_run_breaks(const uint32_t *p, size_t k, size_t pairs,
+                                  uint32_t prev, int32_t window,
+                                  const uint64_t *breaks)
+{
+  if (k >= pairs || !aida_adc_run_plain(p + 2 * k, 1, prev, window))
+    return 0;
+
+  // The run continues up to the next break
+  for (size_t i = k + 1; i < pairs; i = (i | 63) + 1)
+  {
+    uint64_t bits = breaks[i / 64] >> (i % 64);
+
+    if (bits)
+      return i + (size_t) __builtin_ctzll(bits) - k;
+  }
+  return pairs - k;
+}
+
+aida_decoder_pool::aida_decoder_pool() : _started(false), _num_threads(0)
+{
+#ifdef USE_PTHREAD
+  _threads = nullptr;
+  _pairs = nullptr;
+  _num_pairs = 0;
+  _window = 0;
+  _breaks = nullptr;
+  _segments = _next_segment = _done_segments = 0;
+  _quit = false;
+#endif
+}
+
+aida_decoder_pool::~aida_decoder_pool()
+{
+#ifdef USE_PTHREAD
+  if (!_num_threads)
+    return;
+
+  pthread_mutex_lock(&_mutex);
+  _quit = true;
+  pthread_cond_broadcast(&_work);
+  pthread_mutex_unlock(&_mutex);
+
+  for (int i = 0; i < _num_threads; i++)
+    pthread_join(_threads[i], NULL);
+
+  delete[] _threads;
+  pthread_cond_destroy(&_finished);
+  pthread_cond_destroy(&_work);
+  pthread_mutex_destroy(&_mutex);
+#endif
+}
+
+void aida_decoder_pool::init(int decoders)
+{
+  _started = true;
+
+#ifdef AIDA_SCAN_X86
+  __builtin_cpu_init();
+
+  if (__builtin_cpu_supports("avx2"))
+    _aida_breaks_word_fcn = aida_breaks_word_avx2;
+#endif
+
+#ifdef USE_PTHREAD
+  if (decoders <= 0)
+    return;
+
+  pthread_mutex_init(&_mutex, NULL);
+  pthread_cond_init(&_work, NULL);
+  pthread_cond_init(&_finished, NULL);
+
+  _threads = new pthread_t[decoders];
+
+  for ( ; _num_threads < decoders; _num_threads++)
+  {
+    if (pthread_create(&_threads[_num_threads], NULL,
+                       aida_decoder_pool::decoder_thread, this) != 0)
+    {
+      perror("pthread_create()");
+      exit(1);
+    }
+    set_thread_name(_threads[_num_threads], "AIDA", 5);
+  }
+  INFO(0, "Decoding large AIDA blocks with %d extra thread(s).", _num_threads);
+#else
+  (void) decoders;
+#endif
+}
+
+#ifdef USE_PTHREAD
+void* aida_decoder_pool::decoder_thread(void* us)
+{
+  aida_decoder_pool* pool = (aida_decoder_pool*) us;
+
+  pool->decoder();
+  return NULL;
+}
+
+void aida_decoder_pool::decoder()
+{
+  pthread_mutex_lock(&_mutex);
+  for ( ; ; )
+  {
+    while (!_quit && _next_segment >= _segments)
+      pthread_cond_wait(&_work, &_mutex);
+    if (_quit)
+      break;
+    decode_segments();
+  }
+  pthread_mutex_unlock(&_mutex);
+}
+
+void aida_decoder_pool::decode_segments()
+{
+  while (_next_segment < _segments)
+  {
+    size_t begin = _next_segment++ * AIDA_DECODE_SEGMENT_PAIRS;
+    size_t end = std::min(begin + AIDA_DECODE_SEGMENT_PAIRS, _num_pairs);
+
+    pthread_mutex_unlock(&_mutex);
+    aida_decode_breaks(_pairs, begin, end, _window, _breaks);
+    pthread_mutex_lock(&_mutex);
+
+    if (++_done_segments == _segments)
+      pthread_cond_signal(&_finished);
+  }
+}
+#endif
+
+void aida_decoder_pool::decode(const uint32_t* pairs, size_t num_pairs,
+                               int32_t window, uint64_t* breaks)
+{
+#ifdef USE_PTHREAD
+  if (_num_threads)
+  {
+    pthread_mutex_lock(&_mutex);
+    _pairs = pairs;
+    _num_pairs = num_pairs;
+    _window = window;
+    _breaks = breaks;
+    _segments = (num_pairs + AIDA_DECODE_SEGMENT_PAIRS - 1) / AIDA_DECODE_SEGMENT_PAIRS;
+    _next_segment = 0;
+    _done_segments = 0;
+    pthread_cond_broadcast(&_work);
+
+    // Take part, then wait for the segments still being decoded
+    decode_segments();
+    while (_done_segments < _segments)
+      pthread_cond_wait(&_finished, &_mutex);
+    pthread_mutex_unlock(&_mutex);
+    return;
+  }
+#endif
+  aida_decode_breaks(pairs, 0, num_pairs, window, breaks);
+}
+
 void lmd_source_multievent::load_aida(lmd_subevent *se, char* pb_start, char* pb_end, int64_t mbs_wr)
 {
   _TRACE("lmd_source_multievent::load_events(): identified an AIDA block... expanding\n");
 
-      input_event_header = _file_event._header;
+      input_event_header = loaded->_header;
 
       // We are to continue with a fragmented block
       if (cur_aida != nullptr && cur_aida->fragment)
@@ -428,7 +831,7 @@ void lmd_source_multievent::load_aida(lmd_subevent *se, char* pb_start, char* pb
       else
       {
         _TRACE(" new AIDA event %16lx\n", load_event_wr);
-        cur_aida = pool_new(aida_events_pool);
+        cur_aida = pool_new(aida_events_pool, &aida_payload);
         cur_aida->_header = se->_header;
         cur_aida->timestamp = load_event_wr - AIDA_TIME_SHIFT;
         cur_aida->fragment_wr = load_event_wr;
@@ -450,8 +853,70 @@ void lmd_source_multievent::load_aida(lmd_subevent *se, char* pb_start, char* pb
         load_event_wr = mbs_wr;
       }
 
+      // Time differences are within the low 28 bits
+      int32_t run_window = (int32_t) std::min(_conf._eventbuilder_window,
+                                              (int64_t) 0x0fffffff);
+      if (run_window < 0)
+        run_window = -1;
+
+      // Large blocks are first handed to the decoders
+      if (UNLIKELY(!aida_decoders.started()))
+        aida_decoders.init(_conf._aida_decoders);
+
+      const uint32_t* pl_pairs = pl_data;
+      size_t block_pairs = (size_t) (pl_end - pl_data) / 2;
+      bool decoded = false;
+
+      if (aida_decoders.active() &&
+          block_pairs >= 2 * AIDA_DECODE_SEGMENT_PAIRS)
+      {
+        aida_breaks.resize((block_pairs + 63) / 64);
+        aida_decoders.decode(pl_pairs, block_pairs, run_window,
+                             aida_breaks.data());
+        decoded = true;
+      }
+
       while(pl_data < pl_end)
       {
+        if ((old_ts & ~(int64_t) 0x0fffffff) ==
+            (load_event_wr & ~(int64_t) 0x0fffffff))
+        {
+          size_t pairs;
+
+          if (decoded)
+            pairs = aida_adc_run_breaks(pl_pairs,
+                                        (size_t) (pl_data - pl_pairs) / 2,
+                                        block_pairs,
+                                        (uint32_t) (old_ts & 0x0fffffff),
+                                        run_window, aida_breaks.data());
+          else
+            pairs = aida_adc_run(pl_data, (size_t) (pl_end - pl_data) / 2,
+                                 (uint32_t) (old_ts & 0x0fffffff),
+                                 run_window);
+          if (pairs)
+          {
+            if (_AIDA_WATCHER_STATS)
+            {
+              for (size_t j = 0; j < pairs; j++)
+                _AIDA_WATCHER_STATS->add_d(1 + ((pl_data[2 * j] >> 22) & 0x3F));
+            }
+            if (aida_skip)
+            {
+              TIMEWARP("AIDA timewarp is over, skipped %d AIDA event(s)", aida_skip);
+            }
+            aida_skip = 0;
+
+            cur_aida->data.append(pl_data, 2 * pairs);
+            pl_data += 2 * pairs;
+
+            load_event_wr &= ~0x0fffffff;
+            load_event_wr |= (pl_data[-1] & 0x0fffffff);
+            cur_aida->fragment_wr = load_event_wr;
+            old_ts = load_event_wr;
+            continue;
+          }
+        }
+
         uint32_t word1 = *pl_data++;
         uint32_t word2 = *pl_data++;
 
@@ -652,10 +1117,10 @@ void lmd_source_multievent::load_aida(lmd_subevent *se, char* pb_start, char* pb
             cur_aida->fragment_wr = old_ts;
             //if (cur_aida->implant()) cur_aida->timestamp = cur_aida->implant_wr_s;
             //aida_events_merge.push_back(cur_aida);
-            events.push(cur_aida);
+            events.push(aida_source, cur_aida);
             cur_aida = nullptr;
           }
-          cur_aida = pool_new(aida_events_pool);
+          cur_aida = pool_new(aida_events_pool, &aida_payload);
           cur_aida->_header = se->_header;
           cur_aida->timestamp = load_event_wr - AIDA_TIME_SHIFT;
           _TRACE(" new AIDA event %16lx\n", load_event_wr);
@@ -694,7 +1159,7 @@ void lmd_source_multievent::load_dtas(lmd_subevent *se, char* pb_start, char* pb
 {
   _TRACE("lmd_source_multievent::load_events(): identified a DTAS block... expanding\n");
 
-  input_event_header = _file_event._header;
+  input_event_header = loaded->_header;
 
   // We are to continue with a fragmented block
   if (cur_dtas != nullptr && cur_dtas->fragment)
@@ -705,7 +1170,7 @@ void lmd_source_multievent::load_dtas(lmd_subevent *se, char* pb_start, char* pb
   else
   {
     _TRACE(" new DTAS event %16lx\n", load_event_wr);
-    cur_dtas = pool_new(dtas_events_pool);
+    cur_dtas = pool_new(dtas_events_pool, &dtas_payload);
     cur_dtas->_header = se->_header;
     cur_dtas->timestamp = load_event_wr;
     cur_dtas->fragment_wr = load_event_wr;
@@ -733,13 +1198,13 @@ void lmd_source_multievent::load_dtas(lmd_subevent *se, char* pb_start, char* pb
       cur_dtas = nullptr;
     }
     _TRACE("Making special DTAS pulser event\n");    
-    dtasevent_entry* pulser = pool_new(dtas_events_pool);
+    dtasevent_entry* pulser = pool_new(dtas_events_pool, &dtas_payload);
     pulser->_header = se->_header;
     pulser->timestamp = mbs_wr;
     pulser->fragment = false;
     pulser->fragment_wr = mbs_wr;
     pulser->pulser = true;
-    events.push(pulser);
+    events.push(dtas_source, pulser);
     return;
   }
 
@@ -805,8 +1270,8 @@ void lmd_source_multievent::load_dtas(lmd_subevent *se, char* pb_start, char* pb
         cur_dtas->fragment = false;
         cur_dtas->fragment_wr = old_ts;
         _TRACE(" completed DTAS event %16lx (%lu entries) moved to event queue\n", cur_dtas->timestamp, cur_dtas->data.size());
-        events.push(cur_dtas);
-        cur_dtas = pool_new(dtas_events_pool);
+        events.push(dtas_source, cur_dtas);
+        cur_dtas = pool_new(dtas_events_pool, &dtas_payload);
       }
       else
       {
@@ -833,7 +1298,7 @@ void lmd_source_multievent::load_dtas(lmd_subevent *se, char* pb_start, char* pb
     //cur_dtas->fragment = true;
 
     cur_dtas->fragment = false;
-    events.push(cur_dtas);
+    events.push(dtas_source, cur_dtas);
     cur_dtas = nullptr;
   }
   else
@@ -845,125 +1310,224 @@ void lmd_source_multievent::load_dtas(lmd_subevent *se, char* pb_start, char* pb
   }
 }
 
+payload_arena::~payload_arena()
+{
+  if (cur && cur->users == 0)
+    recycle(cur);
+  while (free_chunks)
+  {
+    payload_chunk* chunk = free_chunks;
+    free_chunks = chunk->next_free;
+    arena_chunk_free(chunk, chunk->alloc);
+  }
+}
+
+payload_chunk* payload_arena::get_space(size_t need)
+{
+  if (cur && cur->size - cur->used >= need)
+    return cur;
+
+  // A full chunk stays until the last event in it is gone
+  if (cur && cur->users == 0)
+    recycle(cur);
+
+  if (free_chunks && need <= PAYLOAD_CHUNK_WORDS)
+  {
+    cur = free_chunks;
+    free_chunks = cur->next_free;
+    num_free--;
+  }
+  else
+  {
+    size_t words = std::max(need, (size_t) PAYLOAD_CHUNK_WORDS);
+    size_t got;
+    cur = (payload_chunk*) arena_chunk_alloc(sizeof(payload_chunk) + words * sizeof(uint32_t), &got);
+    cur->size = (got - sizeof(payload_chunk)) / sizeof(uint32_t);
+    cur->alloc = got;
+    chunks++;
+  }
+  cur->used = 0;
+  cur->users = 0;
+  return cur;
+}
+
+void payload_arena::release(payload_chunk* chunk)
+{
+  if (--chunk->users != 0)
+    return;
+  if (chunk == cur)
+    cur->used = 0; // start over from the beginning
+  else
+    recycle(chunk);
+}
+
+void payload_arena::recycle(payload_chunk* chunk)
+{
+  if (chunk == cur)
+    cur = nullptr;
+  // Oversized (single event) chunks and too many spare ones are given back
+  if (chunk->size > 2 * PAYLOAD_CHUNK_WORDS || num_free >= PAYLOAD_KEEP_CHUNKS)
+  {
+    arena_chunk_free(chunk, chunk->alloc);
+    chunks--;
+    return;
+  }
+  chunk->next_free = free_chunks;
+  free_chunks = chunk;
+  num_free++;
+}
+
+// The event is not at the end of the current chunk, or that is full.
+// Move what it has to where there is space, after the head words.
+void payload_words::move_to_space(size_t need)
+{
+  payload_chunk* old_chunk = chunk;
+  size_t old_start = start;
+
+  // Leave room to grow, such that long events are not moved repeatedly
+  payload_chunk* to = arena->get_space(head + std::max(need, 2 * count));
+
+  to->users++;
+  if (count)
+    memmove(to->words() + to->used + head, old_chunk->words() + old_start, count * sizeof(uint32_t));
+  chunk = to;
+  start = to->used + head;
+  to->used += head + count;
+
+  if (old_chunk)
+    arena->release(old_chunk);
+}
+
 lmd_event *aidaevent_entry::emit()
 {
   _TRACE("Emitting an AIDA event entry\n");
-  _file_event.release();
+  lmd_event *out = emit_event_begin();
 
-  _file_event._header = input_event_header;
-  _file_event._header._info.l_count = (uint32_t)++l_count;
-  _file_event._header._info.i_trigger = 1;
+  out->_header = input_event_header;
+  out->_header._info.l_count = (uint32_t)++l_count;
+  out->_header._info.i_trigger = 1;
 #ifdef AIDA_CORRELATION_PULSER
   if (this->flags & 0x2)
-    _file_event._header._info.i_trigger = 3;
+    out->_header._info.i_trigger = 3;
 #else
   if (!entry->implant() && entry->data.size() > 750 * 3 * 2) // 750 channels, 3 items (SYNC, SYNC, ADC), 2 32-bit words per item
-    _file_event._header._info.i_trigger = 3;
+    out->_header._info.i_trigger = 3;
 #endif
 
-  _file_event._nsubevents = 1;
-  _file_event._subevents = (lmd_subevent*)_file_event._defrag_event.allocate(sizeof (lmd_subevent));
+  out->_nsubevents = 1;
+  out->_subevents = emit_event_subevents(out, 1);
 
-  _file_event._subevents[0]._header = this->_header;
-  //if (entry->implant) _file_event._subevents[0]._header.i_procid = 95; // Special subevent mark for implant events
-  _file_event._subevents[0]._data = (char*)_file_event._defrag_event_many.allocate(this->data.size() * sizeof(uint32_t) + WRTS_SIZE);
-  _file_event._subevents[0]._header._header.l_dlen = (uint32_t)(this->data.size() * sizeof(uint32_t) + WRTS_SIZE)/2 + 2;
+  out->_subevents[0]._header = this->_header;
+  //if (entry->implant) out->_subevents[0]._header.i_procid = 95; // Special subevent mark for implant events
+  out->_subevents[0]._header._header.l_dlen = (uint32_t)(this->data.size() * sizeof(uint32_t) + WRTS_SIZE)/2 + 2;
 
-  _file_event._header._header.l_dlen = (uint32_t)DLEN_FROM_EVENT_DATA_LENGTH(this->data.size() * sizeof(uint32_t) + WRTS_SIZE + sizeof(lmd_subevent));
+  out->_header._header.l_dlen = (uint32_t)DLEN_FROM_EVENT_DATA_LENGTH(this->data.size() * sizeof(uint32_t) + WRTS_SIZE + sizeof(lmd_subevent));
 
   // AIDA events contain extra state for ucesb
-  _file_event._aida_extra = true;
-  _file_event._aida_implant = this->implant();
-  _file_event._aida_length = (int64_t)this->fragment_wr - AIDA_TIME_SHIFT - this->timestamp;
+  out->_aida_extra = true;
+  out->_aida_implant = this->implant();
+  out->_aida_length = (int64_t)this->fragment_wr - AIDA_TIME_SHIFT - this->timestamp;
   if (this->implant()) {
     this->fragment_wr = this->implant_wr_e;
-    //_file_event._aida_length = (int64_t)entry->implant_wr_s - entry->timestamp; // Only count length from start to implant for overlap... implant is instant
-    _file_event._aida_length = 0; // Aida implants have 0 length
+    //out->_aida_length = (int64_t)entry->implant_wr_s - entry->timestamp; // Only count length from start to implant for overlap... implant is instant
+    out->_aida_length = 0; // Aida implants have 0 length
   }
 
   wrts_header wr(_conf._eventbuilder_wrid, (uint64_t)this->timestamp);
-  memcpy(_file_event._subevents[0]._data, &wr, sizeof(wr));
-  memcpy(_file_event._subevents[0]._data + WRTS_SIZE, this->data.data(), this->data.size() * sizeof(uint32_t));
-  this->return_to_pool();
+#if USE_THREADING
+  char *d = emit_event_data(this->data.size() * sizeof(uint32_t) + WRTS_SIZE);
+  memcpy(d + WRTS_SIZE, this->data.data(), this->data.size() * sizeof(uint32_t));
+#else
+  char *d = (char *)this->data.with_head();
+#endif
+  memcpy(d, &wr, sizeof(wr));
+  out->_subevents[0]._data = d;
 
-  _file_event._status = LMD_EVENT_GET_10_1_INFO_ATTEMPT | LMD_EVENT_HAS_10_1_INFO | LMD_EVENT_LOCATE_SUBEVENTS_ATTEMPT;
-  return &_file_event;
+  out->_status = LMD_EVENT_GET_10_1_INFO_ATTEMPT | LMD_EVENT_HAS_10_1_INFO | LMD_EVENT_LOCATE_SUBEVENTS_ATTEMPT;
+  return out;
 }
 
 lmd_event *dtasevent_entry::emit()
 {
   _TRACE("Emitting a DTAS event entry\n");
-   _file_event.release();
+   lmd_event *out = emit_event_begin();
 
-  _file_event._header = input_event_header;
-  _file_event._header._info.l_count = (uint32_t)++l_count;
-  _file_event._header._info.i_trigger = 1;
+  out->_header = input_event_header;
+  out->_header._info.l_count = (uint32_t)++l_count;
+  out->_header._info.i_trigger = 1;
 
-  _file_event._nsubevents = 1;
-  _file_event._subevents = (lmd_subevent*)_file_event._defrag_event.allocate(sizeof (lmd_subevent));
+  out->_nsubevents = 1;
+  out->_subevents = emit_event_subevents(out, 1);
 
-  _file_event._subevents[0]._header = this->_header;
-  _file_event._subevents[0]._data = (char*)_file_event._defrag_event_many.allocate(this->data.size() * sizeof(uint32_t) + WRTS_SIZE + sizeof(uint32_t));
-  _file_event._subevents[0]._header._header.l_dlen = (uint32_t)(this->data.size() * sizeof(uint32_t) + WRTS_SIZE + sizeof(uint32_t))/2 + 2;
+  out->_subevents[0]._header = this->_header;
+  out->_subevents[0]._header._header.l_dlen = (uint32_t)(this->data.size() * sizeof(uint32_t) + WRTS_SIZE + sizeof(uint32_t))/2 + 2;
 
-  _file_event._header._header.l_dlen = (uint32_t)DLEN_FROM_EVENT_DATA_LENGTH(this->data.size() * sizeof(uint32_t) + WRTS_SIZE + sizeof(uint32_t) + sizeof(lmd_subevent));
+  out->_header._header.l_dlen = (uint32_t)DLEN_FROM_EVENT_DATA_LENGTH(this->data.size() * sizeof(uint32_t) + WRTS_SIZE + sizeof(uint32_t) + sizeof(lmd_subevent));
 
-  _file_event._aida_extra = false;
-  _file_event._aida_implant = false;
-  _file_event._aida_length = 0;
+  out->_aida_extra = false;
+  out->_aida_implant = false;
+  out->_aida_length = 0;
 
   wrts_header wr(0x800, (uint64_t)this->timestamp);
-  memcpy(_file_event._subevents[0]._data, &wr, sizeof(wr));
+#if USE_THREADING
+  char *d = emit_event_data(this->data.size() * sizeof(uint32_t) + WRTS_SIZE + sizeof(uint32_t));
+  memcpy(d + sizeof(uint32_t) + WRTS_SIZE, this->data.data(), this->data.size() * sizeof(uint32_t));
+#else
+  char *d = (char *)this->data.with_head();
+#endif
+  memcpy(d, &wr, sizeof(wr));
   uint32_t sausage = (uint32_t)(this->timestamp >> 32);
 
   // If the event is a pulser set trigger to 3 (pulser) and set the "WR" to 12345678 as before
-  // The data() array is (should be) 0 but we can memcpy 0 bytes safely (as a no-op)
+  // The data() array is (should be) 0, with only the head words
   if (pulser)
   {
-    _file_event._header._info.i_trigger = 3;
+    out->_header._info.i_trigger = 3;
     sausage = 0x12345678;
   }
-  memcpy(_file_event._subevents[0]._data + WRTS_SIZE, &sausage, sizeof(uint32_t));
-  memcpy(_file_event._subevents[0]._data + sizeof(uint32_t) + WRTS_SIZE, this->data.data(), this->data.size() * sizeof(uint32_t));
-  this->return_to_pool();
+  memcpy(d + WRTS_SIZE, &sausage, sizeof(uint32_t));
+  out->_subevents[0]._data = d;
 
-  _file_event._status = LMD_EVENT_GET_10_1_INFO_ATTEMPT | LMD_EVENT_HAS_10_1_INFO | LMD_EVENT_LOCATE_SUBEVENTS_ATTEMPT;
-  return &_file_event;
+  out->_status = LMD_EVENT_GET_10_1_INFO_ATTEMPT | LMD_EVENT_HAS_10_1_INFO | LMD_EVENT_LOCATE_SUBEVENTS_ATTEMPT;
+  return out;
 }
 
 lmd_event* triggerevent_entry::emit()
 {
     _TRACE("Emitting a trigger event entry\n");
-    _file_event.release();
+    lmd_event *out = emit_event_begin();
 
-    _file_event._header = this->event._header;
-    _file_event._header._info.l_count = (uint32_t)++l_count;
+    out->_header = this->event._header;
+    out->_header._info.l_count = (uint32_t)++l_count;
 
-    _file_event._swapping = this->event._swapping;
-    _file_event._nsubevents = this->event._nsubevents;
+    out->_swapping = this->event._swapping;
+    out->_nsubevents = this->event._nsubevents;
     // allocate subevent array
-    _file_event._subevents = (lmd_subevent*)_file_event._defrag_event.allocate((size_t)_file_event._nsubevents * sizeof(lmd_subevent));
-    // copy subevents over
+    out->_subevents = emit_event_subevents(out, out->_nsubevents);
+    // copy subevents over, the data is used in place without threading
     for (int i = 0; i < this->event._nsubevents; i++)
     {
+      out->_subevents[i]._header = this->event._subevents[i]._header;
+#if USE_THREADING
       size_t nsubev = SUBEVENT_DATA_LENGTH_FROM_DLEN(this->event._subevents[i]._header._header.l_dlen);
-      _file_event._subevents[i]._header = this->event._subevents[i]._header;
-      _file_event._subevents[i]._data = (char*)_file_event._defrag_event_many.allocate(nsubev);
-      memcpy(_file_event._subevents[i]._data, this->event._subevents[i]._data, nsubev);
+      out->_subevents[i]._data = emit_event_data(nsubev);
+      memcpy(out->_subevents[i]._data, this->event._subevents[i]._data, nsubev);
+#else
+      out->_subevents[i]._data = this->event._subevents[i]._data;
+#endif
     }
 
-    _file_event._aida_extra = false;
-    _file_event._aida_implant = false;
-    _file_event._aida_length = 0;
+    out->_aida_extra = false;
+    out->_aida_implant = false;
+    out->_aida_length = 0;
 
-    this->return_to_pool();
     //trigger_event.pop_front();
 
-    _file_event._status = LMD_EVENT_GET_10_1_INFO_ATTEMPT | LMD_EVENT_HAS_10_1_INFO | LMD_EVENT_LOCATE_SUBEVENTS_ATTEMPT;
-    return &_file_event;
+    out->_status = LMD_EVENT_GET_10_1_INFO_ATTEMPT | LMD_EVENT_HAS_10_1_INFO | LMD_EVENT_LOCATE_SUBEVENTS_ATTEMPT;
+    return out;
 }
 
-lmd_source_multievent::lmd_source_multievent() : load_event_wr(0), emit_wr(0), last_mbs_wr(0), emit_skip(0), aida_skip(0), dtas_skip(0), cur_aida(nullptr), cur_dtas(nullptr)
+lmd_source_multievent::lmd_source_multievent() : load_event_wr(0), emit_wr(0), last_mbs_wr(0), emit_skip(0), aida_skip(0), dtas_skip(0), cur_aida(nullptr), cur_dtas(nullptr), loaded(nullptr), emitted(nullptr)
 {
 #if BPLAST_DELAY_FIX
   WARNING("bPlas WR Correction is ACTIVE");
@@ -984,20 +1548,17 @@ lmd_source_multievent::~lmd_source_multievent()
   INFO(0, "cur_dtas size = %zu", cur_dtas ? cur_dtas->data.size() : 0);
   INFO(0, "event buffer size = %zu", events.size());
   INFO(0, "aida pool size = %zu", aida_events_pool.size());
-  size_t recurse = 0;
-  for (auto i : aida_events_pool) recurse += i->data.capacity();
-  INFO(0, "aida pool recursive size = %zu", recurse);
+  INFO(0, "aida payload chunks = %zu", aida_payload.num_chunks());
   INFO(0, "trigger pool size = %zu", trigger_events_pool.size());
-  recurse = 0;
+  size_t recurse = 0;
   for (auto i : trigger_events_pool) recurse += i->event._defrag_event_many._allocated;
   INFO(0, "trigger pool recursive size = %zu", recurse);
   INFO(0, "dtas pool size = %zu", dtas_events_pool.size());
-  recurse = 0;
-  for (auto i : dtas_events_pool) recurse += i->data.capacity();
-  INFO(0, "dtas pool recursive size = %zu", recurse);
+  INFO(0, "dtas payload chunks = %zu", dtas_payload.num_chunks());
 #endif
   delete cur_aida;
   delete cur_dtas;
+  delete emitted;
   for (; !events.empty(); events.pop()) delete events.top();
   for (auto i : aida_events_pool) delete i;
   for (auto i : trigger_events_pool) delete i;
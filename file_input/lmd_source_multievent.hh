@@ -6,6 +6,7 @@
 #include <list>
 #include <map>
 #include <queue>
+#include <vector>
 
 #include <stdint.h>
 
@@ -18,6 +19,10 @@ struct lmd_event_multievent;
 #include <math.h>
 #include "config.hh"
 
+#ifdef USE_PTHREAD
+#include <pthread.h>
+#endif
+
 //#define BPLAST_DELAY_FIX 1
 //#define FATIMA_DELAY_FIX 1
 #define AIDA_REAL_IMPLANTS
@@ -160,12 +165,12 @@ private:
 
 // Pool managers
 
-template <typename T>
-T* pool_new(std::deque<T*>& queue)
+template <typename T, typename... Args>
+T* pool_new(std::deque<T*>& queue, Args... args)
 {
   if (queue.empty())
   {
-    T* set = new T;
+    T* set = new T(args...);
     set->pool = &queue;
     _TRACE("Creating new entry as queue is empty addr=%p\n", set);
     return set;
@@ -221,13 +226,174 @@ public:
   virtual void return_to_pool() = 0;
 };
 
-// Special comparator to compare the two event_entry pointers by their values (not addresses)
-struct compare_entry
+// The entry streams that are merged
+enum event_entry_source
+{
+  trigger_source,
+  aida_source,
+  dtas_source,
+  num_entry_sources
+};
+
+// Time ordering of all entries.  Each source produces its entries
+// (nearly) in time order, so they are kept in one sorted FIFO per
+// source, and the next entry is the earliest of the few FIFO heads.
+// Insertion only has to walk back past the (rare) later entries.
+class event_entry_merge
 {
-  bool operator()(event_entry const* lhs, event_entry const* rhs)
+public:
+  event_entry_merge() : entries(0), top_source(-1) {}
+
+  inline void push(int source, event_entry* entry)
+  {
+    std::deque<event_entry*>& q = fifo[source];
+    auto it = q.end();
+    while (it != q.begin() && **(it - 1) > *entry)
+      --it;
+    q.insert(it, entry);
+    entries++;
+    top_source = -1;
+  }
+
+  inline event_entry* top()
   {
-    return *lhs > *rhs;
+    if (top_source < 0)
+    {
+      for (int i = 0; i < num_entry_sources; i++)
+      {
+        if (!fifo[i].empty() &&
+            (top_source < 0 || *fifo[top_source].front() > *fifo[i].front()))
+          top_source = i;
+      }
+    }
+    return fifo[top_source].front();
   }
+
+  inline void pop()
+  {
+    top();
+    fifo[top_source].pop_front();
+    entries--;
+    top_source = -1;
+  }
+
+  inline size_t size() const { return entries; }
+  inline bool empty() const { return entries == 0; }
+
+private:
+  std::deque<event_entry*> fifo[num_entry_sources];
+  size_t entries;
+  int top_source; // source of the earliest head, -1 if not known
+};
+
+// Payload storage for the built AIDA and DTAS events.
+//
+// The words of all events of one kind are appended into large shared
+// chunks, instead of each (pooled) entry keeping its own vector.  Only
+// one event of each kind is being built at a time, so that is always
+// at the end of the current chunk.  A chunk is reused when all events
+// with data in it have been emitted or discarded.
+
+#define PAYLOAD_CHUNK_WORDS 0x10000 // 256 kB
+#define PAYLOAD_KEEP_CHUNKS 64
+
+// Words kept free in front of each event's payload, where emit()
+// writes the WR header (and for DTAS the upper timestamp word), so
+// that the payload is handed out in place.
+
+#define AIDA_PAYLOAD_HEAD   5
+#define DTAS_PAYLOAD_HEAD   6
+
+struct payload_chunk
+{
+  size_t size;  // words
+  size_t used;
+  size_t alloc; // bytes, for arena_chunk_free
+  int users;    // events with data in the chunk
+  payload_chunk* next_free;
+
+  inline uint32_t* words() { return reinterpret_cast<uint32_t*>(this + 1); }
+};
+
+class payload_arena
+{
+public:
+  payload_arena() : cur(nullptr), free_chunks(nullptr), num_free(0), chunks(0) {}
+  ~payload_arena();
+
+  // Current chunk, with space for at least need words.
+  payload_chunk* get_space(size_t need);
+  // One user of the chunk is done with it.
+  void release(payload_chunk* chunk);
+
+  inline size_t num_chunks() const { return chunks; }
+
+private:
+  payload_chunk* cur;
+  payload_chunk* free_chunks;
+  size_t num_free;
+  size_t chunks;
+
+  void recycle(payload_chunk* chunk);
+};
+
+// The words of one event, as a (start, count) range in an arena chunk.
+class payload_words
+{
+public:
+  payload_words(payload_arena* _arena, size_t _head = 0)
+    : arena(_arena), chunk(nullptr), head(_head), start(0), count(0) {}
+  ~payload_words() { clear(); }
+
+  // Owns its reference to the chunk.
+  payload_words(const payload_words&) = delete;
+  payload_words& operator=(const payload_words&) = delete;
+
+  inline void push_back(uint32_t word)
+  {
+    if (!chunk || chunk->used != start + count || chunk->used == chunk->size)
+      move_to_space(count + 1);
+    chunk->words()[chunk->used++] = word;
+    count++;
+  }
+
+  inline void append(const uint32_t* src, size_t n)
+  {
+    if (!chunk || chunk->used != start + count || chunk->size - chunk->used < n)
+      move_to_space(count + n);
+    memcpy(chunk->words() + chunk->used, src, n * sizeof(uint32_t));
+    chunk->used += n;
+    count += n;
+  }
+
+  inline void clear()
+  {
+    if (chunk)
+      arena->release(chunk);
+    chunk = nullptr;
+    start = count = 0;
+  }
+
+  inline size_t size() const { return count; }
+  inline uint32_t operator[](size_t i) const { return chunk->words()[start + i]; }
+  inline const uint32_t* data() const { return chunk ? chunk->words() + start : nullptr; }
+
+  // The head words in front of data(), followed by the data.
+  inline uint32_t* with_head()
+  {
+    if (!chunk)
+      move_to_space(0);
+    return chunk->words() + start - head;
+  }
+
+private:
+  payload_arena* arena;
+  payload_chunk* chunk;
+  size_t head;
+  size_t start;
+  size_t count;
+
+  void move_to_space(size_t need);
 };
 
 struct aidaevent_entry;
@@ -237,7 +403,7 @@ struct aidaevent_entry : public event_entry
 {
   //keep_buffer_wrapper *data_alloc;
   lmd_subevent_10_1_host _header;
-  std::vector<uint32_t> data;
+  payload_words data;
   bool fragment;
   int64_t fragment_wr, implant_wr_s, implant_wr_e;
   int flags;
@@ -248,7 +414,7 @@ struct aidaevent_entry : public event_entry
   bool nside_imp[2];
 #endif
 
-	aidaevent_entry() : data(), fragment(true), implant_wr_s(0), flags(0)  { data.reserve(10000); reset(); }
+	aidaevent_entry(payload_arena* arena) : data(arena, AIDA_PAYLOAD_HEAD), fragment(true), implant_wr_s(0), flags(0)  { reset(); }
 	virtual ~aidaevent_entry(){}
 
   virtual void reset() {
@@ -289,10 +455,13 @@ typedef std::deque< triggerevent_entry* > triggerevent_queue;
 struct triggerevent_entry : public event_entry
 {
   lmd_event event;
+  // Copies of the subevent headers and data of event
+  keep_buffer_single subevents_alloc;
+  keep_buffer_many data_alloc;
 
   virtual void reset() {
     timestamp = 0;
-    event.release();
+    data_alloc.release();
   }
 
   virtual ~triggerevent_entry() {}
@@ -318,12 +487,12 @@ typedef std::deque< dtasevent_entry* > dtasevent_queue;
 struct dtasevent_entry : public event_entry
 {
   lmd_subevent_10_1_host _header;
-  std::vector<uint32_t> data;
+  payload_words data;
   bool fragment;
   int64_t fragment_wr;
   bool pulser;
 
-  dtasevent_entry() : event_entry(), data()  { data.reserve(100); reset(); }
+  dtasevent_entry(payload_arena* arena) : event_entry(), data(arena, DTAS_PAYLOAD_HEAD)  { reset(); }
 
   virtual ~dtasevent_entry() {
   
@@ -347,6 +516,66 @@ struct dtasevent_entry : public event_entry
   }
 };
 
+// Pool of decoder threads for large AIDA blocks.
+//
+// A block is cut into segments, which the decoders (and the input
+// thread) take in turn.  For each word pair they mark whether it does
+// NOT continue a run of plain ADC items from the pair before it (break
+// map, one bit per pair).  That only depends on the data itself.  The
+// input thread then goes through the block in order, as before, with
+// the WR time, fragment and timewarp state carried from the previous
+// block, but takes each run up to the next break as a whole, checking
+// only its first item.
+
+// Pairs per segment, a multiple of 64 (one map word per 64 pairs)
+#define AIDA_DECODE_SEGMENT_PAIRS 0x4000
+
+class aida_decoder_pool
+{
+public:
+  aida_decoder_pool();
+  ~aida_decoder_pool();
+
+  // Start the decoder threads (none: decode in the input thread).
+  void init(int decoders);
+
+  inline bool started() const { return _started; }
+  inline bool active() const { return _num_threads > 0; }
+
+  // Fill breaks (one bit per pair) for a block.  Returns when all
+  // segments are done.
+  void decode(const uint32_t* pairs, size_t num_pairs,
+              int32_t window, uint64_t* breaks);
+
+private:
+  bool _started;
+  int _num_threads;
+
+#ifdef USE_PTHREAD
+  pthread_t* _threads;
+
+  pthread_mutex_t _mutex;
+  pthread_cond_t _work;     // new block, or quit
+  pthread_cond_t _finished; // all segments of the block done
+
+  // The block being decoded, under _mutex
+  const uint32_t* _pairs;
+  size_t _num_pairs;
+  int32_t _window;
+  uint64_t* _breaks;
+  size_t _segments;
+  size_t _next_segment;
+  size_t _done_segments;
+  bool _quit;
+
+  static void* decoder_thread(void* us);
+  void decoder();
+  // Take and decode segments until none are left.  Called and
+  // returns with _mutex locked.
+  void decode_segments();
+#endif
+};
+
 struct lmd_source_multievent : public lmd_source
 {
 protected:
@@ -361,6 +590,10 @@ protected:
 
   lmd_event_hint event_hint;
 
+  // Data of the AIDA and DTAS entries
+  payload_arena aida_payload;
+  payload_arena dtas_payload;
+
   aidaevent_queue aida_events_pool;
   triggerevent_queue trigger_events_pool;
   dtasevent_queue dtas_events_pool;
@@ -368,11 +601,15 @@ protected:
   aidaevent_entry* cur_aida;
   dtasevent_entry* cur_dtas;
 
+  // Break map of the AIDA block being loaded, from the decoders
+  aida_decoder_pool aida_decoders;
+  std::vector<uint64_t> aida_breaks;
+
   //aidaevent_queue aida_events_merge;
   //aidaevent_queue aida_events_dump;
   //triggerevent_queue trigger_event;
   //dtasevent_queue dtas_events;
-  std::priority_queue<event_entry*, std::deque<event_entry*>, compare_entry> events;
+  event_entry_merge events;
 #if BPLAST_DELAY_FIX
   triggerevent_entry plastic_buffer;
 #endif
@@ -380,6 +617,11 @@ protected:
   triggerevent_entry fatima_buffer;
 #endif
 
+  // Last event read from the input
+  lmd_event* loaded;
+  // Entry of the event last handed out, its data may be used in place
+  event_entry* emitted;
+
   file_status_t load_events();
 
   void load_aida(lmd_subevent *se, char* pb_start, char* pb_end, int64_t mbs_wr);
@@ -0,0 +1,7 @@
+#include <lzma.h>
+
+int main()
+{
+  lzma_stream ls = LZMA_STREAM_INIT;
+  return lzma_stream_decoder(&ls,UINT64_MAX,LZMA_CONCATENATED) != LZMA_OK;
+}
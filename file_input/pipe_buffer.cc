@@ -96,8 +96,13 @@
 
 #ifdef USE_PTHREAD
 
+void (*pipe_buffer_base::_reader_thread_init)() = NULL;
+
 void *pipe_buffer_base::reader_thread(void *us)
 {
+  if (_reader_thread_init)
+    _reader_thread_init();
+
   return ((pipe_buffer_base *) us)->reader();
 }
 
@@ -527,21 +532,26 @@ void pipe_buffer_base::init(unsigned char *push_magic,size_t push_magic_len,
   // _thread_consumer = pthread_self();
 
   if (create_thread)
-    {
-      _block.init();
-
-      if (pthread_create(&_thread,NULL,pipe_buffer::reader_thread,this) != 0)
-	{
-	  perror("pthread_create()");
-	  exit(1);
-	}
+    spawn_reader("NETIN");
+#endif
+}
 
-      set_thread_name(_thread, "NETIN", 5);
+#ifdef USE_PTHREAD
+void pipe_buffer_base::spawn_reader(const char *name)
+{
+  _block.init();
 
-      _active = true;
+  if (pthread_create(&_thread,NULL,pipe_buffer::reader_thread,this) != 0)
+    {
+      perror("pthread_create()");
+      exit(1);
     }
-#endif
+
+  set_thread_name(_thread, name, 5);
+
+  _active = true;
 }
+#endif
 
 void pipe_buffer_base::realloc(size_t bufsize)
 {
@@ -99,6 +99,10 @@ public:
 public:
   static void *reader_thread(void *us);
   virtual void *reader() = 0;
+
+  // Called first by each reader thread (e.g. to set CPU affinity,
+  // before the buffer pages are touched), if set.
+  static void (*_reader_thread_init)();
 #else
 public:
   virtual int read_now(off_t end) = 0;
@@ -113,6 +117,10 @@ public:
 	    );
   virtual void close();
 
+#ifdef USE_PTHREAD
+  void spawn_reader(const char *name);
+#endif
+
   void realloc(size_t bufsize);
 
 public:
@@ -0,0 +1,607 @@
+/* This file is part of UCESB - a tool for data unpacking and processing.
+ *
+ * Copyright (C) 2016  Haakan T. Johansson  <f96hajo@chalmers.se>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301  USA
+ */
+
+#include "uring_buffer.hh"
+
+#ifdef HAVE_IO_URING
+
+#include "error.hh"
+
+#include <unistd.h>
+#include <stdio.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <stdint.h>
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/eventfd.h>
+#include <sys/select.h>
+
+// Principle of operation:
+//
+// The buffer handling towards the consumer is the one of
+// pipe_buffer_base, see pipe_buffer.cc.  The difference is in how
+// the buffer gets filled.  Instead of one blocking read() at a time,
+// we keep up to URING_QUEUE_DEPTH read requests of (at most)
+// URING_CHUNK_SIZE queued with the kernel.  Each request covers a
+// stretch of the ring buffer that does not wrap.  Since the stream
+// offset and the position in the buffer are related by a fixed
+// mask, a request always writes the right data into the right
+// place, no matter in which order they complete.
+//
+// The requests are kept in a small ring of slots, in the order they
+// were issued.  Completions only record the result in the slot.
+// _avail is then moved over the prefix of completed slots.
+//
+// The reader thread sleeps in the usual thread_block select, with
+// an eventfd registered with the io_uring instance, such that both
+// completions and the wakeups from release_to() get its attention.
+//
+// A short read means that the end of the file was reached (at least
+// for now).  All outstanding requests are then waited for and
+// discarded, and reading continues from where the data ended.  When
+// a read returns nothing, we are at the end.
+
+#ifndef IORING_FEAT_SINGLE_MMAP
+#define IORING_FEAT_SINGLE_MMAP  (1U << 0)
+#endif
+
+static int sys_io_uring_setup(unsigned entries,struct io_uring_params *p)
+{
+  return (int) syscall(__NR_io_uring_setup,entries,p);
+}
+
+static int sys_io_uring_enter(int fd,unsigned to_submit,
+			      unsigned min_complete,unsigned flags)
+{
+  return (int) syscall(__NR_io_uring_enter,fd,to_submit,min_complete,
+		       flags,NULL,0);
+}
+
+static int sys_io_uring_register(int fd,unsigned opcode,
+				 void *arg,unsigned nr_args)
+{
+  return (int) syscall(__NR_io_uring_register,fd,opcode,arg,nr_args);
+}
+
+uring_buffer::uring_buffer()
+{
+  _fd = -1;
+
+  _ring_fd  = -1;
+  _event_fd = -1;
+
+  _sq_ring = MAP_FAILED;
+  _cq_ring = MAP_FAILED;
+  _sqes    = (struct io_uring_sqe *) MAP_FAILED;
+
+  _sq_ring_size = 0;
+  _cq_ring_size = 0;
+  _sqes_size    = 0;
+
+  _fixed_buffer = false;
+
+  _slot_first = 0;
+  _slot_next  = 0;
+  _inflight   = 0;
+  _to_submit  = 0;
+
+  _submitted = 0;
+  _chunk     = URING_CHUNK_SIZE;
+
+  _hit_eof = false;
+}
+
+uring_buffer::~uring_buffer()
+{
+  close();
+}
+
+bool uring_buffer::setup_ring()
+{
+  struct io_uring_params p;
+
+  memset(&p,0,sizeof(p));
+
+  _ring_fd = sys_io_uring_setup(URING_QUEUE_DEPTH,&p);
+
+  if (_ring_fd < 0)
+    {
+      // ENOSYS: kernel too old, EPERM: disabled by sysctl or seccomp
+      _ring_fd = -1;
+      return false;
+    }
+
+  _sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  _cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+
+  if (p.features & IORING_FEAT_SINGLE_MMAP)
+    {
+      if (_cq_ring_size > _sq_ring_size)
+	_sq_ring_size = _cq_ring_size;
+      _cq_ring_size = _sq_ring_size;
+    }
+
+  _sq_ring = mmap(NULL,_sq_ring_size,PROT_READ | PROT_WRITE,
+		  MAP_SHARED | MAP_POPULATE,_ring_fd,IORING_OFF_SQ_RING);
+
+  if (_sq_ring == MAP_FAILED)
+    return false;
+
+  if (p.features & IORING_FEAT_SINGLE_MMAP)
+    _cq_ring = _sq_ring;
+  else
+    {
+      _cq_ring = mmap(NULL,_cq_ring_size,PROT_READ | PROT_WRITE,
+		      MAP_SHARED | MAP_POPULATE,_ring_fd,IORING_OFF_CQ_RING);
+
+      if (_cq_ring == MAP_FAILED)
+	return false;
+    }
+
+  _sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+
+  _sqes = (struct io_uring_sqe *)
+    mmap(NULL,_sqes_size,PROT_READ | PROT_WRITE,
+	 MAP_SHARED | MAP_POPULATE,_ring_fd,IORING_OFF_SQES);
+
+  if (_sqes == MAP_FAILED)
+    return false;
+
+  char *sq = (char *) _sq_ring;
+  char *cq = (char *) _cq_ring;
+
+  _sq_tail  = (unsigned *) (sq + p.sq_off.tail);
+  _sq_mask  = (unsigned *) (sq + p.sq_off.ring_mask);
+  _sq_array = (unsigned *) (sq + p.sq_off.array);
+
+  _cq_head  = (unsigned *) (cq + p.cq_off.head);
+  _cq_tail  = (unsigned *) (cq + p.cq_off.tail);
+  _cq_mask  = (unsigned *) (cq + p.cq_off.ring_mask);
+  _cqes     = (struct io_uring_cqe *) (cq + p.cq_off.cqes);
+
+  _event_fd = eventfd(0,EFD_CLOEXEC | EFD_NONBLOCK);
+
+  if (_event_fd == -1)
+    return false;
+
+  if (sys_io_uring_register(_ring_fd,IORING_REGISTER_EVENTFD,
+			    &_event_fd,1) != 0)
+    return false;
+
+  return true;
+}
+
+void uring_buffer::prepare_read(unsigned slot_no)
+{
+  uring_slot *slot = &_slots[slot_no & (URING_QUEUE_DEPTH - 1)];
+
+  // Only we touch the submission tail, the kernel the head.  We
+  // never have more requests than entries, so there is always space.
+
+  unsigned tail  = *_sq_tail;
+  unsigned index = tail & *_sq_mask;
+
+  struct io_uring_sqe *sqe = &_sqes[index];
+
+  memset(sqe,0,sizeof(*sqe));
+
+  char *dest = _buffer + (slot->_start & (_size - 1));
+
+  sqe->fd        = _fd;
+  sqe->off       = (uint64_t) slot->_start;
+  sqe->user_data = slot_no;
+
+  if (_fixed_buffer)
+    {
+      sqe->opcode    = IORING_OP_READ_FIXED;
+      sqe->addr      = (uint64_t) (size_t) dest;
+      sqe->len       = (uint32_t) slot->_length;
+      sqe->buf_index = 0;
+    }
+  else
+    {
+      slot->_iov.iov_base = dest;
+      slot->_iov.iov_len  = slot->_length;
+
+      sqe->opcode    = IORING_OP_READV;
+      sqe->addr      = (uint64_t) (size_t) &slot->_iov;
+      sqe->len       = 1;
+    }
+
+  slot->_result = URING_SLOT_PENDING;
+
+  _sq_array[index] = index;
+
+  // The entry must be visible before the kernel sees the new tail.
+  __atomic_store_n(_sq_tail,tail + 1,__ATOMIC_RELEASE);
+
+  _inflight++;
+  _to_submit++;
+}
+
+void uring_buffer::submit_reads()
+{
+  while (!_hit_eof &&
+	 _slot_next - _slot_first < URING_QUEUE_DEPTH)
+    {
+      // _done may only move forward under our feet, so space is
+      // a conservative estimate.
+
+      size_t space   = _size - (_submitted - _done);
+      size_t offset  = _submitted & (_size - 1);
+      size_t segment = _size - offset;
+
+      if (segment > space)
+	segment = space;
+
+      if (!segment)
+	break;
+
+      if (segment > _chunk)
+	segment = _chunk;
+      else if (segment < _chunk &&
+	       offset + segment != _size &&
+	       _inflight)
+	{
+	  // Do not chop the buffer into small requests while others
+	  // are still pending, rather wait for more space.
+	  break;
+	}
+
+      uring_slot *slot = &_slots[_slot_next & (URING_QUEUE_DEPTH - 1)];
+
+      slot->_start  = _submitted;
+      slot->_length = segment;
+
+      prepare_read(_slot_next);
+
+      _slot_next++;
+      _submitted += segment;
+    }
+
+  if (_to_submit)
+    enter(0);
+}
+
+void uring_buffer::enter(unsigned min_complete)
+{
+  for ( ; ; )
+    {
+      unsigned flags = min_complete ? IORING_ENTER_GETEVENTS : 0;
+
+      int n = sys_io_uring_enter(_ring_fd,_to_submit,min_complete,flags);
+
+      if (n >= 0)
+	{
+	  _to_submit -= (unsigned) n;
+	  if (!_to_submit || min_complete)
+	    return;
+	  continue;
+	}
+
+      if (errno == EINTR)
+	continue;
+      if (errno == EAGAIN || errno == EBUSY)
+	{
+	  // Completion queue full, or kernel out of resources.
+	  // Reap what we have and try again.
+	  harvest();
+	  continue;
+	}
+      perror("io_uring_enter()");
+      exit(1);
+    }
+}
+
+void uring_buffer::harvest()
+{
+  unsigned head = *_cq_head;
+  unsigned tail = __atomic_load_n(_cq_tail,__ATOMIC_ACQUIRE);
+
+  for ( ; head != tail; head++)
+    {
+      struct io_uring_cqe *cqe = &_cqes[head & *_cq_mask];
+
+      uring_slot *slot =
+	&_slots[cqe->user_data & (URING_QUEUE_DEPTH - 1)];
+
+      slot->_result = cqe->res;
+      _inflight--;
+    }
+
+  __atomic_store_n(_cq_head,head,__ATOMIC_RELEASE);
+}
+
+void uring_buffer::drain()
+{
+  while (_inflight)
+    {
+      enter(1);
+      harvest();
+    }
+}
+
+void uring_buffer::retire()
+{
+  size_t avail = _avail;
+
+  while (_slot_first != _slot_next)
+    {
+      uring_slot *slot = &_slots[_slot_first & (URING_QUEUE_DEPTH - 1)];
+
+      if (slot->_result == URING_SLOT_PENDING)
+	break;
+
+      if (slot->_result < 0)
+	{
+	  if (slot->_result == -EINTR ||
+	      slot->_result == -EAGAIN)
+	    {
+	      // Just ask again
+	      prepare_read(_slot_first);
+	      enter(0);
+	      break;
+	    }
+	  errno = (int) -slot->_result;
+	  perror("io_uring read");
+	  exit(1);
+	}
+
+      size_t n = (size_t) slot->_result;
+
+      avail += n;
+      _slot_first++;
+
+      if (n < slot->_length)
+	{
+	  // Short read.  Whatever else is in flight is beyond the
+	  // end of what the file held when it was read.  Wait for it
+	  // all and then issue again from here.
+
+	  drain();
+
+	  _slot_first = _slot_next;
+	  _submitted  = avail;
+
+	  if (n == 0)
+	    _hit_eof = true;
+	  break;
+	}
+    }
+
+  if (avail == _avail)
+    return;
+
+  _avail = avail;
+
+#ifdef USE_PTHREAD
+  if (_need_consumer_wakeup &&
+      ((ssize_t) (_avail - _wakeup_avail)) >= 0)
+    {
+      // The consumer was waiting for us.
+
+      const thread_block *blocked =
+	(const thread_block *) _need_consumer_wakeup;
+      _need_consumer_wakeup = NULL;
+      SFENCE;
+      blocked->wakeup();
+    }
+#endif
+}
+
+#ifdef USE_PTHREAD
+void *uring_buffer::reader()
+{
+  sigset_t sigmask;
+
+  sigemptyset(&sigmask);
+  sigaddset(&sigmask,SIGINT);
+
+  pthread_sigmask(SIG_BLOCK,&sigmask,NULL);
+
+  for ( ; ; )
+    {
+      submit_reads();
+
+      if (!_inflight)
+	{
+	  if (_hit_eof)
+	    break;
+
+	  // Buffer is FULL.  Same procedure (and race avoidance) as
+	  // in pipe_buffer::reader().
+
+	  MFENCE;
+
+	  _wakeup_done = _avail - _size + (_size >> 4);
+	  MFENCE;
+	  _need_reader_wakeup = &_block;
+
+	  MFENCE;
+
+	  if (_avail - _done >= _size)
+	    _block.block();
+	  continue;
+	}
+
+      fd_set rfds;
+      FD_ZERO(&rfds);
+      FD_SET(_event_fd,&rfds);
+
+      _block.block(_event_fd,&rfds,NULL);
+
+      if (FD_ISSET(_event_fd,&rfds))
+	{
+	  uint64_t count;
+
+	  // Only resets the counter, the completions are in the ring.
+	  if (read(_event_fd,&count,sizeof(count)) == -1 &&
+	      errno != EAGAIN && errno != EINTR)
+	    {
+	      perror("read(eventfd)");
+	      exit(1);
+	    }
+	}
+
+      harvest();
+      retire();
+    }
+
+#ifdef USE_THREADING
+  request_next_file();
+#endif
+
+  _reached_eof = true;
+
+  MFENCE;
+
+  if (_need_consumer_wakeup)
+    {
+      // The consumer was waiting for us.  Wake him up to tell him
+      // that data will never be available.
+
+      const thread_block *blocked =
+	(const thread_block *) _need_consumer_wakeup;
+      _need_consumer_wakeup = NULL;
+      SFENCE;
+      blocked->wakeup();
+    }
+
+  return NULL;
+}
+#else//!USE_PTHREAD
+int uring_buffer::read_now(off_t end)
+{
+  // We have no reader thread.  Issue the requests and wait for
+  // them ourselves.
+
+  while (((ssize_t) _avail - (ssize_t) end) < 0)
+    {
+      if (_reached_eof)
+	return 0; // data requested is NOT available
+
+      submit_reads();
+
+      if (!_inflight)
+	{
+	  if (_hit_eof)
+	    {
+	      _reached_eof = true;
+	      continue;
+	    }
+	  ERROR("pipe_buffer too small");
+	}
+
+      enter(1);
+      harvest();
+      retire();
+    }
+  return 1;
+}
+#endif//!USE_PTHREAD
+
+bool uring_buffer::init(int fd,unsigned char *push_magic,size_t push_magic_len,
+			size_t bufsize
+#ifdef USE_PTHREAD
+			,thread_block *block_reader
+#endif
+			)
+{
+  _fd = fd;
+
+  if (!setup_ring())
+    return false;
+
+  pipe_buffer_base::init(push_magic,push_magic_len,bufsize
+#ifdef USE_PTHREAD
+			 ,block_reader,false
+#endif
+			 );
+
+  // Any pushed magic bytes are already in the buffer, and were
+  // stolen from the start of the file.  Stream and file offsets
+  // are thus the same.
+  _submitted = _avail;
+
+  _chunk = _size / URING_QUEUE_DEPTH;
+  if (_chunk > URING_CHUNK_SIZE)
+    _chunk = URING_CHUNK_SIZE;
+
+  // Registering the buffer saves the kernel from mapping the pages
+  // for each request.  It may fail due to RLIMIT_MEMLOCK, then
+  // plain readv requests are used.
+
+  struct iovec iov;
+
+  iov.iov_base = _buffer;
+  iov.iov_len  = _size;
+
+  _fixed_buffer =
+    (sys_io_uring_register(_ring_fd,IORING_REGISTER_BUFFERS,&iov,1) == 0);
+
+#ifdef USE_PTHREAD
+  spawn_reader("URING");
+#endif
+
+  return true;
+}
+
+void uring_buffer::close()
+{
+  pipe_buffer_base::close();
+
+  // No request may write into the buffer after we are gone.
+  if (_ring_fd != -1)
+    drain();
+
+  if (_sqes != MAP_FAILED)
+    munmap(_sqes,_sqes_size);
+  if (_cq_ring != MAP_FAILED &&
+      _cq_ring != _sq_ring)
+    munmap(_cq_ring,_cq_ring_size);
+  if (_sq_ring != MAP_FAILED)
+    munmap(_sq_ring,_sq_ring_size);
+
+  _sqes    = (struct io_uring_sqe *) MAP_FAILED;
+  _cq_ring = MAP_FAILED;
+  _sq_ring = MAP_FAILED;
+
+  if (_ring_fd != -1)
+    ::close(_ring_fd);
+  _ring_fd = -1;
+
+  if (_event_fd != -1)
+    ::close(_event_fd);
+  _event_fd = -1;
+
+  if (_fd != -1 &&
+      ::close(_fd) == -1)
+    {
+      perror("close()");
+      exit(1);
+    }
+  _fd = -1;
+}
+
+#endif//HAVE_IO_URING
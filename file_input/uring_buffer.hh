@@ -0,0 +1,128 @@
+/* This file is part of UCESB - a tool for data unpacking and processing.
+ *
+ * Copyright (C) 2016  Haakan T. Johansson  <f96hajo@chalmers.se>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301  USA
+ */
+
+#ifndef __URING_BUFFER_HH__
+#define __URING_BUFFER_HH__
+
+#include "pipe_buffer.hh"
+
+#ifdef HAVE_IO_URING
+
+#include <linux/io_uring.h>
+#include <sys/uio.h>
+
+#define URING_QUEUE_DEPTH  32       // must be power of 2
+#define URING_CHUNK_SIZE   0x100000 // 1 MB per read request (max)
+
+#define URING_SLOT_PENDING (-((ssize_t) 1 << 30)) // not an -errno
+
+struct uring_slot
+{
+  size_t  _start;  // stream offset of the request
+  size_t  _length;
+  ssize_t _result; // bytes read, -errno, or URING_SLOT_PENDING
+
+  struct iovec _iov; // only used when the buffer could not be registered
+};
+
+// Read a (regular) file with many asynchronous requests in flight.
+// The data ends up in the ring buffer of pipe_buffer_base, so the
+// consumer side (map_range/release_to) is unchanged.  Requests are
+// issued in stream order, and _avail is only moved forward over the
+// completed prefix, as completions may arrive out of order.
+
+class uring_buffer
+  : public pipe_buffer_base
+{
+public:
+  uring_buffer();
+  virtual ~uring_buffer();
+
+public:
+  int _fd;
+
+protected:
+  int _ring_fd;
+  int _event_fd;
+
+  // The rings shared with the kernel
+  void   *_sq_ring;
+  size_t  _sq_ring_size;
+  void   *_cq_ring;
+  size_t  _cq_ring_size;
+
+  struct io_uring_sqe *_sqes;
+  size_t               _sqes_size;
+
+  unsigned *_sq_tail;
+  unsigned *_sq_mask;
+  unsigned *_sq_array;
+
+  unsigned *_cq_head;
+  unsigned *_cq_tail;
+  unsigned *_cq_mask;
+  struct io_uring_cqe *_cqes;
+
+  bool      _fixed_buffer; // buffer registered, use READ_FIXED
+
+protected:
+  uring_slot _slots[URING_QUEUE_DEPTH];
+
+  unsigned _slot_first;  // oldest request not yet retired
+  unsigned _slot_next;   // next request to issue
+  unsigned _inflight;    // requests without completion
+  unsigned _to_submit;   // prepared, but not yet handed to the kernel
+
+  size_t   _submitted;   // stream offset up to which reads are issued
+  size_t   _chunk;       // size of each request
+
+  bool     _hit_eof;
+
+protected:
+  bool setup_ring();
+  void prepare_read(unsigned slot_no);
+  void submit_reads();
+  void enter(unsigned min_complete);
+  void harvest();
+  void retire();
+  void drain();
+
+#ifdef USE_PTHREAD
+public:
+  virtual void *reader();
+#else
+public:
+  virtual int read_now(off_t end);
+#endif
+
+public:
+  bool init(int fd,unsigned char *push_magic,size_t push_magic_len,
+	    size_t bufsize
+#ifdef USE_PTHREAD
+	    ,thread_block *block_reader
+#endif
+	    );
+  virtual void close();
+
+};
+
+#endif//HAVE_IO_URING
+
+#endif//__URING_BUFFER_HH__
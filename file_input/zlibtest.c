@@ -0,0 +1,8 @@
+#include <zlib.h>
+
+int main()
+{
+  z_stream zs;
+  inflateInit2(&zs,15 + 32);
+  return 0;
+}
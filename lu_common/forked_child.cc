@@ -40,6 +40,8 @@
 #include <sched.h>
 #endif
 
+void (*forked_child::_child_init)() = NULL;
+
 forked_child::forked_child()
 {
   _child  = 0;
@@ -86,6 +88,9 @@ forked_child::fork(const char *file,const char *const argv[],
     {
       // This is the child process
 
+      if (_child_init)
+	_child_init();
+
       // File handle that the child reads (STDIN), parent writes
 
       if (fork_pipes || fd_src == -1)
@@ -63,6 +63,11 @@ public:
 	    int *exit_status = NULL);
   void close_fds();
 
+public:
+  // Called first in each child process (e.g. to reset the CPU
+  // affinity inherited from the parent thread), if set.
+  static void (*_child_init)();
+
 };
 
 size_t full_write(int fd,const void *buf,size_t count);
@@ -0,0 +1,273 @@
+/* This file is part of UCESB - a tool for data unpacking and processing.
+ *
+ * Copyright (C) 2016  Haakan T. Johansson  <f96hajo@chalmers.se>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301  USA
+ */
+
+
+#include "arena_chunk.hh"
+
+#include "error.hh"
+
+#include <sys/mman.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdio.h>
+
+#ifdef USE_PTHREAD
+#include <pthread.h>
+#endif
+
+// A released chunk, kept for reuse.  The header lives in the (free)
+// chunk itself.
+
+struct arena_free_chunk
+{
+  size_t            _size;
+  arena_free_chunk *_next;
+};
+
+struct arena_free_list
+{
+  arena_free_chunk *_first;
+  size_t            _size;
+};
+
+struct arena_chunk_stat
+{
+  size_t   _in_use;     // handed out
+  size_t   _in_use_max;
+  size_t   _held;       // handed out + on free list
+  size_t   _held_max;
+  size_t   _hugetlb;    // mapped from reserved huge pages (total)
+  uint64_t _fresh;
+  uint64_t _reused;
+  uint64_t _released;
+};
+
+static bool              _arena_no_hugetlb = false;
+
+static arena_chunk_stat  _arena_stat;
+
+// The lock protects the statistics, and the free list when there is
+// no thread local storage.
+
+#ifdef USE_PTHREAD
+static pthread_mutex_t _arena_lock = PTHREAD_MUTEX_INITIALIZER;
+#define ARENA_LOCK   pthread_mutex_lock(&_arena_lock)
+#define ARENA_UNLOCK pthread_mutex_unlock(&_arena_lock)
+#else
+#define ARENA_LOCK   do { } while (0)
+#define ARENA_UNLOCK do { } while (0)
+#endif
+
+#if defined(USE_PTHREAD) && defined(HAVE_THREAD_LOCAL_STORAGE)
+static __thread arena_free_list _arena_free = { NULL, 0 };
+#define ARENA_FREE_LOCK   do { } while (0)
+#define ARENA_FREE_UNLOCK do { } while (0)
+#else
+static arena_free_list _arena_free = { NULL, 0 };
+#define ARENA_FREE_LOCK   ARENA_LOCK
+#define ARENA_FREE_UNLOCK ARENA_UNLOCK
+#endif
+
+// The size a chunk really has.  Must give the same result when
+// applied again, as the free function gets the rounded size.  The
+// kind (mapped or malloc) is decided on the rounded size, such that
+// the free sees the same kind.
+
+static size_t arena_chunk_round(size_t size)
+{
+  size = (size + (ARENA_CHUNK_ALIGN-1)) & ~(size_t) (ARENA_CHUNK_ALIGN-1);
+
+  if (size >= ARENA_CHUNK_HUGE_MIN)
+    size = (size + (ARENA_CHUNK_HUGE_PAGE-1)) &
+      ~(size_t) (ARENA_CHUNK_HUGE_PAGE-1);
+
+  return size;
+}
+
+static void *arena_chunk_map(size_t size)
+{
+  void *ptr;
+
+#if defined(MAP_HUGETLB) && defined(MAP_HUGE_SHIFT)
+  // Only works if the administrator has reserved huge pages.  Once it
+  // has failed, do not try again.
+  if (!_arena_no_hugetlb)
+    {
+      ptr = mmap(NULL,size,PROT_READ | PROT_WRITE,
+		 MAP_PRIVATE | MAP_ANONYMOUS |
+		 MAP_HUGETLB | (21 << MAP_HUGE_SHIFT) /* 2 MB */,-1,0);
+
+      if (ptr != MAP_FAILED)
+	{
+	  _arena_stat._hugetlb += size;
+	  return ptr;
+	}
+      _arena_no_hugetlb = true;
+    }
+#endif
+
+  // Map one huge page extra, such that the chunk can be placed on a
+  // huge page boundary, and let the kernel use transparent huge pages.
+
+  size_t map_size = size + ARENA_CHUNK_HUGE_PAGE;
+
+  char *map = (char *) mmap(NULL,map_size,PROT_READ | PROT_WRITE,
+			    MAP_PRIVATE | MAP_ANONYMOUS,-1,0);
+
+  if (map == MAP_FAILED)
+    return NULL;
+
+  char *start =
+    (char *) (((uintptr_t) map + (ARENA_CHUNK_HUGE_PAGE-1)) &
+	      ~(uintptr_t) (ARENA_CHUNK_HUGE_PAGE-1));
+  char *end = start + size;
+
+  if (start != map)
+    munmap(map,(size_t) (start - map));
+  if (end != map + map_size)
+    munmap(end,(size_t) (map + map_size - end));
+
+#ifdef MADV_HUGEPAGE
+  madvise(start,size,MADV_HUGEPAGE);
+#endif
+
+  return start;
+}
+
+void *arena_chunk_alloc(size_t size,size_t *got)
+{
+  size_t rsize = arena_chunk_round(size);
+  void *ptr = NULL;
+  bool fresh = false;
+
+  ARENA_FREE_LOCK;
+
+  // Take a free chunk if one is large enough, but not wastefully so.
+  // (A chunk up to twice the size is of the same kind.)
+
+  for (arena_free_chunk **prev = &_arena_free._first; *prev;
+       prev = &((*prev)->_next))
+    {
+      arena_free_chunk *fc = *prev;
+
+      if (fc->_size >= rsize && fc->_size <= 2 * rsize)
+	{
+	  *prev = fc->_next;
+	  _arena_free._size -= fc->_size;
+
+	  rsize = fc->_size;
+	  ptr = fc;
+	  break;
+	}
+    }
+
+  ARENA_FREE_UNLOCK;
+
+  ARENA_LOCK;
+
+  if (!ptr)
+    {
+      if (rsize >= ARENA_CHUNK_HUGE_MIN)
+	ptr = arena_chunk_map(rsize);
+      else if (posix_memalign(&ptr,ARENA_CHUNK_ALIGN,rsize) != 0)
+	ptr = NULL;
+      fresh = true;
+    }
+
+  if (ptr)
+    {
+      if (fresh)
+	{
+	  _arena_stat._fresh++;
+	  _arena_stat._held += rsize;
+	  if (_arena_stat._held > _arena_stat._held_max)
+	    _arena_stat._held_max = _arena_stat._held;
+	}
+      else
+	_arena_stat._reused++;
+
+      _arena_stat._in_use += rsize;
+      if (_arena_stat._in_use > _arena_stat._in_use_max)
+	_arena_stat._in_use_max = _arena_stat._in_use;
+    }
+
+  ARENA_UNLOCK;
+
+  if (!ptr)
+    ERROR("Memory allocation failure!");
+
+  *got = rsize;
+  return ptr;
+}
+
+void arena_chunk_free(void *ptr,size_t size)
+{
+  size_t rsize = arena_chunk_round(size);
+  bool kept = false;
+
+  ARENA_FREE_LOCK;
+
+  if (_arena_free._size + rsize <= ARENA_CHUNK_KEEP_FREE)
+    {
+      arena_free_chunk *fc = (arena_free_chunk *) ptr;
+
+      fc->_size = rsize;
+      fc->_next = _arena_free._first;
+      _arena_free._first = fc;
+      _arena_free._size += rsize;
+      kept = true;
+    }
+
+  ARENA_FREE_UNLOCK;
+
+  ARENA_LOCK;
+
+  _arena_stat._in_use -= rsize;
+
+  if (!kept)
+    {
+      _arena_stat._held -= rsize;
+      _arena_stat._released++;
+    }
+
+  ARENA_UNLOCK;
+
+  if (kept)
+    return;
+
+  if (rsize >= ARENA_CHUNK_HUGE_MIN)
+    munmap(ptr,rsize);
+  else
+    free(ptr);
+}
+
+void arena_chunk_stats()
+{
+  INFO(0,"Buffer arenas: max %" PRIu64 " kB in use, "
+       "max %" PRIu64 " kB held (%" PRIu64 " kB huge pages), "
+       "chunks: %" PRIu64 " new, %" PRIu64 " reused, "
+       "%" PRIu64 " released.",
+       (uint64_t) (_arena_stat._in_use_max >> 10),
+       (uint64_t) (_arena_stat._held_max >> 10),
+       (uint64_t) (_arena_stat._hugetlb >> 10),
+       _arena_stat._fresh,
+       _arena_stat._reused,
+       _arena_stat._released);
+}
@@ -0,0 +1,51 @@
+/* This file is part of UCESB - a tool for data unpacking and processing.
+ *
+ * Copyright (C) 2016  Haakan T. Johansson  <f96hajo@chalmers.se>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301  USA
+ */
+
+
+#ifndef __ARENA_CHUNK_HH__
+#define __ARENA_CHUNK_HH__
+
+#include <stdlib.h>
+
+// Backing memory for the thread_buffer and keep_buffer_many arenas.
+//
+// Chunks are 64-byte (cache line) aligned.  Large chunks are mapped
+// directly, from huge pages if any are reserved (MAP_HUGETLB), else
+// 2 MB aligned with transparent huge pages requested.  Released
+// chunks are kept on a free list of the releasing thread, for its own
+// reuse, instead of going back to malloc.  Per thread, since the pages
+// are placed (first touch) on the NUMA node of the thread that used
+// them.
+
+#define ARENA_CHUNK_ALIGN       64
+#define ARENA_CHUNK_HUGE_PAGE   0x200000  // 2 MB
+#define ARENA_CHUNK_HUGE_MIN    0x100000  // larger requests get huge pages
+#define ARENA_CHUNK_KEEP_FREE   0x4000000 // 64 MB at most kept (per thread)
+
+// Returns a chunk of at least size bytes.  The usable size (that
+// shall be given back to arena_chunk_free) is returned in *got.
+void *arena_chunk_alloc(size_t size,size_t *got);
+
+void arena_chunk_free(void *ptr,size_t size);
+
+// Print the high-water marks of the arena memory.
+void arena_chunk_stats();
+
+#endif//__ARENA_CHUNK_HH__
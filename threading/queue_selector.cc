@@ -20,68 +20,109 @@
 
 #include "queue_selector.hh"
 
+queue_selector::queue_selector()
+{
+  _queue  = NULL;
+  _queues = 0;
+  _slots  = 0;
 
-int queue_selector::next_queue()
+  _current      = 0;
+  _current_left = 0;
+  _bunches      = 1;
+}
+
+queue_selector::~queue_selector()
 {
-  // until things work: simple round-robin
+  delete[] _queue;
+}
+
+void queue_selector::init(multi_thread_queue_base *queues,
+			  int num_queues,int slots)
+{
+  delete[] _queue;
 
-  _current++;
+  _queues = num_queues;
+  _slots  = slots;
 
-  return _current;
+  _queue = new thread_queue_base*[(size_t) num_queues];
 
-#if 0
-  if (likely(!_drained))
+  for (int i = 0; i < num_queues; i++)
+    _queue[i] = queues->get_queue(i);
+
+  _current      = 0;
+  _current_left = 0;
+  _bunches      = 1;
+}
+
+int queue_selector::next_queue()
+{
+  // Stay with the current queue until the bunch is used up.  Since
+  // we only are looking at the free slots when the bunch was
+  // started, the queue should not be full (unless the consumer is
+  // stuck, then nothing else would help either).
+
+  if (LIKELY(_current_left > 0))
     {
       _current_left--;
-
-      if (likely(_current_left))
-	return _current;
+      return _current;
     }
 
   // Go over the queues and find out who is in most need of more events.
   // If we find anyone being empty, we'll enqueue events into that one, without
-  // further looking into the other ones
+  // further looking into the other ones.  Start with the one after the
+  // current, such that equally loaded queues are used round-robin.
+
+  int min_fill  = _slots;
+  int min_queue = _current;
+  bool idle = false;
 
-  for (int i = 0; i < _queues; i++)
+  for (int j = 1; j <= _queues; j++)
     {
-      // Find out the status of the queue, how many events are in the queue
+      int i = (_current + j) % _queues;
 
-      int items = queue[i]->fill();
+      int items = fill(i);
 
-      if (unlikely(!items))
+      if (UNLIKELY(!items))
 	{
-	  _bunches >>= 3; // send fewer items per queue (restart the round robin)
-
-	  _current_left = _bunches;
-
-	  // but do not try to emit more elements than the queue has free slots!
-	  // (avoid unnecessary stops)
-
-	  int free_slots = queue[i]->slots() - items - 1 /* the one given now*/;
-
-	  _current_left = (_bunches < free_slots) ? _bunches ? free_slots;
-	  return _current = i;
+	  min_fill  = 0;
+	  min_queue = i;
+	  idle = true;
+	  break;
 	}
 
-      // Compare the number of elements in the queue to the desired
-      // fill factor, i.e. a queue that we do not want to give so much
-      // work (because it also has other tasks)
-
-      // Now for the 'queue' that fills into our own thread, there
-      // will never be any entries, as we would process the events
-      // directly, and send them along to the next stage...
-
-      int factor = items / fraction[i];
-
-      if (factor > min_factor)
-	continue;
+      if (items < min_fill)
+	{
+	  min_fill  = items;
+	  min_queue = i;
+	}
+    }
 
-      min_factor = factor;
+  if (idle)
+    {
+      // Somebody ran out of work: send fewer items per queue, such that
+      // work gets spread out quicker.
+      _bunches >>= 1;
+      if (_bunches < 1)
+	_bunches = 1;
+    }
+  else if (min_fill >= 2 * _bunches)
+    {
+      // Everyone has a backlog of several bunches.  Larger bunches
+      // then cost nothing in latency, but make each consumer
+      // switch less between the data of different producers.
+      _bunches <<= 1;
+      if (_bunches > QUEUE_SELECTOR_MAX_BUNCH)
+	_bunches = QUEUE_SELECTOR_MAX_BUNCH;
+    }
 
-      // Now that
+  // But do not try to emit more elements than the queue has free
+  // slots!  (avoid unnecessary stops)
 
+  int free_slots = _slots - min_fill;
+  int bunch = (_bunches < free_slots) ? _bunches : free_slots;
 
-    }
-#endif
+  _current = min_queue;
+  _current_left = bunch - 1 /* the one given now */;
 
+  return _current;
 }
@@ -21,8 +21,27 @@
 #ifndef __QUEUE_SELECTOR_HH__
 #define __QUEUE_SELECTOR_HH__
 
+#include "thread_queue.hh"
+
+// Decide which of the queues of a fan-out the next item shall go to.
+// Consecutive items are given in bunches to the same queue (such that
+// the consumer works on data it is likely to have in cache), and the
+// bunch size is adapted from how full the queues are: an idle
+// consumer makes the bunches smaller, while all consumers having a
+// backlog make them larger.
+
+#define QUEUE_SELECTOR_MAX_BUNCH  64
+
 class queue_selector
 {
+public:
+  queue_selector();
+  ~queue_selector();
+
+public:
+  thread_queue_base **_queue;
+  int _queues;       // Number of queues
+  int _slots;        // Items per queue (power of 2)
 
 public:
   int _current;      // The queue that we currently want to issue events to
@@ -31,8 +50,17 @@ public:
   int _bunches;      // Number of events to throw into each queue
 
 public:
+  void init(multi_thread_queue_base *queues,int num_queues,int slots);
+
   int next_queue();
 
+protected:
+  int fill(int i) const
+  {
+    const thread_queue_base *q = _queue[i];
+
+    return (q->_avail - q->_done) & (2 * _slots - 1);
+  }
 
 };
 
@@ -58,7 +58,7 @@ void reclaim_items(reclaim_item *first)
 	  {
 	    tb_reclaim *tbr = (tb_reclaim*) item;
 
-	    tbr->_buffer->reclaim(tbr->_reclaim);
+	    tbr->_buffer->reclaim(tbr->_chunk,tbr->_reclaim);
 	  }
 	  break;
 	case RECLAIM_MMAP_RELEASE_TO:
@@ -66,7 +66,7 @@ void reclaim_items(reclaim_item *first)
 	    fmm_reclaim *fmmr = (fmm_reclaim*) item;
 
 	    fmmr->_mm->release_to(fmmr->_end);
-	    fmmr->_buffer->reclaim(fmmr->_reclaim);
+	    fmmr->_buffer->reclaim(fmmr->_chunk,fmmr->_reclaim);
 	  }
 	  break;
 	case RECLAIM_PBUF_RELEASE_TO:
@@ -74,7 +74,7 @@ void reclaim_items(reclaim_item *first)
 	    pbf_reclaim *pbfr = (pbf_reclaim*) item;
 
 	    pbfr->_pb->release_to(pbfr->_end);
-	    pbfr->_buffer->reclaim(pbfr->_reclaim);
+	    pbfr->_buffer->reclaim(pbfr->_chunk,pbfr->_reclaim);
 	  }
 	  break;
 	default:
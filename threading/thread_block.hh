@@ -27,6 +27,13 @@
 #include <assert.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#ifdef HAVE_FUTEX
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
 
 #include "error.hh"
 #include "optimise.hh"
@@ -42,6 +49,20 @@
 #define IF_USE_PTHREAD(x)
 #endif
 
+// When futex(2) is available, a thread that only waits for a wakeup
+// (no other file descriptors) sleeps on _state instead of in select()
+// on the pipe.  A plain wakeup (token 0) then only costs an atomic
+// operation if the thread is awake, and one futex() call otherwise.
+// Wakeups with a token value, and wakeups of a thread that sleeps in
+// select() still go through the pipe.
+
+#define THREAD_BLOCK_PENDING       0x01 // wakeup not yet seen by owner
+#define THREAD_BLOCK_SLEEP_FUTEX   0x02 // owner sleeps in futex()
+#define THREAD_BLOCK_SLEEP_SELECT  0x04 // owner sleeps in select()
+
+// Number of rounds to check for a wakeup before going to sleep
+#define THREAD_BLOCK_SPIN          2000
+
 class thread_block
 {
 public:
@@ -51,6 +72,17 @@ public:
 
     for (int i = 0; i < 2; i++)
       _fd_wakeup[i] = -1;
+
+    _state = 0;
+    _piped = 0;
+    _spin  = 0;
+
+    _wakeup_stamp = 0;
+
+    _stat_sleeps  = 0;
+    _stat_spun    = 0;
+    _stat_wakeups = 0;
+    _stat_wake_ns = 0;
   }
 
   ~thread_block()
@@ -64,6 +96,23 @@ public:
   //bool _need_wakeup;
   int  _fd_wakeup[2];
 
+protected:
+  mutable volatile int _state;  // THREAD_BLOCK_xxx
+  mutable volatile int _piped;  // tokens written to the pipe, not read
+  int                  _spin;
+
+  mutable volatile uint64_t _wakeup_stamp; // when a sleeper was woken (ns)
+
+  // The above is written by the wakers, the below by the owner
+  CACHE_LINE_PAD(_pad_stat);
+
+public:
+  // Statistics, only for diagnostic purposes (thread_info)
+  mutable volatile uint64_t _stat_sleeps;  // times gone to sleep in kernel
+  mutable volatile uint64_t _stat_spun;    // wakeups caught while spinning
+  mutable volatile uint64_t _stat_wakeups; // wakeups from kernel sleep
+  mutable volatile uint64_t _stat_wake_ns; // total latency of those (ns)
+
 public:
   void init()
   {
@@ -75,9 +124,38 @@ public:
 	ERROR("Error creating pipe.");
       }
 
+    // Spinning is pointless if the waker cannot run meanwhile
+    if (sysconf(_SC_NPROCESSORS_ONLN) > 1)
+      _spin = THREAD_BLOCK_SPIN;
+
     TDBG("rd:%d wr:%d",_fd_wakeup[0],_fd_wakeup[1]);
    }
 
+protected:
+  static uint64_t now_ns()
+  {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+
+    return (uint64_t) ts.tv_sec * 1000000000 + (uint64_t) ts.tv_nsec;
+  }
+
+  void account_wakeup() const
+  {
+    uint64_t stamp = _wakeup_stamp;
+
+    if (!stamp)
+      return;
+
+    uint64_t now = now_ns();
+
+    _wakeup_stamp = 0;
+    _stat_wakeups++;
+    if (now > stamp)
+      _stat_wake_ns += now - stamp;
+  }
+
   ////////////////////////////////////////////////////////
   // Called by the thread itself:
 public:
@@ -92,6 +170,9 @@ public:
     if (nfd < _fd_wakeup[0])
       nfd = _fd_wakeup[0];
 
+    // Any wakeup must from now on be delivered through the pipe
+    __sync_fetch_and_or(&_state,THREAD_BLOCK_SLEEP_SELECT);
+
     return nfd;
   }
 
@@ -100,12 +181,30 @@ public:
   {
     TDBG("nfd:%d",nfd);
 
+#ifdef HAVE_FUTEX
+    if (nfd == -1)
+      return block_futex(timeout); // nothing else to wait for
+#endif
+
     nfd = setup_select(nfd,readfds);
 
+    struct timeval no_wait = { 0, 0 };
+
+    if (_state & THREAD_BLOCK_PENDING)
+      {
+	// Wakeup came before we announced the select(), so only
+	// check the status of the other file descriptors.
+	timeout = &no_wait;
+      }
+    else
+      _stat_sleeps++;
+
     TDBG("nfd:%d",nfd);
 
     int n = select(nfd+1,readfds,NULL,NULL,timeout);
 
+    __sync_fetch_and_and(&_state,~THREAD_BLOCK_SLEEP_SELECT);
+
     if (n == -1)
       {
 	if (errno == EINTR)
@@ -127,15 +226,106 @@ public:
 
     if (!FD_ISSET(_fd_wakeup[0],readfds))
       {
+	if (_state & THREAD_BLOCK_PENDING)
+	  return consume_wakeup();
+
 	TDBG("timeout");
 	return 0;
       }
 
     // There is data available in the readout buffer
 
+    account_wakeup();
+
     return get_token();
   }
 
+#ifdef HAVE_FUTEX
+protected:
+  int block_futex(struct timeval *timeout) const
+  {
+    // Tokens from earlier wakeups are handed out first
+    if (_piped > 0)
+      return consume_wakeup();
+
+    // The wakeup is often just around the corner (the other end of
+    // a queue is working on it), so check a while before sleeping.
+
+    for (int i = 0; i < _spin; i++)
+      {
+	if (_state & THREAD_BLOCK_PENDING)
+	  {
+	    _stat_spun++;
+	    return consume_wakeup();
+	  }
+	CPU_RELAX;
+      }
+
+    struct timespec ts;
+    struct timespec *pts = NULL;
+
+    if (timeout)
+      {
+	ts.tv_sec  = timeout->tv_sec;
+	ts.tv_nsec = timeout->tv_usec * 1000;
+	pts = &ts;
+      }
+
+    int state =
+      __sync_fetch_and_or(&_state,THREAD_BLOCK_SLEEP_FUTEX) |
+      THREAD_BLOCK_SLEEP_FUTEX;
+
+    if (!(state & THREAD_BLOCK_PENDING))
+      _stat_sleeps++;
+
+    while (!(state & THREAD_BLOCK_PENDING))
+      {
+	TDBG("futex wait");
+
+	if (syscall(SYS_futex,&_state,FUTEX_WAIT_PRIVATE,state,
+		    pts,NULL,0) == -1)
+	  {
+	    // Like with select(): act as if we were waked up
+	    if (errno == ETIMEDOUT ||
+		errno == EINTR)
+	      break;
+	    if (errno != EAGAIN)
+	      {
+		perror("futex()");
+		// This error is fatal, since it should not happen
+		exit(1);
+	      }
+	  }
+	state = _state;
+      }
+
+    __sync_fetch_and_and(&_state,~THREAD_BLOCK_SLEEP_FUTEX);
+
+    if (!(_state & THREAD_BLOCK_PENDING))
+      {
+	TDBG("timeout");
+	return 0;
+      }
+
+    account_wakeup();
+
+    return consume_wakeup();
+  }
+#endif
+
+protected:
+  int consume_wakeup() const
+  {
+    __sync_fetch_and_and(&_state,~THREAD_BLOCK_PENDING);
+
+    // A token with a value may be waiting in the pipe
+    if (_piped > 0)
+      return get_token();
+
+    return 0;
+  }
+
+public:
   void block() const
   {
     fd_set rfds;
@@ -157,6 +347,9 @@ public:
 
   int get_token() const
   {
+    // Whatever wakeup was pending, we are awake now
+    __sync_fetch_and_and(&_state,~THREAD_BLOCK_PENDING);
+
     for ( ; ; )
       {
 	int token;
@@ -169,7 +362,10 @@ public:
 	       !((size_t) n & (sizeof(token)-1))); // even multiple of token (which must be power of 2)
 
 	if (n >= 1)
-	  return token;
+	  {
+	    __sync_fetch_and_sub(&_piped,1);
+	    return token;
+	  }
 
 	if (n == -1)
 	  {
@@ -200,6 +396,34 @@ public:
 
     // SFENCE;
 
+    if (token)
+      write_token(token); // must be in the pipe before we flag it
+
+    int state = __sync_fetch_and_or(&_state,THREAD_BLOCK_PENDING);
+
+    if (state & THREAD_BLOCK_PENDING)
+      return; // not seen yet, i.e. the owner is already being woken
+
+    if (state & THREAD_BLOCK_SLEEP_FUTEX)
+      {
+#ifdef HAVE_FUTEX
+	_wakeup_stamp = now_ns();
+	syscall(SYS_futex,&_state,FUTEX_WAKE_PRIVATE,1,NULL,NULL,0);
+#endif
+	return;
+      }
+
+    if (!token &&
+	(state & THREAD_BLOCK_SLEEP_SELECT))
+      {
+	_wakeup_stamp = now_ns();
+	write_token(token);
+      }
+  }
+
+protected:
+  void write_token(int token) const
+  {
     // Write one token to wake the thread up
 
     for ( ; ; )
@@ -222,10 +446,10 @@ public:
 	fprintf (stderr,"Failed to write to wakeup pipe.  DEADLOCK\n");
 	abort();
       }
+
+    __sync_fetch_and_add(&_piped,1);
   }
 
 };
 
 #endif//__THREAD_BLOCK_HH__
-
-
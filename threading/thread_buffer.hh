@@ -37,6 +37,7 @@
 #include "reclaim.hh"
 #include "worker_thread.hh"
 #include "error.hh"
+#include "arena_chunk.hh"
 #endif
 
 #include <stdlib.h>
@@ -44,21 +45,32 @@
 #ifdef USE_THREADING
 
 class thread_buffer;
+struct tb_buf;
 
 struct tb_reclaim
   : public reclaim_item
 {
   thread_buffer *_buffer;
+  tb_buf        *_chunk;
   size_t         _reclaim;
 };
 
+// Items are not necessarily reclaimed in the order they were
+// allocated (a stolen event is retired in the order of its owner),
+// so the reclaimed space is counted per buffer.  A buffer may be
+// reused once everything allocated from it has been reclaimed.
+
 struct tb_buf
 {
   size_t   _size;
   tb_buf  *_next;
 
+  size_t   _sealed;    // bytes allocated, set when no longer _cur
+  volatile size_t _freed; // ONLY updated by reclaim (except reset)
 };
 
+#define TB_BUF_NOT_SEALED  ((size_t) -1)
+
 class thread_buffer
 {
 public:
@@ -75,15 +87,16 @@ public:
 
     // Allocate a dummy buffer, such that _cur is non-NULL
 
-    _cur = (tb_buf *) malloc(sizeof(tb_buf));
+    size_t got;
 
-    if (!_cur)
-      ERROR("Memory allocation failure!");
+    _cur = (tb_buf *) arena_chunk_alloc(sizeof(tb_buf),&got);
 
     _total += 0;
 
     _cur->_next = _cur;
     _cur->_size = sizeof(tb_buf);
+    _cur->_sealed = TB_BUF_NOT_SEALED;
+    _cur->_freed = 0;
 
     _cur_used = sizeof(tb_buf);
   }
@@ -94,13 +107,13 @@ public:
 
   size_t _allocated;
   size_t _reclaimed; // ONLY updated by reclaim (and then only
-		     // growing)
+		     // growing), for statistics
 
   size_t _total; // total memory in our buffers
   size_t _alloc_size;
 
 public:
-  void *allocate(size_t size,size_t *reclaim)
+  void *allocate(size_t size,tb_buf **chunk,size_t *reclaim)
   {
     // Make sure we are never more misaligned than 8 bytes (for double)
     // TODO: other archs may want larger, like PPU/SPU
@@ -118,6 +131,7 @@ public:
 	_cur_used += size;
 	_allocated += size;
 
+	*chunk = _cur;
 	*reclaim = size;
 #if DEBUG_THREAD_BUFFER
 	printf ("AVAIL:      %d (%d [%p]) (%d,%d,%d)\n",(int) size,(int) *reclaim,ptr,
@@ -128,13 +142,12 @@ public:
       }
 
     // We could not get the needed size from the allocated buffer,
-    // so it has been wasted.  But the wasted space will be returned when we free
-    // up the associated item
+    // so the remainder is wasted.  The buffer is done, and is free
+    // again when what was allocated from it has been reclaimed.
 
-    _allocated += _cur->_size - _cur_used;
-    *reclaim = _cur->_size - _cur_used;
+    _cur->_sealed = _cur_used - sizeof(tb_buf);
 #if DEBUG_THREAD_BUFFER
-    printf ("addRECLAIM:     (%d)\n",(int) *reclaim);
+    printf ("SEALED:     (%d)\n",(int) _cur->_sealed);
 #endif
     // Now, we are very much thinking about advancing the _cur ptr to _cur->_next
     // but this is ONLY allowed if that entire buffer has been reclaimed!
@@ -143,9 +156,7 @@ public:
       {
 	tb_buf *next = _cur->_next;
 
-	size_t reclaimed_size = _total - _allocated + _reclaimed;
-
-	if (reclaimed_size < next->_size ||
+	if (next->_freed != next->_sealed ||
 	    next == _cur) // this is not only needed at startup!
 	  {
 	    // We may NOT advance, next buffer is not completely
@@ -169,18 +180,22 @@ public:
 		     next,
 		     (int) _allocated,(int) _reclaimed,(int) (_allocated-_reclaimed),(int) _total);
 #endif
-	    free(next);
+	    arena_chunk_free(next,next->_size);
 	    continue; // so, try again
 	  }
 
-	// Ok, so buffer next is free, and has space enough, move there
+	// Ok, so buffer next is free, and has space enough, move there.
+	// Nothing in it is pending reclaim, so we may reset the count.
 
 	_cur = next;
+	_cur->_sealed = TB_BUF_NOT_SEALED;
+	_cur->_freed = 0;
 	_cur_used = sizeof(tb_buf) + size;
 
 	_allocated += size;
 
-	*reclaim += size;
+	*chunk = _cur;
+	*reclaim = size;
 	void *ptr = ((char*) _cur) + sizeof(tb_buf);
 
 #if DEBUG_THREAD_BUFFER
@@ -202,22 +217,27 @@ public:
     else
       _alloc_size &= ~0xff;
 
-    tb_buf *new_bfr = (tb_buf *) malloc(_alloc_size);
+    // The chunk may be larger than asked for (huge page rounding, or
+    // a larger one reused), then use all of it.
 
-    if (!new_bfr)
-      ERROR("Memory allocation failure!");
+    size_t got;
 
-    _total += _alloc_size - sizeof(tb_buf);
+    tb_buf *new_bfr = (tb_buf *) arena_chunk_alloc(_alloc_size,&got);
 
-    new_bfr->_size = _alloc_size;
+    _total += got - sizeof(tb_buf);
+
+    new_bfr->_size = got;
     new_bfr->_next = _cur->_next;
+    new_bfr->_sealed = TB_BUF_NOT_SEALED;
+    new_bfr->_freed = 0;
     _cur->_next = new_bfr;
     _cur = new_bfr;
 
     _cur_used = sizeof(tb_buf) + size;
 
     _allocated += size;
-    *reclaim += size;
+    *chunk = _cur;
+    *reclaim = size;
 
     void *ptr = ((char*) _cur) + sizeof(tb_buf);
 #if DEBUG_THREAD_BUFFER
@@ -234,15 +254,17 @@ public:
   //#ifndef TEST_THREAD_BUFFER
   void *allocate_reclaim(size_t size,uint32 type = RECLAIM_THREAD_BUFFER_ITEM)
   {
+    tb_buf *chunk;
     size_t reclaim;
 
-    void *ptr = allocate(sizeof (tb_reclaim) + size,&reclaim);
+    void *ptr = allocate(sizeof (tb_reclaim) + size,&chunk,&reclaim);
 
     tb_reclaim *tbr = (tb_reclaim *) ptr;
 
     tbr->_type = type;
     tbr->_next = NULL;
     tbr->_buffer = this;
+    tbr->_chunk = chunk;
     tbr->_reclaim = reclaim;
 
     *(_wt._last_reclaim) =   tbr;
@@ -304,15 +326,17 @@ public:
   template<typename T>
   T *allocate_reclaim_item(uint32 type = RECLAIM_THREAD_BUFFER_ITEM)
   {
+    tb_buf *chunk;
     size_t reclaim;
 
-    void *ptr = allocate(sizeof (T),&reclaim);
+    void *ptr = allocate(sizeof (T),&chunk,&reclaim);
 
     T *tbr = (T *) ptr;
 
     tbr->_type = type;
     tbr->_next = NULL;
     tbr->_buffer = this;
+    tbr->_chunk = chunk;
     tbr->_reclaim = reclaim;
 
     *(_wt._last_reclaim) =   tbr;
@@ -322,11 +346,12 @@ public:
   }
 
 public:
-  void reclaim(size_t reclaim)
+  void reclaim(tb_buf *chunk,size_t reclaim)
   {
 #if DEBUG_THREAD_BUFFER
-    printf ("RECLAIM: %d (%d)\n",(int)reclaim,(int)_reclaimed);
+    printf ("RECLAIM: %d [%p] (%d)\n",(int)reclaim,chunk,(int)_reclaimed);
 #endif
+    chunk->_freed = chunk->_freed + reclaim;
     _reclaimed += reclaim;
   }
 
@@ -335,7 +360,10 @@ public:
 // Defined in error.cc
 void reclaim_eject_message(tb_reclaim *tbr);
 
-#else//!USE_THREADING
+#endif//USE_THREADING
+
+// Buffers owned by one user (without threading: the events; also
+// used by the lmd event builder to keep data between events).
 
 class keep_buffer_single
 {
@@ -398,11 +426,11 @@ protected:
   kbm_buf *new_buf(kbm_buf *next,size_t alloc)
   {
     // fprintf(stderr,"keep_buffer_many[%p]::new_buf(...,%d)\n",this,alloc);
-    kbm_buf *newbuf = (kbm_buf *) malloc(sizeof(kbm_buf) + alloc);
-    if (!newbuf)
-      ERROR("Memory allocation failure!");
+    size_t got;
+    kbm_buf *newbuf =
+      (kbm_buf *) arena_chunk_alloc(sizeof(kbm_buf) + alloc,&got);
     newbuf->_next = next;
-    newbuf->_size = alloc;
+    newbuf->_size = got - sizeof(kbm_buf); // usable, >= alloc
 
     return newbuf;
   }
@@ -425,7 +453,7 @@ public:
 	  {
 	    kbm_buf *r = f;
 	    f = f->_next;
-	    free(r);
+	    arena_chunk_free(r,sizeof(kbm_buf) + r->_size);
 	  }
 
 	// fprintf(stderr,"keep_buffer_many[%p]::release() -> %d\n",this,_allocated);
@@ -436,7 +464,7 @@ public:
     // Reset start pointer
 
     _end = (char*) (_first+1);
-    _remain = _allocated;
+    _remain = _first->_size;
   }
 
 public:
@@ -458,7 +486,7 @@ public:
 	_first = new_buf(_first,alloc);
 
 	_end = (char*) (_first+1);
-	_remain = alloc;
+	_remain = _first->_size;
 	_allocated += alloc;
       }
 
@@ -471,8 +499,6 @@ public:
   }
 };
 
-#endif//!USE_THREADING
-
 #endif//__THREAD_BUFFER_HH__
 
 
@@ -497,30 +523,30 @@ int main(int argc,char *argv[])
   else
     n = 10000;
 
-  std::queue<size_t> to_reclaim;
+  std::queue<std::pair<tb_buf *,size_t> > to_reclaim;
 
   for (int i = 0; i < n; i++)
     {
       size_t size = 100;
+      tb_buf *chunk;
       size_t reclaim;
-      void   *ptr;
 
-      printf ("About to allocate: %d\n",size);
+      printf ("About to allocate: %d\n",(int) size);
       fflush(stdout);
 
-      _buffer.allocate(size,&reclaim,&ptr);
+      _buffer.allocate(size,&chunk,&reclaim);
 
-      to_reclaim.push(reclaim);
+      to_reclaim.push(std::make_pair(chunk,reclaim));
 
-      printf ("Did Allocate: %d (reclaim: %d)\n",size,reclaim);
+      printf ("Did Allocate: %d (reclaim: %d)\n",(int) size,(int) reclaim);
       fflush(stdout);
 
       if (i % 2 == 0)
 	{
-	  reclaim = to_reclaim.front();
+	  std::pair<tb_buf *,size_t> item = to_reclaim.front();
 	  to_reclaim.pop();
 
-	  _buffer.reclaim(reclaim);
+	  _buffer.reclaim(item.first,item.second);
 
 	}
     }
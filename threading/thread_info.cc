@@ -408,6 +408,38 @@ void thread_info::update()
       if (!thread->_worker)
 	continue;
 
+      // Rate and latency of wakeups (since last update)
+
+      const thread_block *block = &thread->_worker->_block;
+
+      uint64_t wakeups = block->_stat_wakeups;
+      uint64_t wake_ns = block->_stat_wake_ns;
+
+      timeval now;
+
+      gettimeofday(&now,NULL);
+
+      if (thread->_prev_time.tv_sec)
+	{
+	  double elapsed =
+	    (double) (now.tv_sec - thread->_prev_time.tv_sec) +
+	    1.e-6 * (double) (now.tv_usec - thread->_prev_time.tv_usec);
+	  uint64_t woken = wakeups - thread->_prev_wakeups;
+
+	  if (elapsed > 0)
+	    thread->_wakeups = (int) ((double) woken / elapsed);
+	  thread->_wakeup_lat = 0;
+	  if (woken)
+	    thread->_wakeup_lat = (float) (1.e-3 *
+					   (double) (wake_ns -
+						     thread->_prev_wake_ns) /
+					   (double) woken);
+	}
+
+      thread->_prev_wakeups = wakeups;
+      thread->_prev_wake_ns = wake_ns;
+      thread->_prev_time    = now;
+
       if (!thread->_worker->get_data())
 	continue;
 
@@ -23,6 +23,7 @@
 
 #include <sys/types.h>
 #include <sys/time.h>
+#include <stdint.h>
 
 // TODO: remove
 #include "input_buffer.hh"
@@ -114,6 +115,13 @@ struct ti_thread
   int _buf_used; // used size of thread's buffer
   int _buf_size; // total size of thread's buffer
 
+  int   _wakeups;     // wakeups from sleep per second
+  float _wakeup_lat;  // average latency of those wakeups (us)
+
+  uint64_t _prev_wakeups; // counters at previous update
+  uint64_t _prev_wake_ns;
+  timeval  _prev_time;
+
   ti_thread_task *_tasks; /* size: ti._num_tasks */
 };
 
@@ -307,7 +307,7 @@ void thread_info_window::display()
   wcolor_set(wthreads,COL_NORMAL,NULL);
   wmove(wthreads,0,0);
   //               "01234567890        20        30        40        50        60        70        8"
-  waddstr(wthreads,"Thr   Task k/s Buf  Task k/s Buf  Task k/s Buf  Task k/s Buf  TBuf      CPU");
+  waddstr(wthreads,"Thr   Wake/s Lat    Task k/s Buf  Task k/s Buf  Task k/s Buf  TBuf      CPU");
 
   for (int th = 0; th < _ti->_num_threads; th++)
     {
@@ -328,6 +328,13 @@ void thread_info_window::display()
       wadd_magi_str(wthreads,5,task->_speed,0);
       */
 
+      // Wakeups from sleep, and their latency (in us)
+
+      wmove(wthreads,th+1,6);
+      wadd_magi_str(wthreads,5,thread->_wakeups,0);
+      waddstr(wthreads," ");
+      wadd_mag_str(wthreads,4,thread->_wakeup_lat,0);
+
       wmove(wthreads,th+1,62);
       wadd_magi_str(wthreads,4,thread->_buf_used,0);
       waddstr(wthreads,"/");
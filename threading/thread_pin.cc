@@ -0,0 +1,257 @@
+/* This file is part of UCESB - a tool for data unpacking and processing.
+ *
+ * Copyright (C) 2016  Haakan T. Johansson  <f96hajo@chalmers.se>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301  USA
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // for sched_setaffinity
+#endif
+
+#include "thread_pin.hh"
+
+#include "error.hh"
+
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// One mask per slot, empty if the thread is not to be pinned.
+static cpu_set_t *_pin_mask = NULL;
+static int        _pin_slots = 0;
+
+// The mask we were started with, for what should not be pinned.
+static cpu_set_t  _pin_orig;
+static bool       _pin_any = false;
+
+// Parse a CPU list, as in /sys/devices/system/node/node0/cpulist.
+// Returns the CPUs in list order, and the number found (-1 if bad).
+
+static int parse_cpu_list(const char *list,int *cpus,int max_cpus)
+{
+  int n = 0;
+  const char *p = list;
+
+  while (*p && *p != '\n')
+    {
+      char *end;
+      long first = strtol(p,&end,10);
+      long last  = first;
+
+      if (end == p || first < 0)
+	return -1;
+      p = end;
+      if (*p == '-')
+	{
+	  p++;
+	  last = strtol(p,&end,10);
+	  if (end == p || last < first)
+	    return -1;
+	  p = end;
+	}
+      if (*p == ',')
+	p++;
+      else if (*p && *p != '\n')
+	return -1;
+
+      for (long cpu = first; cpu <= last; cpu++)
+	if (n < max_cpus && cpu < CPU_SETSIZE)
+	  cpus[n++] = (int) cpu;
+    }
+  return n;
+}
+
+// The node of each CPU, -1 if unknown (no NUMA info).
+
+static void read_cpu_nodes(int *node_of)
+{
+  for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+    node_of[cpu] = -1;
+
+  for (int node = 0; ; node++)
+    {
+      char filename[64];
+      char line[1024];
+
+      snprintf(filename,sizeof(filename),
+	       "/sys/devices/system/node/node%d/cpulist",node);
+
+      FILE *fid = fopen(filename,"r");
+
+      if (!fid)
+	break;
+
+      int cpus[CPU_SETSIZE];
+      int n = -1;
+
+      if (fgets(line,sizeof(line),fid))
+	n = parse_cpu_list(line,cpus,CPU_SETSIZE);
+      fclose(fid);
+
+      for (int i = 0; i < n; i++)
+	node_of[cpus[i]] = node;
+    }
+}
+
+void thread_pin_setup(const char *spec,int workers)
+{
+  if (!spec || strcmp(spec,"none") == 0)
+    return;
+
+  bool automatic = (strcmp(spec,"auto") == 0);
+
+  cpu_set_t allowed;
+
+  if (sched_getaffinity(0,sizeof(allowed),&allowed) != 0)
+    {
+      perror("sched_getaffinity");
+      return;
+    }
+
+  int *node_of = new int[CPU_SETSIZE];
+
+  read_cpu_nodes(node_of);
+
+  int *order = new int[CPU_SETSIZE];
+  int n = 0;
+
+  if (automatic)
+    {
+      // Fill the node of the first allowed CPU first, then the other
+      // nodes in turn.  Threads that talk much (reader and workers)
+      // thereby share a node as far as possible.
+
+      bool *used = new bool[CPU_SETSIZE];
+
+      memset(used,0,sizeof(bool) * CPU_SETSIZE);
+
+      for (int start = 0; start < CPU_SETSIZE; start++)
+	{
+	  if (used[start] || !CPU_ISSET(start,&allowed))
+	    continue;
+
+	  int node = node_of[start];
+
+	  for (int cpu = start; cpu < CPU_SETSIZE; cpu++)
+	    if (!used[cpu] && CPU_ISSET(cpu,&allowed) &&
+		(cpu == start || (node != -1 && node_of[cpu] == node)))
+	      {
+		order[n++] = cpu;
+		used[cpu] = true;
+	      }
+	}
+      delete[] used;
+
+      // Pinning only pays off when each thread has a CPU of its own,
+      // else the scheduler is better at moving them around.  (The
+      // default number of workers leaves room for Extr and Final.)
+      if (n < workers + 2)
+	n = 0;
+    }
+  else
+    {
+      n = parse_cpu_list(spec,order,CPU_SETSIZE);
+
+      if (n <= 0)
+	ERROR("Bad CPU list '%s' for --pin=.",spec);
+
+      int keep = 0;
+
+      for (int i = 0; i < n; i++)
+	{
+	  if (!CPU_ISSET(order[i],&allowed))
+	    WARNING("CPU %d (--pin=) is not available to us, ignored.",
+		    order[i]);
+	  else
+	    order[keep++] = order[i];
+	}
+      n = keep;
+    }
+
+  _pin_slots = THREAD_PIN_WORK + workers;
+  _pin_mask = new cpu_set_t[_pin_slots];
+
+  for (int i = 0; i < _pin_slots; i++)
+    CPU_ZERO(&_pin_mask[i]);
+
+  int next = 0;
+
+#define PIN_NEXT_CPU(slot) do {				\
+    if (next < n) CPU_SET(order[next++],&_pin_mask[slot]); \
+  } while (0)
+
+  PIN_NEXT_CPU(THREAD_PIN_EXTR);
+  for (int i = 0; i < workers; i++)
+    PIN_NEXT_CPU(THREAD_PIN_WORK + i);
+  PIN_NEXT_CPU(THREAD_PIN_FINAL);
+
+  // The file readers may go on any CPU of the reader node, such that
+  // the input buffers are local to the reader.
+  if (n)
+    {
+      int node = node_of[order[0]];
+
+      if (node != -1)
+	{
+	  for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+	    if (node_of[cpu] == node && CPU_ISSET(cpu,&allowed))
+	      CPU_SET(cpu,&_pin_mask[THREAD_PIN_INPUT]);
+	}
+      else
+	CPU_SET(order[0],&_pin_mask[THREAD_PIN_INPUT]);
+    }
+
+  if (n)
+    {
+      _pin_orig = allowed;
+      _pin_any  = true;
+
+      if (node_of[order[0]] != -1)
+	INFO(0,"Threads pinned, reader on CPU %d (node %d).",
+	     order[0],node_of[order[0]]);
+      else
+	INFO(0,"Threads pinned, reader on CPU %d.",order[0]);
+    }
+
+  delete[] order;
+  delete[] node_of;
+}
+
+void thread_pin_self(int slot)
+{
+  if (slot < 0 || slot >= _pin_slots ||
+      !CPU_COUNT(&_pin_mask[slot]))
+    return;
+
+  if (sched_setaffinity(0,sizeof(cpu_set_t),&_pin_mask[slot]) != 0)
+    perror("sched_setaffinity");
+}
+
+void thread_pin_input()
+{
+  thread_pin_self(THREAD_PIN_INPUT);
+}
+
+void thread_pin_release()
+{
+  if (!_pin_any)
+    return;
+
+  // No perror(), may be called in a forked child.
+  sched_setaffinity(0,sizeof(cpu_set_t),&_pin_orig);
+}
@@ -0,0 +1,50 @@
+/* This file is part of UCESB - a tool for data unpacking and processing.
+ *
+ * Copyright (C) 2016  Haakan T. Johansson  <f96hajo@chalmers.se>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301  USA
+ */
+
+#ifndef __THREAD_PIN_HH__
+#define __THREAD_PIN_HH__
+
+// Placement of the threads on CPUs (and thereby NUMA nodes).
+//
+// Each thread pins itself before it allocates any buffers, such that
+// those (by the first-touch policy of the kernel) end up in memory
+// local to its node.
+
+#define THREAD_PIN_NONE   -1
+
+#define THREAD_PIN_EXTR    0 // event reader ("Extr")
+#define THREAD_PIN_FINAL   1 // open/retire/output ("Final", main thread)
+#define THREAD_PIN_INPUT   2 // file readers (any CPU on the Extr node)
+#define THREAD_PIN_WORK    3 // + index, event_processor workers
+
+// spec: NULL or "none" (no pinning), "auto", or a CPU list
+// (e.g. "0-3,8"), used in the order Extr, Work0..WorkN-1, Final.
+void thread_pin_setup(const char *spec,int workers);
+
+void thread_pin_self(int slot);
+
+// For file_input (pipe_buffer) reader threads.
+void thread_pin_input();
+
+// Back to the mask we were started with.  For forked children, which
+// would otherwise inherit the mask of the (pinned) Final thread.
+void thread_pin_release();
+
+#endif//__THREAD_PIN_HH__
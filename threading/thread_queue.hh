@@ -57,20 +57,32 @@
 // The size is to be a power of 2
 
 // This structure is non-templated such that it works for a diagnostic class
+// The members are grouped by the thread that (mostly) writes them,
+// with padding in between, such that the producer and consumer do not
+// invalidate each others cache line on every item.
+
+// These two will NEVER be blocked at the same time.  If, then we
+// have a deadlock!  (_need_avail_wakeup / _need_done_wakeup)
+
 struct thread_queue_base
 {
 public:
-  volatile int _avail;
-  volatile int _done;
-  // int _size;
+  CACHE_LINE_PAD(_pad_before);
 
-  // These two will NEVER be blocked at the same time.  If, then
-  // we have a deadlock!
-  volatile const thread_block *_need_avail_wakeup;
+  // Written by the producer
+  volatile int _avail;
   volatile const thread_block *_need_done_wakeup;
+  volatile int _wakeup_done;
+
+  CACHE_LINE_PAD(_pad_avail_done);
 
+  // Written by the consumer
+  volatile int _done;
+  volatile const thread_block *_need_avail_wakeup;
   volatile int _wakeup_avail;
-  volatile int _wakeup_done;
+
+  CACHE_LINE_PAD(_pad_after);
+  // int _size;
 };
 
 template<typename T,int n>
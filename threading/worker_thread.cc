@@ -26,10 +26,12 @@
 #include "thread_debug.hh"
 #include "error.hh"
 #include "set_thread_name.hh"
+#include "thread_pin.hh"
+#include "subevent_match_cache.hh"
 
 #include <signal.h>
 
-#define WT_DATA_INIT { NULL, NULL, NULL, }
+#define WT_DATA_INIT { NULL, NULL, NULL, NULL, }
 
 #ifdef USE_THREADING
 #ifdef HAVE_THREAD_LOCAL_STORAGE
@@ -76,12 +78,20 @@ void worker_thread_data::init()
 
 }
 
+subevent_match_cache *worker_thread_data::alloc_subevent_match()
+{
+  _subevent_match = new subevent_match_cache[SUBEVENT_MATCH_CACHE_KINDS];
+
+  return _subevent_match;
+}
+
 
 
 
 worker_thread::worker_thread()
 {
   _data = NULL;
+  _pin  = THREAD_PIN_NONE;
 
 #ifdef USE_PTHREAD
   _active = false;
@@ -151,6 +161,8 @@ void *worker_thread::worker(void *us)
 {
   TDBG("");
   worker_thread *wt = ((worker_thread *) us);
+  // Before any allocation, such that the memory is local
+  thread_pin_self(wt->_pin);
   wt->thread_init();
   return wt->worker();
 }
@@ -165,7 +177,7 @@ void worker_thread::spawn()
       exit(1);
     }
 
-  set_thread_name((*relay_info)->_thread, "WORK", 5);
+  set_thread_name(_thread, "WORK", 5);
 
   // INFO(0,"Thread created...");
 
@@ -32,6 +32,7 @@
 
 class thread_buffer;
 struct reclaim_item;
+class subevent_match_cache;
 
 // The worker threads operate on one event at a time
 
@@ -48,8 +49,12 @@ struct worker_thread_data
 
   event_base     *_current_event;
 
+  subevent_match_cache *_subevent_match; // allocated on first use
+
 public:
   void init();
+
+  subevent_match_cache *alloc_subevent_match();
 };
 
 #ifdef USE_THREADING
@@ -100,6 +105,9 @@ public:
   virtual void *worker() = 0;
 #endif
 
+public:
+  int       _pin;    // THREAD_PIN_ slot, or THREAD_PIN_NONE
+
 public:
   void thread_init();
   void init();
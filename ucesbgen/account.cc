@@ -19,9 +19,17 @@
  */
 
 #include <vector>
+#include <map>
+#include <string>
 #include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#define __STDC_FORMAT_MACROS
+#include <inttypes.h>
 
 #include "dumper.hh"
+#include "account.hh"
+#include "parse_error.hh"
 
 class account_item
 {
@@ -51,6 +59,108 @@ int new_account_item(const char *name, const char *ident)
   return (int) index;
 }
 
+// Candidates of select statements, counted at run-time to write a
+// match profile (--match-profile=FILE), which is read back by
+// ucesbgen --profile=FILE to order the candidates.
+
+class match_account_item
+{
+public:
+  match_account_item(const char *name, int select_no,
+		     int index, const char *ident)
+  {
+    _name      = name;
+    _select_no = select_no;
+    _index     = index;
+    _ident     = ident;
+  }
+
+public:
+  const char *_name;
+  int         _select_no;
+  int         _index;
+  const char *_ident;
+};
+
+typedef std::vector<match_account_item*> match_account_item_list;
+
+match_account_item_list _match_account_items;
+
+int new_match_account_item(const char *name, int select_no,
+			   int index, const char *ident)
+{
+  size_t id = _match_account_items.size();
+
+  _match_account_items.push_back(new match_account_item(name, select_no,
+							index, ident));
+
+  return (int) id;
+}
+
+typedef std::map<std::string, uint64_t> match_profile_map;
+
+match_profile_map _match_profile;
+bool              _have_match_profile = false;
+
+static std::string match_profile_key(const char *name, int select_no,
+				     int index, const char *ident)
+{
+  char tmp[64];
+
+  snprintf (tmp, sizeof (tmp), " %d %d ", select_no, index);
+
+  return std::string(name) + tmp + ident;
+}
+
+void read_match_profile(const char *filename)
+{
+  FILE *fid = fopen(filename, "r");
+
+  if (!fid)
+    ERROR("Failure opening match profile '%s': %s",
+	  filename, strerror(errno));
+
+  char line[1024];
+
+  while (fgets(line, sizeof (line), fid))
+    {
+      char name[256], ident[256];
+      int select_no, index;
+      uint64_t count;
+
+      if (line[0] == '#')
+	continue;
+
+      // Lines that do not parse are ignored, the profile only gives hints.
+      if (sscanf(line, "%255s %d %d %255s %" SCNu64,
+		 name, &select_no, &index, ident, &count) != 5)
+	continue;
+
+      _match_profile[match_profile_key(name, select_no, index, ident)] +=
+	count;
+    }
+
+  fclose(fid);
+
+  _have_match_profile = true;
+}
+
+bool have_match_profile()
+{
+  return _have_match_profile;
+}
+
+uint64_t match_profile_count(const char *name, int select_no,
+			     int index, const char *ident)
+{
+  match_profile_map::iterator iter =
+    _match_profile.find(match_profile_key(name, select_no, index, ident));
+
+  if (iter == _match_profile.end())
+    return 0;
+  return iter->second;
+}
+
 void generate_account_items()
 {
   print_header("ACCOUNT_IDS",
@@ -69,8 +179,27 @@ void generate_account_items()
     }
   printf ("};\n\n");
 
-  printf ("#define NUM_ACCOUNT_IDS  %zd\n",
+  printf ("#define NUM_ACCOUNT_IDS  %zd\n\n",
 	  _account_items.size());
 
+  printf ("match_account_id _match_account_ids[] =\n"
+	  "{ \n");
+  i = 0;
+  for (match_account_item_list::iterator iter = _match_account_items.begin();
+       iter !=_match_account_items.end(); i++, ++iter)
+    {
+      printf ("  { %zd, \"%s\", %d, %d, \"%s\" },\n",
+	      i,
+	      (*iter)->_name,
+	      (*iter)->_select_no,
+	      (*iter)->_index,
+	      (*iter)->_ident);
+    }
+  printf ("  { -1, NULL, 0, 0, NULL },\n");
+  printf ("};\n\n");
+
+  printf ("#define NUM_MATCH_ACCOUNT_IDS  %zd\n",
+	  _match_account_items.size());
+
   print_footer("ACCOUNT_IDS");
 }
@@ -21,8 +21,18 @@
 #ifndef __ACCOUNT_HH__
 #define __ACCOUNT_HH__
 
+#include <stdint.h>
+
 int new_account_item(const char *name, const char *ident);
 
+int new_match_account_item(const char *name, int select_no,
+			   int index, const char *ident);
+
+void read_match_profile(const char *filename);
+bool have_match_profile();
+uint64_t match_profile_count(const char *name, int select_no,
+			     int index, const char *ident);
+
 void generate_account_items();
 
 #endif//__ACCOUNT_HH__
@@ -305,6 +305,8 @@ void generate_unpack_code()
   if (the_sticky_event)
     generate_unpack_code(the_sticky_event);
 
+  generate_unpack_defines();
+
   printf ("/**********************************************************/\n");
 }
 
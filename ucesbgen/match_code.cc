@@ -25,6 +25,8 @@
 #include <assert.h>
 #include <limits.h>
 
+#include <algorithm>
+
 bool struct_unpack_code::get_match_bits(const struct_item* item,dumper &d,const arguments *args,
 					match_info &bits)
 {
@@ -397,6 +399,70 @@ struct_unpack_code::gen_match_decl_quick(const std::vector<match_info> &infos,
 }
 
 
+// When too many bits differ between the candidates to make a table
+// indexed by all of them, pick a subset that still separates (most
+// of) the candidates.  Greedily take the bit which separates the
+// most pairs of candidates that are not yet told apart.  Bits that
+// a candidate does not care about (range, or not fixed) do not
+// separate it from anyone.
+
+static void select_match_index_bits(const std::vector<match_info> &infos,
+				    const std::vector<int> &bits_differ,
+				    size_t max_bits,
+				    std::vector<int> &bits_index)
+{
+  size_t n = infos.size();
+
+  std::vector<bool> separated(n * n,false);
+  std::vector<bool> used(bits_differ.size(),false);
+
+  while (bits_index.size() < max_bits)
+    {
+      int select_bi = -1;
+      int select_separate = 0;
+
+      for (size_t bi = 0; bi < bits_differ.size(); bi++)
+	{
+	  if (used[bi])
+	    continue;
+
+	  uint32 bit = ((uint32) 1) << bits_differ[bi];
+	  int separate = 0;
+
+	  for (size_t i = 0; i < n; i++)
+	    for (size_t j = i+1; j < n; j++)
+	      if (!separated[i * n + j] &&
+		  (infos[i]._mask & infos[j]._mask &
+		   (infos[i]._value ^ infos[j]._value) & bit))
+		separate++;
+
+	  if (separate > select_separate)
+	    {
+	      select_bi = (int) bi;
+	      select_separate = separate;
+	    }
+	}
+
+      if (select_bi == -1)
+	break; // no further bit helps
+
+      used[(size_t) select_bi] = true;
+      bits_index.push_back(bits_differ[(size_t) select_bi]);
+
+      uint32 bit = ((uint32) 1) << bits_differ[(size_t) select_bi];
+
+      for (size_t i = 0; i < n; i++)
+	for (size_t j = i+1; j < n; j++)
+	  if (infos[i]._mask & infos[j]._mask &
+	      (infos[i]._value ^ infos[j]._value) & bit)
+	    separated[i * n + j] = true;
+    }
+
+  // The index is formed with the bits in increasing order (as for
+  // the full table, and as PEXT compacts them)
+
+  std::sort(bits_index.begin(),bits_index.end());
+}
 
 
 bool struct_unpack_code::gen_optimized_match(const file_line &loc,
@@ -498,25 +564,62 @@ bool struct_unpack_code::gen_optimized_match(const file_line &loc,
       }
   d.text_fmt("\n");
 
+  // We at most make an array that has 2^5 times the number of elements
+  // that are to be matched.  If more bits differ, a subset of them
+  // that separates the candidates is used for the index.  Then a
+  // single candidate found in the table has not been checked on all
+  // its bits, so that is done afterwards.
+
+  std::vector<int> bits_index;
+  bool index_subset = false;
+
   if ((((unsigned int) 1) << bits_differ.size()) <= items->size() * (1 << 5))
+    bits_index = bits_differ;
+  else if (items->size() > 3)
+    {
+      size_t max_bits = 0;
+
+      while ((((size_t) 1) << (max_bits+1)) <= items->size() * (1 << 5))
+	max_bits++;
+
+      select_match_index_bits(infos,bits_differ,max_bits,bits_index);
+
+      if (!bits_index.empty())
+	{
+	  index_subset = true;
+
+	  d.text_fmt("// index subset :");
+	  for (size_t i = 0; i < bits_index.size(); i++)
+	    d.text_fmt(" %d",bits_index[i]);
+	  d.text_fmt("\n");
+	}
+    }
+
+  if (bits_index.size() == bits_differ.size() || index_subset)
     {
-      // We at most make an array that has 2^5 times the number of elements
-      // that are to be matched
+      uint32 index_mask = 0;
+
+      for (size_t i = 0; i < bits_index.size(); i++)
+	index_mask |= ((uint32) 1) << bits_index[i];
 
-      d.text("uint32 __match_index = 0");
+      // With BMI2, the index is gathered by a single PEXT instruction,
+      // otherwise by the shift and mask expression.
+
+      d.text_fmt("uint32 __match_index = MATCH_INDEX_GATHER(__match_peek,0x%08x,0",
+		 index_mask);
 
       // Now, walk through the bits that we want to make an index of, and put
       // them into the slots
 
-      for (size_t i = 0; i < bits_differ.size(); i++)
+      for (size_t i = 0; i < bits_index.size(); i++)
 	{
-	  int min_bit = bits_differ[i];
-	  int max_bit = bits_differ[i];
+	  int min_bit = bits_index[i];
+	  int max_bit = bits_index[i];
 
 	  int start_i = (int) i;
 
-	  while (i+1 < bits_differ.size() &&
-		 bits_differ[i+1] == max_bit+1)
+	  while (i+1 < bits_index.size() &&
+		 bits_index[i+1] == max_bit+1)
 	    {
 	      i++;
 	      max_bit++;
@@ -527,9 +630,9 @@ bool struct_unpack_code::gen_optimized_match(const file_line &loc,
 		     min_bit - start_i,((1 << (max_bit-min_bit+1)) - 1) << start_i);
 
 	}
-      d.text(";\n");
+      d.text(");\n");
 
-      int array_size = 1 << bits_differ.size();
+      int array_size = 1 << bits_index.size();
 
       d.text_fmt("static const sint%d __match_index_array[%d] = { ",
 		 items->size() <= 127 ? 8 : 32,
@@ -554,11 +657,11 @@ bool struct_unpack_code::gen_optimized_match(const file_line &loc,
 
 	      //d.text_fmt("\n(%d)",i);
 
-	      for (unsigned int bi = 0; bi < bits_differ.size(); bi++)
+	      for (unsigned int bi = 0; bi < bits_index.size(); bi++)
 		{
-		  int bit = bits_differ[bi];
+		  int bit = bits_index[bi];
 
-		  // d.text_fmt("[%d,%d]",bi,bits_differ[bi]);
+		  // d.text_fmt("[%d,%d]",bi,bits_index[bi]);
 
 		  if (info._mask & (1 << bit))
 		    {
@@ -629,6 +732,27 @@ bool struct_unpack_code::gen_optimized_match(const file_line &loc,
 
       d.text("__match_no = __match_index_array[__match_index];\n");
 
+      // With only a subset of the bits in the index, the single
+      // candidate must also match on all its other fixed bits.
+
+      if (index_subset)
+	{
+	  d.text_fmt("static const uint%d __match_verify_mask[%d] = { 0, ",
+		     size,(int) infos.size() + 1);
+	  for (unsigned int i = 0; i < infos.size(); i++)
+	    d.text_fmt("0x%0*x, ",size/4,infos[i]._mask);
+	  d.text("};\n");
+	  d.text_fmt("static const uint%d __match_verify_value[%d] = { 0, ",
+		     size,(int) infos.size() + 1);
+	  for (unsigned int i = 0; i < infos.size(); i++)
+	    d.text_fmt("0x%0*x, ",size/4,infos[i]._value);
+	  d.text("};\n");
+	  d.text("if (__match_no > 0 &&\n");
+	  d.text("    (__match_peek & __match_verify_mask[__match_no]) !=\n");
+	  d.text("    __match_verify_value[__match_no])\n");
+	  d.text("  __match_no = 0;\n");
+	}
+
       // If we had a ambiguous match, then we've gotten a negative
       // index out (which has an associated set of items to check
 
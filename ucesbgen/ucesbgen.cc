@@ -20,6 +20,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "definitions.hh"
 #include "parse_error.hh"
@@ -34,16 +35,33 @@ bool parse_definitions();
 void usage()
 {
   printf ("ucesbgen\n"
-	  "usage ucesbgen\n");
-  printf ("    ");
+	  "usage ucesbgen [--profile=FILE] < SPEC\n");
+  printf ("    --profile=FILE  Order select candidates by counts "
+	  "from unpacker --match-profile=FILE.\n");
 }
 
-int main(int /*argc*/,char *argv[])
+int main(int argc,char *argv[])
 {
   lexer_read_fd = 0; // read from stdin
 
   setup_segfault_coredump(argv[0]);
 
+  for (int i = 1; i < argc; i++)
+    {
+      if (strncmp(argv[i],"--profile=",10) == 0)
+	read_match_profile(argv[i]+10);
+      else if (strcmp(argv[i],"--help") == 0)
+	{
+	  usage();
+	  exit(0);
+	}
+      else
+	{
+	  usage();
+	  ERROR("%s: Unknown option '%s'.\n",argv[0],argv[i]);
+	}
+    }
+
   if (!parse_definitions())
     ERROR("%s: Aborting!\n",argv[0]);
 
@@ -27,6 +27,8 @@
 #include "account.hh"
 
 #include <inttypes.h>
+#include <typeinfo>
+#include <algorithm>
 
 // We generate the unpack code recursively, i.e. whenever an subevent
 // needs another subevent, that other subevent has to be processed
@@ -122,6 +124,20 @@ void match_end_info::set_end()
   _match_ended = true;
 }
 
+// Set when any structure has a 64-bit data item
+bool _unpack_has_uint64_items = false;
+
+void generate_unpack_defines()
+{
+  if (!_unpack_has_uint64_items)
+    return;
+
+  print_header("UNPACKER_DEFINES","Data item sizes");
+  // --bulk-swap would read the two 32-bit halves in the wrong order
+  printf ("#define UNPACKER_HAS_UINT64_ITEMS 1\n\n");
+  print_footer("UNPACKER_DEFINES");
+}
+
 void generate_unpack_code(struct_definition *structure)
 {
   if (structure->_code)
@@ -317,6 +333,22 @@ void struct_unpack_code::gen(const struct_definition *str,
 
   if (type & UCT_UNPACK)
     {
+      // Select statements are identified by structure and order in
+      // the match profile.
+      _match_struct_name = str->_header->_name;
+      _match_select_no = 0;
+
+      // The actual unpacking is done by __unpack_checks, which either
+      // checks each item immediately, or (__check_deferred) only
+      // collects mismatches, to be tested once at the end.  In the
+      // latter case, a failure re-runs the immediate version on the
+      // same data to report it.  Structures getting members of
+      // the caller as arguments cannot be re-run (items would be
+      // inserted twice), so always check immediately.
+
+      bool deferrable = !(named_header &&
+			  has_member_params(named_header->_params));
+
       d.text("template<typename __data_src_t>\n");
       d.text("void ");
       d.text(str->_header->_name);
@@ -324,6 +356,21 @@ void struct_unpack_code::gen(const struct_definition *str,
       if (named_header)
 	gen_params(named_header->_params,d,type,true,false);
       d.text(")\n");
+      d.text("{\n");
+      d.text_fmt("  UNPACK_CHECK_%s(__unpack_checks",
+		 deferrable ? "DEFERRED" : "IMMEDIATE");
+      if (named_header)
+	gen_param_names(named_header->_params,d);
+      d.text(");\n");
+      d.text("}\n");
+      d.text("template<typename __data_src_t,int __check_deferred>\n");
+      d.text("void ");
+      d.text(str->_header->_name);
+      d.text("::__unpack_checks(uint32 &__check_fail,"
+	     "__data_src_t &__buffer");
+      if (named_header)
+	gen_params(named_header->_params,d,type,true,false);
+      d.text(")\n");
     }
   if (type & UCT_MATCH)
     {
@@ -364,6 +411,12 @@ void struct_unpack_code::gen(const struct_definition *str,
       if (named_header)
 	gen_params(named_header->_params,d,type,true,true);
       d.text(");\n");
+      d.text("template<typename __data_src_t,int __check_deferred>\n");
+      d.text("  void __unpack_checks(uint32 &__check_fail,"
+	     "__data_src_t &__buffer");
+      if (named_header)
+	gen_params(named_header->_params,d,type,true,false);
+      d.text(");\n");
       d.text("template<typename __data_src_t>\n");
       d.text("  static bool __match(__data_src_t &__buffer");
       if (named_header)
@@ -663,6 +716,10 @@ void struct_unpack_code::gen(const encode_spec *encode,dumper &d,uint32 type,
 
       if (vi || (encode->_flags & ES_APPEND_LIST))
 	{
+	  // Bad data may give an index out of range, report any
+	  // pending (deferred) check failure first
+	  sd.text("UNPACK_CHECK_FLUSH;\n");
+
 	  item = "__item";
 	  // Without the use of typeof here, we'd have to keep
 	  // track of the types of variables...
@@ -792,7 +849,9 @@ void struct_unpack_code::gen(const struct_header *header,
 
   switch (data->_size)
     {
-    case 64: data_type = "uint64 "; full_name = "u64"; fmt = "PRIx64"; break;
+    case 64: data_type = "uint64 "; full_name = "u64"; fmt = "PRIx64";
+      _unpack_has_uint64_items = true;
+      break;
     case 32: data_type = "uint32 "; full_name = "u32"; fmt = "PRIx32"; break;
     case 16: data_type = "uint16 "; full_name = "u16"; fmt = "PRIx16"; break;
     case 8:  data_type = "uint8  "; full_name = "u8";  fmt = "PRIx8";  break;
@@ -1003,7 +1062,7 @@ void struct_unpack_code::gen(const struct_header *header,
       // First we need to get the data from the buffer
 
       int account_id =
-	new_account_item(header->_name, data->_ident);
+	data_account_id(header, data);
 
       d.text_fmt("%s%s_FROM_BUFFER_FULL(%d,%s,%s,%s%s.%s,%d);\n",
 		 match_prefix,
@@ -1042,7 +1101,9 @@ void struct_unpack_code::gen(const struct_header *header,
 	    //BITFIELD_NAMED(sshd,data_type,b);
 	    //next_bit = b->_max+1;
 
-	    if (b->_cond)
+	    if (b->_cond &&
+		!(_list_fixed_skip && data == _list_fixed_data &&
+		  _list_fixed_bits.count(b)))
 	      {
 		char name[512];
 
@@ -1055,6 +1116,10 @@ void struct_unpack_code::gen(const struct_header *header,
 	      }
 	  }
 
+	if (_list_fixed_skip && data == _list_fixed_data &&
+	    _list_fixed_unnamed)
+	  unnamed_bits = 0; // checked before the loop
+
 	if (unnamed_bits)
 	  {
 	    d.text_fmt("%s_UNNAMED_BITS_ZERO(%d,%s%s.%s,0x%0*llx%s",
@@ -1293,6 +1358,132 @@ const var_external *struct_unpack_code::gen_external_header(const variable *var,
   return external;
 }
 
+// Find out if the list consists of only one 32-bit data word, with
+// fixed bits (unnamed, constants, or parameters of the structure).
+// Those can then be checked for all items before the loop, with a
+// vectorised compare, see bulk_check_32().  The other checks (ranges
+// etc) are still done per item.
+
+const struct_data *
+struct_unpack_code::list_fixed_bits(const struct_header *header,
+				    const struct_list *list,
+				    uint32 *mask,uint32 *value,
+				    std::vector<const bits_spec *> &param_bits)
+{
+  if (list->_items->size() != 1)
+    return NULL;
+
+  const struct_data *data =
+    dynamic_cast<const struct_data *>(*list->_items->begin());
+
+  if (!data ||
+      data->_size != 32 ||
+      !data->_bits ||
+      (data->_flags & (SD_FLAGS_OPTIONAL | SD_FLAGS_SEVERAL)))
+    return NULL;
+
+  const struct_header_named *named_header =
+    dynamic_cast<const struct_header_named *>(header);
+
+  _list_fixed_bits.clear();
+
+  *mask  = 0xffffffff;
+  *value = 0;
+
+  bits_spec_list::const_iterator i;
+
+  for (i = data->_bits->begin(); i != data->_bits->end(); ++i)
+    {
+      bits_spec *b = *i;
+
+      uint32 field_mask =
+	(uint32) (NUM_BITS_MASK(b->_max+1) ^ NUM_BITS_MASK(b->_min));
+
+      *mask &= ~field_mask; // named field, (so far) not fixed
+
+      const bits_cond_check *check =
+	dynamic_cast<const bits_cond_check *>(b->_cond);
+
+      if (!check)
+	continue;
+
+      const var_const *vc = dynamic_cast<const var_const *>(check->_check);
+      const var_name  *vn = dynamic_cast<const var_name *>(check->_check);
+
+      if (vc)
+	{
+	  // A constant that does not fit can never match, leave it
+	  // for the per-item check to complain
+	  if ((((uint64) vc->_value._value) << b->_min) & ~(uint64) field_mask)
+	    continue;
+	  *value |= vc->_value._value << b->_min;
+	}
+      else if (vn && typeid(*vn) == typeid(var_name) &&
+	       named_header && named_header->_params)
+	{
+	  // A plain parameter of the structure is known before the loop.
+
+	  param_list::const_iterator p;
+
+	  for (p = named_header->_params->begin();
+	       p != named_header->_params->end(); ++p)
+	    if (strcmp((*p)->_name,vn->_name) == 0)
+	      break;
+
+	  if (p == named_header->_params->end())
+	    continue;
+
+	  param_bits.push_back(b);
+	}
+      else
+	continue;
+
+      *mask |= field_mask;
+      _list_fixed_bits.insert(b);
+    }
+
+  _list_fixed_unnamed = true;
+
+  if (_list_fixed_bits.empty())
+    return NULL; // no use, the unnamed bits are usually few
+
+  return data;
+}
+
+void struct_unpack_code::gen_list_loop(const struct_list *list,
+				       const var_external *external_max,
+				       dumper &d)
+{
+  d.text("for (uint32 ");
+  list->_index->dump(d);
+  d.text(" = ");
+  list->_min->dump(d);
+  d.text("; ");
+  list->_index->dump(d);
+  d.text(" < (uint32) (");
+  if (external_max)
+    d.text_fmt("%s()",external_max->_name);
+  else
+    list->_max->dump(d);
+  d.text("); ++");
+  list->_index->dump(d);
+  d.text(")\n");
+}
+
+int struct_unpack_code::data_account_id(const struct_header *header,
+					const struct_data *data)
+{
+  // The two loops of a list with fixed bits checked before are
+  // accounted as the same item.
+  if (data == _list_fixed_data)
+    {
+      if (_list_fixed_account_id < 0)
+	_list_fixed_account_id = new_account_item(header->_name,data->_ident);
+      return _list_fixed_account_id;
+    }
+  return new_account_item(header->_name,data->_ident);
+}
+
 void struct_unpack_code::gen(const struct_header *header,
 			     const struct_list*    list,   dumper &d,uint32 type,
 			     match_end_info *mei,
@@ -1302,24 +1493,76 @@ void struct_unpack_code::gen(const struct_header *header,
 
   external_max = gen_external_header(list->_max,d,type);
 
-  if (type & (UCT_UNPACK | UCT_MATCH))
+  const struct_data *fixed_data = NULL;
+  uint32 fixed_mask = 0, fixed_value = 0;
+  std::vector<const bits_spec *> param_bits;
+
+  if ((type & UCT_UNPACK) && !(type & UCT_MATCH))
+    fixed_data = list_fixed_bits(header,list,
+				 &fixed_mask,&fixed_value,param_bits);
+
+  if (fixed_data)
     {
-      d.text("for (uint32 ");
-      list->_index->dump(d);
-      d.text(" = ");
-      list->_min->dump(d);
-      d.text("; ");
-      list->_index->dump(d);
-      d.text(" < (uint32) (");
+      // Check the fixed bits of all items at once.  If good, the
+      // loop is run without those checks, otherwise the normal loop
+      // reports the (first) bad item.
+
+      d.text("{\n");
+      dumper sd(d,2);
+
+      sd.text_fmt("uint32 __list_fixed_value = 0x%08x;\n",fixed_value);
+      sd.text("bool __list_fixed_ok = true;\n");
+
+      for (size_t i = 0; i < param_bits.size(); i++)
+	{
+	  const bits_spec *b = param_bits[i];
+	  const bits_cond_check *check =
+	    dynamic_cast<const bits_cond_check *>(b->_cond);
+
+	  sd.text_fmt("UNPACK_LIST_FIXED_PARAM(__list_fixed_value,"
+		      "__list_fixed_ok,%d,0x%x,",
+		      b->_min,(uint32) NUM_BITS_MASK(b->_max-b->_min+1));
+	  check->_check->dump(sd);
+	  sd.text(");\n");
+	}
+
+      sd.text("if (__list_fixed_ok &&\n");
+      sd.text("    UNPACK_LIST_CHECK_FIXED_32(");
+      list->_min->dump(sd);
+      sd.text(",");
       if (external_max)
-	d.text_fmt("%s()",external_max->_name);
+	sd.text_fmt("%s()",external_max->_name);
       else
-	list->_max->dump(d);
-      d.text("); ++");
-      list->_index->dump(d);
-      d.text(")\n");
+	list->_max->dump(sd);
+      sd.text_fmt(",0x%08x,__list_fixed_value))\n",fixed_mask);
+
+      _list_fixed_data = fixed_data;
+      _list_fixed_account_id = -1;
+
+      {
+	dumper ssd(sd,2);
+	_list_fixed_skip = true;
+	gen_list_loop(list,external_max,ssd);
+	gen(header,list->_items,ssd,type,mei,last_subevent_item,false);
+	_list_fixed_skip = false;
+      }
+      sd.text("else\n");
+      {
+	dumper ssd(sd,2);
+	gen_list_loop(list,external_max,ssd);
+	gen(header,list->_items,ssd,type,mei,last_subevent_item,false);
+      }
+
+      _list_fixed_data = NULL;
+      _list_fixed_bits.clear();
+
+      d.text("}\n");
+      return;
     }
 
+  if (type & (UCT_UNPACK | UCT_MATCH))
+    gen_list_loop(list,external_max,d);
+
   gen(header,list->_items,d,type,mei,last_subevent_item,false);
 }
 
@@ -1331,6 +1574,90 @@ void struct_unpack_code::gen(const struct_select*select,dumper &d,uint32 type,
 	    select->_flags);
 }
 
+// Candidates with counts in the profile, which by their fixed bits
+// cannot match together with any other candidate, most common first.
+
+static bool compare_profile_count(const std::pair<uint64_t,int> &lhs,
+				  const std::pair<uint64_t,int> &rhs)
+{
+  if (lhs.first != rhs.first)
+    return lhs.first > rhs.first;
+  return lhs.second < rhs.second;
+}
+
+#define PROFILE_MAX_HOT_CANDIDATES  4
+
+std::vector<int>
+struct_unpack_code::profile_hot_candidates(const struct_decl_list *items,
+					   int select_no)
+{
+  std::vector<int> hot;
+  size_t n = items->size();
+
+  if (n < 2)
+    return hot;
+
+  // get_match_bits() describes what it finds, not wanted here
+  dumper_dest_memory ddm;
+  dumper dd(&ddm);
+
+  std::vector<match_info> infos(n);
+  std::vector<bool> have_bits(n,false);
+
+  for (size_t i = 0; i < n; i++)
+    {
+      struct_decl *decl = (*items)[i];
+
+      infos[i]._size = 0;
+      infos[i]._decl = decl;
+      infos[i]._index = (int) i+1;
+
+      if (!decl->is_event_opt())
+	have_bits[i] = get_match_bits(decl,dd,infos[i]);
+    }
+
+  std::vector<std::pair<uint64_t,int> > counts;
+
+  for (size_t i = 0; i < n; i++)
+    {
+      struct_decl *decl = (*items)[i];
+
+      if (decl->is_event_opt() || !have_bits[i])
+	continue;
+
+      uint64_t count = match_profile_count(_match_struct_name,select_no,
+					   (int) i+1,decl->_ident);
+
+      if (!count)
+	continue;
+
+      bool exclusive = true;
+
+      for (size_t j = 0; j < n && exclusive; j++)
+	{
+	  if (j == i || (*items)[j]->is_event_opt())
+	    continue;
+
+	  if (!have_bits[j] ||
+	      infos[j]._size != infos[i]._size ||
+	      !(infos[i]._mask & infos[j]._mask &
+		(infos[i]._value ^ infos[j]._value)))
+	    exclusive = false;
+	}
+
+      if (exclusive)
+	counts.push_back(std::pair<uint64_t,int>(count,(int) i+1));
+    }
+
+  std::sort(counts.begin(),counts.end(),compare_profile_count);
+
+  for (size_t i = 0;
+       i < counts.size() && i < PROFILE_MAX_HOT_CANDIDATES; i++)
+    hot.push_back(counts[i].second);
+
+  return hot;
+}
+
 void struct_unpack_code::gen_check_spurios_match(const struct_decl *decl,dumper &d,
 						 const char *abort_spurious_label)
 {
@@ -1415,6 +1742,10 @@ void struct_unpack_code::gen_match(const file_line &loc,
 	  d.col0_text("#ifndef __PSDC__\n");
 	  if (items->size())
 	    d.text_fmt("  bitsone<%d> __visited;\n",(int) items->size());
+	  d.text_fmt("  enum { __subevent_match_kind = %s };\n",
+		     sticky ?
+		     "SUBEVENT_MATCH_CACHE_STICKY" :
+		     "SUBEVENT_MATCH_CACHE_EVENT");
 	  d.text("  void __clear_visited() {");
 	  if (items->size())
 	    d.text(" __visited.clear();");
@@ -1496,6 +1827,26 @@ void struct_unpack_code::gen_match(const file_line &loc,
 	WARNING_LOC(loc,"select statement with no entries "
 		    "(will give run-time error)\n");
 
+      // Which candidate matched is counted (when accounting), to
+      // write a profile for ordering the candidates.
+      int select_no = 0;
+      int match_account_base = -1;
+
+      if (!subevent && (type & UCT_UNPACK) && items->size())
+	{
+	  select_no = ++_match_select_no;
+
+	  struct_decl_list::const_iterator i;
+	  int index = 1;
+	  for (i = items->begin(); i != items->end(); ++i, ++index)
+	    {
+	      int id = new_match_account_item(_match_struct_name,select_no,
+					      index,(*i)->_ident);
+	      if (index == 1)
+		match_account_base = id;
+	    }
+	}
+
       int normal_match = true;
 
       if (!subevent && !(type & UCT_MATCH))
@@ -1523,6 +1874,44 @@ void struct_unpack_code::gen_match(const file_line &loc,
 
       if (normal_match)
       {
+	// The subevent conditions only depend on the header, so the
+	// result of the search is remembered (per kind of subevent),
+	// instead of comparing with all declarations each time.
+	if (subevent)
+	  {
+	    sd.text("if (!SUBEVENT_MATCH_CACHE_FIND(__match_no))\n");
+	    sd.text("{\n");
+	  }
+	dumper msd(sd,subevent ? 2 : 0);
+
+	// With a profile, the most common candidates which cannot
+	// match together with any other candidate are tried first,
+	// and the others only when they did not match.
+
+	std::vector<int> hot;
+
+	if (!subevent && (type & UCT_UNPACK) && have_match_profile())
+	  hot = profile_hot_candidates(items,select_no);
+
+	for (size_t h = 0; h < hot.size(); h++)
+	  {
+	    dumper hsd(msd,(int) (2 * h));
+	    struct_decl *decl = (*items)[(size_t) hot[h]-1];
+	    const struct_header_named *named_header = find_decl(decl,false);
+
+	    hsd.text_fmt("MATCH_DECL(%d,__match_no,%d,",
+			 decl->_loc._internal,hot[h]);
+	    hsd.text(decl->_ident);
+	    hsd.text(",");
+	    decl->_name->dump(hsd);
+	    dump_param_args(decl->_loc,named_header->_params,decl->_args,hsd,false);
+	    hsd.text(");\n");
+	    hsd.text("if (!__match_no)\n");
+	    hsd.text("{\n");
+	  }
+
+	dumper rsd(msd,(int) (2 * hot.size()));
+
 	struct_decl_list::const_iterator i;
 	int index = 1;
 	for (i = items->begin(); i != items->end(); ++i, ++index)
@@ -1532,30 +1921,47 @@ void struct_unpack_code::gen_match(const file_line &loc,
 	    if (decl->is_event_opt())
 	      continue;
 
+	    if (std::find(hot.begin(),hot.end(),index) != hot.end())
+	      continue;
+
 	    const struct_header_named *named_header = find_decl(decl,subevent);
 
 	    if (subevent)
 	      {
-		sd.text_fmt("MATCH_SUBEVENT_DECL(%d,__match_no,%d,(",
-			    decl->_loc._internal,index);
-		dump_match_args(decl->_loc,subevent_cond_params,decl->_args,sd);
-		sd.text("),");
-		decl->_name->dump(sd);
-		// dump_param_args(decl->_loc,named_header->_params,decl->_args,sd);
-		sd.text(");\n");
+		msd.text_fmt("MATCH_SUBEVENT_DECL(%d,__match_no,%d,(",
+			     decl->_loc._internal,index);
+		dump_match_args(decl->_loc,subevent_cond_params,decl->_args,msd);
+		msd.text("),");
+		decl->_name->dump(msd);
+		// dump_param_args(decl->_loc,named_header->_params,decl->_args,msd);
+		msd.text(");\n");
 	      }
 	    else
 	      {
-		sd.text_fmt("MATCH_DECL(%d,__match_no,%d,",
-			    decl->_loc._internal,index);
-		sd.text(decl->_ident);
-		sd.text(",");
-		decl->_name->dump(sd);
-		dump_param_args(decl->_loc,named_header->_params,decl->_args,sd,false);
-		sd.text(");\n");
+		rsd.text_fmt("MATCH_DECL(%d,__match_no,%d,",
+			     decl->_loc._internal,index);
+		rsd.text(decl->_ident);
+		rsd.text(",");
+		decl->_name->dump(rsd);
+		dump_param_args(decl->_loc,named_header->_params,decl->_args,rsd,false);
+		rsd.text(");\n");
 	      }
 	  }
+
+	for (size_t h = hot.size(); h; h--)
+	  {
+	    dumper hsd(msd,(int) (2 * (h-1)));
+	    hsd.text("}\n");
+	  }
+
+	if (subevent)
+	  {
+	    msd.text("SUBEVENT_MATCH_CACHE_INSERT(__match_no);\n");
+	    sd.text("}\n");
+	  }
       }
+      if (match_account_base >= 0)
+	sd.text_fmt("MATCH_ACCOUNT(%d,__match_no);\n",match_account_base);
       {
 	// If we are running with several, then we may at any time run out of matches...
 	if (subevent)
@@ -1570,7 +1976,10 @@ void struct_unpack_code::gen_match(const file_line &loc,
 	      }
 	    else
 	      {
-		sd.text_fmt("if (!__match_no) ERROR_U_LOC(%d,\"No match for select statement.\");\n",loc._internal);
+		if (type & UCT_UNPACK)
+		  sd.text_fmt("if (UNLIKELY(!__match_no)) { UNPACK_CHECK_FLUSH; ERROR_U_LOC(%d,\"No match for select statement.\"); }\n",loc._internal);
+		else
+		  sd.text_fmt("if (UNLIKELY(!__match_no)) ERROR_U_LOC(%d,\"No match for select statement.\");\n",loc._internal);
 	      }
 	  }
 	if (type & UCT_MATCH)
@@ -1997,6 +2406,35 @@ bool struct_unpack_code::has_params(const param_list *params,
   return false;
 }
 
+bool struct_unpack_code::has_member_params(const param_list *params)
+{
+  param_list::const_iterator pl;
+
+  for (pl = params->begin(); pl != params->end(); ++pl)
+    if ((*pl)->_member)
+      return true;
+  return false;
+}
+
+void struct_unpack_code::gen_param_names(const param_list *params,
+					 dumper &d)
+{
+  /* Same order as gen_params(), but just the names, for a call. */
+
+  param_list::const_iterator pl;
+
+  for (pl = params->begin(); pl != params->end(); ++pl)
+    {
+      param *p = *pl;
+
+      d.text(",");
+      if (p->_member)
+	d.text(p->_member->_ident->_name);
+      else
+	d.text(p->_name);
+    }
+}
+
 void struct_unpack_code::gen_params(const param_list *params,
 				    dumper &d,
 				    uint32 type,
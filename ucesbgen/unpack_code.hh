@@ -25,6 +25,7 @@
 #include "structure.hh"
 
 #include <map>
+#include <set>
 
 #define UCT_HEADER   0x01
 #define UCT_UNPACK   0x02
@@ -87,6 +88,14 @@ public:
   struct_unpack_code()
   {
     _done = false;
+
+    _list_fixed_data = NULL;
+    _list_fixed_unnamed = false;
+    _list_fixed_skip = false;
+    _list_fixed_account_id = -1;
+
+    _match_struct_name = "-";
+    _match_select_no = 0;
   }
 
 
@@ -101,6 +110,21 @@ public:
 public:
   bool _done;
 
+protected:
+  // Data word of a list which has its fixed bits checked for all
+  // items at once.  The loop is generated twice, with (_skip) and
+  // without those checks, see gen(struct_list).
+  const struct_data           *_list_fixed_data;
+  std::set<const bits_spec *>  _list_fixed_bits;
+  bool                         _list_fixed_unnamed;
+  bool                         _list_fixed_skip;
+  int                          _list_fixed_account_id;
+
+  // Structure being generated, and number of select statements so
+  // far, identifies candidates in the match profile.
+  const char *_match_struct_name;
+  int         _match_select_no;
+
 public:
   void gen(const struct_definition *str,dumper &d,uint32 type,
 	   match_end_info *mei);
@@ -172,6 +196,9 @@ public:
 		  bool dump_member_args,
 		  bool dump_default_args);
 
+  bool has_member_params(const param_list *params);
+  void gen_param_names(const param_list *params,dumper &d);
+
 public:
   bool get_match_bits(const struct_decl      *decl,dumper &d,match_info &bits);
   bool get_match_bits(const struct_item_list *list,dumper &d,const arguments *args,match_info &bits);
@@ -189,12 +216,24 @@ protected:
   void gen_check_spurios_match(const struct_decl *decl,dumper &d,
 			       const char *abort_spurious_label);
 
+  const struct_data *list_fixed_bits(const struct_header *header,
+				     const struct_list *list,
+				     uint32 *mask,uint32 *value,
+				     std::vector<const bits_spec *> &param_bits);
+  void gen_list_loop(const struct_list *list,
+		     const var_external *external_max,dumper &d);
+  int data_account_id(const struct_header *header,
+		      const struct_data *data);
+  std::vector<int> profile_hot_candidates(const struct_decl_list *items,
+					  int select_no);
+
 };
 
 const struct_header_named *find_decl(const struct_decl* decl,bool subevent);
 
 void generate_unpack_code(struct_definition *structure);
 void generate_unpack_code(event_definition *event);
+void generate_unpack_defines();
 
 void gen_subevent_names(const event_definition *evt,dumper &d);
 